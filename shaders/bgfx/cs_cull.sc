@@ -0,0 +1,32 @@
+#include <bgfx_compute.sh>
+
+// Every sprite is 4 vec4s, laid out like SpriteData / i_data0..3
+BUFFER_RO(s_sprites, vec4, 0);
+BUFFER_WR(s_visibleSprites, vec4, 1);
+BUFFER_RW(s_visibleCount, uint, 2);
+
+uniform vec4 u_cullView;   // xy = top-left, zw = bottom-right, in world space
+uniform vec4 u_cullParams; // x = sprite count
+
+// Tests every sprite against the view and appends the visible ones to s_visibleSprites
+NUM_THREADS(64, 1, 1)
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(u_cullParams.x)) {
+        return;
+    }
+
+    vec4 data0 = s_sprites[index * 4u];
+    if (data0.x + data0.z < u_cullView.x || data0.x > u_cullView.z ||
+        data0.y + data0.w < u_cullView.y || data0.y > u_cullView.w) {
+        return;
+    }
+
+    uint slot;
+    atomicFetchAndAdd(s_visibleCount[0], 1u, slot);
+    s_visibleSprites[slot * 4u + 0u] = data0;
+    s_visibleSprites[slot * 4u + 1u] = s_sprites[index * 4u + 1u];
+    s_visibleSprites[slot * 4u + 2u] = s_sprites[index * 4u + 2u];
+    s_visibleSprites[slot * 4u + 3u] = s_sprites[index * 4u + 3u];
+}
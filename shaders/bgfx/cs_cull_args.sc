@@ -0,0 +1,12 @@
+#include <bgfx_compute.sh>
+
+BUFFER_RW(s_visibleCount, uint, 0);
+BUFFER_RW(s_drawArgs, uvec4, 1);
+
+// Turns the visible sprite count into indirect draw arguments and resets it for the next frame
+NUM_THREADS(1, 1, 1)
+void main()
+{
+    drawIndirect(s_drawArgs, 0, 6u, s_visibleCount[0], 0u, 0u);
+    s_visibleCount[0] = 0u;
+}
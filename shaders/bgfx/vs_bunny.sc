@@ -4,12 +4,14 @@ $output v_texcoord0, v_color0
 
 #include <bgfx_shader.sh>
 
+uniform vec4 u_interpolation; // x = how far to go from the previous position to the current one
+
 void main() {
-    vec2 position = i_data0.xy;
+    // i_data1.yz is the position before the last --tick-rate step, i_data1.w is padding
+    vec2 position = mix(i_data1.yz, i_data0.xy, u_interpolation.x);
     vec2 size = i_data0.zw;
 
     float rotation = i_data1.x;
-    // i_data1.yzw are all padding
     float tu = i_data2.x;
     float tv = i_data2.y;
     float tw = i_data2.z;
@@ -0,0 +1,39 @@
+struct SpriteData
+{
+    float3 Position;
+    float Rotation;
+    float2 Scale;
+    float2 PreviousPosition;
+    float TexU, TexV, TexW, TexH;
+    float4 Color;
+};
+
+// See PullSpriteBatch.vert.hlsl for the StructuredBuffer caveat.
+StructuredBuffer<SpriteData> Sprites : register(t0, space0);
+RWStructuredBuffer<SpriteData> VisibleSprites : register(u0, space1);
+// Laid out as an SDL_GPUIndirectDrawCommand; only num_vertices is written here
+RWStructuredBuffer<uint> DrawArgs : register(u1, space1);
+
+cbuffer UniformBlock : register(b0, space2)
+{
+    float4 View;      // xy = top-left, zw = bottom-right, in world space
+    uint SpriteCount;
+};
+
+// Tests every sprite against the view and appends the visible ones to VisibleSprites,
+// growing the indirect vertex count by 6 for each of them
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    if (id.x >= SpriteCount) return;
+
+    SpriteData sprite = Sprites[id.x];
+    if (sprite.Position.x + sprite.Scale.x < View.x || sprite.Position.x > View.z ||
+        sprite.Position.y + sprite.Scale.y < View.y || sprite.Position.y > View.w) {
+        return;
+    }
+
+    uint firstVertex;
+    InterlockedAdd(DrawArgs[0], 6, firstVertex);
+    VisibleSprites[firstVertex / 6] = sprite;
+}
@@ -0,0 +1,64 @@
+struct SpriteData
+{
+    float3 Position;
+    float Rotation;
+    float2 Scale;
+    float2 PreviousPosition; // before the last --tick-rate step
+    float TexU, TexV, TexW, TexH;
+    float4 Color;
+};
+
+struct Output
+{
+    float2 Texcoord : TEXCOORD0;
+    float4 Color : TEXCOORD1;
+    float4 Position : SV_Position;
+};
+
+// See PullSpriteBatch.vert.hlsl for the StructuredBuffer caveat.
+StructuredBuffer<SpriteData> DataBuffer : register(t0, space0);
+
+cbuffer UniformBlock : register(b0, space1)
+{
+    float4x4 ViewProjectionMatrix : packoffset(c0);
+    float4 Interpolation : packoffset(c4); // x = how far to go from the previous position to the current one
+};
+
+static const float2 vertexPos[4] = {
+    {0.0f, 0.0f},
+    {1.0f, 0.0f},
+    {0.0f, 1.0f},
+    {1.0f, 1.0f}
+};
+
+// One instance per sprite; the quad corner comes from a shared 4-vertex index buffer
+Output main(uint vert : SV_VertexID, uint spriteIndex : SV_InstanceID)
+{
+    SpriteData sprite = DataBuffer[spriteIndex];
+
+    float2 texcoord[4] = {
+        {sprite.TexU,               sprite.TexV              },
+        {sprite.TexU + sprite.TexW, sprite.TexV              },
+        {sprite.TexU,               sprite.TexV + sprite.TexH},
+        {sprite.TexU + sprite.TexW, sprite.TexV + sprite.TexH}
+    };
+
+    float c = cos(sprite.Rotation);
+    float s = sin(sprite.Rotation);
+
+    float2 coord = vertexPos[vert];
+    coord *= sprite.Scale;
+    float2x2 rotation = {c, s, -s, c};
+    coord = mul(coord, rotation);
+
+    float2 position = lerp(sprite.PreviousPosition, sprite.Position.xy, Interpolation.x);
+    float3 coordWithDepth = float3(coord + position, sprite.Position.z);
+
+    Output output;
+
+    output.Position = mul(ViewProjectionMatrix, float4(coordWithDepth, 1.0f));
+    output.Texcoord = texcoord[vert];
+    output.Color = sprite.Color;
+
+    return output;
+}
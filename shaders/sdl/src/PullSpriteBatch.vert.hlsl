@@ -3,7 +3,7 @@ struct SpriteData
     float3 Position;
     float Rotation;
     float2 Scale;
-    float2 Padding;
+    float2 PreviousPosition; // before the last --tick-rate step
     float TexU, TexV, TexW, TexH;
     float4 Color;
 };
@@ -24,6 +24,7 @@ StructuredBuffer<SpriteData> DataBuffer : register(t0, space0);
 cbuffer UniformBlock : register(b0, space1)
 {
     float4x4 ViewProjectionMatrix : packoffset(c0);
+    float4 Interpolation : packoffset(c4); // x = how far to go from the previous position to the current one
 };
 
 static const uint triangleIndices[6] = {0, 1, 2, 3, 2, 1};
@@ -55,7 +56,8 @@ Output main(uint id : SV_VertexID)
     float2x2 rotation = {c, s, -s, c};
     coord = mul(coord, rotation);
 
-    float3 coordWithDepth = float3(coord + sprite.Position.xy, sprite.Position.z);
+    float2 position = lerp(sprite.PreviousPosition, sprite.Position.xy, Interpolation.x);
+    float3 coordWithDepth = float3(coord + position, sprite.Position.z);
 
     Output output;
 
@@ -0,0 +1,30 @@
+struct Input
+{
+    float2 Position : TEXCOORD0;
+    float2 Texcoord : TEXCOORD1;
+    float4 Color : TEXCOORD2;
+};
+
+struct Output
+{
+    float2 Texcoord : TEXCOORD0;
+    float4 Color : TEXCOORD1;
+    float4 Position : SV_Position;
+};
+
+cbuffer UniformBlock : register(b0, space1)
+{
+    float4x4 ViewProjectionMatrix : packoffset(c0);
+};
+
+// Vertices are already expanded to screen space on the CPU
+Output main(Input input)
+{
+    Output output;
+
+    output.Position = mul(ViewProjectionMatrix, float4(input.Position, 0.0f, 1.0f));
+    output.Texcoord = input.Texcoord;
+    output.Color = input.Color;
+
+    return output;
+}
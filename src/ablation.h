@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <ostream>
+#include <random>
+
+#include "alloc_tracker.h"
+#include "bunnies.h"
+
+// Parts of the frame the ablation mode switches off, one per run of the scenario after the
+// baseline. The last two only run with --morton, without the Z-order and then also with zero-area
+// sprites, to tell what the order does to the fill.
+enum class Ablation : uint8_t { None, Simulation, Upload, Fill, Viewport, Present, Unordered, UnorderedFill, Count };
+constexpr const char* ABLATION_NAMES[] = {
+    "baseline", "no simulation", "no upload", "zero-area sprites", "1x1 viewport", "no present", "no Z-order",
+    "no Z-order, zero-area"
+};
+// What the difference to the baseline is attributed to
+constexpr const char* ABLATION_COSTS[] = {"", "simulation", "upload", "fill", "fill and target size", "present", "Z-order", ""};
+
+// Frames of every run that are not measured, so caches, drivers and clocks settle first
+constexpr uint32_t ABLATION_WARMUP_FRAMES = 60;
+
+// Bottleneck attribution (--ablate): plays the same scenario once as the baseline and once per
+// ablation, then reports the cost of each part as the frame time it saves. Every run starts from
+// the bunnies and random state of the first frame. Costs only add up when nothing overlaps: work
+// the CPU does while the GPU is the bottleneck, or the other way round, costs nothing here.
+// With spatial ordering (--morton) it also compares the frame time and the fill cost without it.
+class AblationRunner {
+public:
+    AblationRunner(const bool enabled, const uint32_t measuredFrames, const bool spatialOrder)
+        : isEnabled(enabled), measuredFrames(measuredFrames > 0 ? measuredFrames : 1), spatialOrder(spatialOrder) {}
+
+    bool enabled() const { return isEnabled; }
+    bool active(const Ablation ablation) const {
+        if (!isEnabled) return false;
+        if (current == Ablation::UnorderedFill) {
+            return ablation == Ablation::UnorderedFill || ablation == Ablation::Unordered || ablation == Ablation::Fill;
+        }
+        return current == ablation;
+    }
+    bool done() const { return current == Ablation::Count; }
+
+    // Call at the top of every frame with the time of the previous one. Returns true when another
+    // run starts with this frame, or when all are done, after putting the bunnies and `rng` back
+    // to where the first run started. Every run gets the --no-alloc-after warmup again, restoring
+    // the bunnies and whatever the caller sets up for the run may allocate.
+    bool beginFrame(const float millis, Bunnies& bunnies, std::mt19937& rng) {
+        if (!isEnabled || done()) return false;
+        if (!started) {
+            started = true;
+            allocationTracker.restartWarmup();
+            startBunnies = bunnies;
+            startRng = rng;
+            announce();
+            return true;
+        }
+
+        const auto run = static_cast<size_t>(current);
+        if (frame >= ABLATION_WARMUP_FRAMES) {
+            totalMillis[run] += millis;
+        }
+        if (++frame < ABLATION_WARMUP_FRAMES + measuredFrames) return false;
+
+        frame = 0;
+        current = static_cast<Ablation>(run + 1);
+        while (!done() && skipped(current)) {
+            current = static_cast<Ablation>(static_cast<size_t>(current) + 1);
+        }
+        allocationTracker.restartWarmup();
+        if (!done()) {
+            bunnies = startBunnies;
+            rng = startRng;
+            announce();
+        }
+        return true;
+    }
+
+    // Frame time of every run and the cost attributed to each part. The rest is what no ablation
+    // removed: vertex processing, command submission and the driver.
+    void report(std::ostream& out) const {
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        const double baseline = averageMillis(Ablation::None);
+        double rest = baseline;
+        out << std::fixed << std::setprecision(3)
+            << "Ablation over " << measuredFrames << " frames each:" << std::endl;
+        for (size_t run = 0; run < static_cast<size_t>(Ablation::Count); run++) {
+            const auto ablation = static_cast<Ablation>(run);
+            if (skipped(ablation)) continue;
+            const double millis = averageMillis(ablation);
+            out << "  " << std::left << std::setw(22) << ABLATION_NAMES[run] << std::right
+                << std::setw(9) << millis << " ms/frame";
+            if (run > 0 && ablation != Ablation::UnorderedFill) {
+                const double cost = baseline - millis;
+                out << ", " << ABLATION_COSTS[run] << ": " << cost << " ms ("
+                    << std::setprecision(1) << (baseline > 0 ? cost * 100 / baseline : 0) << "%)"
+                    << std::setprecision(3);
+                // The viewport run overlaps the fill one, and the Z-order is not a part of the frame
+                // but changes the others, so neither counts towards the rest
+                if (ablation != Ablation::Viewport && ablation != Ablation::Unordered) rest -= cost;
+            }
+            out << std::endl;
+        }
+        out << "  rest (vertex processing, submission, driver): " << rest << " ms/frame" << std::endl;
+        if (spatialOrder) {
+            // Negative costs are what the order saves, the frame time one net of the reorders
+            const double orderedFill = baseline - averageMillis(Ablation::Fill);
+            const double unorderedFill = averageMillis(Ablation::Unordered) - averageMillis(Ablation::UnorderedFill);
+            out << "  Z-order: fill " << orderedFill << " ms/frame instead of " << unorderedFill << " ("
+                << std::showpos << orderedFill - unorderedFill << " ms), frame time "
+                << baseline - averageMillis(Ablation::Unordered) << " ms" << std::noshowpos << std::endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    bool skipped(const Ablation run) const {
+        return !spatialOrder && (run == Ablation::Unordered || run == Ablation::UnorderedFill);
+    }
+
+    double averageMillis(const Ablation run) const {
+        return totalMillis[static_cast<size_t>(run)] / measuredFrames;
+    }
+
+    void announce() const {
+        std::cout << "Ablation run: " << ABLATION_NAMES[static_cast<size_t>(current)] << std::endl;
+    }
+
+    bool isEnabled;
+    uint32_t measuredFrames;
+    bool spatialOrder;
+    bool started = false;
+    Ablation current = Ablation::None;
+    uint32_t frame = 0; // within the current run, warmup included
+    double totalMillis[static_cast<size_t>(Ablation::Count)]{};
+    Bunnies startBunnies;
+    std::mt19937 startRng;
+};
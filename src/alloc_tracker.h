@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <ostream>
+
+// Where an allocation came from: the global operator new (see tracking_new.h), SDL's memory
+// functions, bgfx's allocator or the large-page bunny storage
+enum class AllocSource : uint8_t { New, SDL, Bgfx, LargePages, Count };
+constexpr const char* ALLOC_SOURCE_NAMES[] = {"operator new", "SDL", "bgfx", "large pages"};
+
+// Part of the frame an allocation is attributed to. Allocations made on other threads, like the
+// worker pool or bgfx's render thread, count towards whatever phase the main thread is in.
+enum class AllocPhase : uint8_t { Startup, Events, Report, Simulate, Cull, Render, Count };
+constexpr const char* ALLOC_PHASE_NAMES[] = {"startup", "events", "report", "simulate", "cull", "render"};
+
+// Counts heap allocations and their bytes per phase and source, and how many frames allocated
+// at all. Frees are not counted, the goal is a frame loop that never touches the heap. With
+// failAfterFrame(N), any allocation after the first N frames prints where it happened and
+// aborts, and restartWarmup() grants another N frames to setup work in the middle of the frame
+// loop. Constant-initialized, so allocations made before main are counted too.
+class AllocationTracker {
+public:
+    constexpr AllocationTracker() = default;
+
+    void record(const AllocSource source, const size_t bytes) {
+        const auto phase = static_cast<size_t>(currentPhase.load(std::memory_order_relaxed));
+        const auto sourceIndex = static_cast<size_t>(source);
+        phaseCounts[phase].fetch_add(1, std::memory_order_relaxed);
+        phaseBytes[phase].fetch_add(bytes, std::memory_order_relaxed);
+        sourceCounts[sourceIndex].fetch_add(1, std::memory_order_relaxed);
+        totalCount.fetch_add(1, std::memory_order_relaxed);
+        if (armed.load(std::memory_order_relaxed)) fail(source, bytes);
+    }
+
+    void setPhase(const AllocPhase phase) { currentPhase.store(phase, std::memory_order_relaxed); }
+
+    // Negative to never fail
+    void failAfterFrame(const long warmupFrames) { failFrame = warmupFrames; }
+
+    // Disarms the check for the rest of this frame and the N frames after it, for setup that
+    // allocates again, like the next run of --ablate or --renderer all
+    void restartWarmup() {
+        armed.store(false, std::memory_order_relaxed);
+        warmupStartFrame = frame;
+    }
+
+    // Closes the previous frame and starts the next one in AllocPhase::Events
+    void beginFrame() {
+        const uint64_t total = totalCount.load(std::memory_order_relaxed);
+        if (frame > 0) {
+            const uint64_t frameCount = total - frameStartCount;
+            if (frameCount > 0) allocatingFrames++;
+            maxPerFrame = std::max(maxPerFrame, frameCount);
+            reportedFrames++;
+        }
+        frameStartCount = total;
+        frame++;
+        if (failFrame >= 0 && frame - warmupStartFrame > static_cast<uint64_t>(failFrame)) {
+            armed.store(true, std::memory_order_relaxed);
+        }
+        setPhase(AllocPhase::Events);
+    }
+
+    // Prints the allocations since the last report, by phase and by source, then resets them
+    void report(std::ostream& out) {
+        uint64_t counts[static_cast<size_t>(AllocPhase::Count)];
+        uint64_t bytes[static_cast<size_t>(AllocPhase::Count)];
+        uint64_t count = 0, byteCount = 0;
+        for (size_t i = 0; i < std::size(phaseCounts); i++) {
+            counts[i] = phaseCounts[i].exchange(0, std::memory_order_relaxed);
+            bytes[i] = phaseBytes[i].exchange(0, std::memory_order_relaxed);
+            count += counts[i];
+            byteCount += bytes[i];
+        }
+
+        out << "Allocations: " << count << " (" << byteCount << " bytes) in " << allocatingFrames
+            << " of " << reportedFrames << " frames, max " << maxPerFrame << " per frame";
+        for (size_t i = 0; i < std::size(counts); i++) {
+            if (counts[i] > 0) out << ", " << ALLOC_PHASE_NAMES[i] << ": " << counts[i] << " (" << bytes[i] << " bytes)";
+        }
+        for (size_t i = 0; i < std::size(sourceCounts); i++) {
+            const uint64_t sourceCount = sourceCounts[i].exchange(0, std::memory_order_relaxed);
+            if (sourceCount > 0) out << ", from " << ALLOC_SOURCE_NAMES[i] << ": " << sourceCount;
+        }
+        out << std::endl;
+        allocatingFrames = 0;
+        reportedFrames = 0;
+        maxPerFrame = 0;
+    }
+
+private:
+    // Runs inside the allocator, so it reports through stdio without allocating and disarms
+    // first in case the C library allocates anyway
+    void fail(const AllocSource source, const size_t bytes) {
+        armed.store(false, std::memory_order_relaxed);
+        std::fprintf(
+            stderr,
+            "Allocation of %zu bytes through %s in the %s phase of frame %llu, after %ld warmup frames\n",
+            bytes,
+            ALLOC_SOURCE_NAMES[static_cast<size_t>(source)],
+            ALLOC_PHASE_NAMES[static_cast<size_t>(currentPhase.load(std::memory_order_relaxed))],
+            static_cast<unsigned long long>(frame),
+            failFrame
+        );
+        std::abort();
+    }
+
+    std::atomic<uint64_t> phaseCounts[static_cast<size_t>(AllocPhase::Count)]{};
+    std::atomic<uint64_t> phaseBytes[static_cast<size_t>(AllocPhase::Count)]{};
+    std::atomic<uint64_t> sourceCounts[static_cast<size_t>(AllocSource::Count)]{};
+    std::atomic<uint64_t> totalCount = 0;
+    std::atomic<AllocPhase> currentPhase = AllocPhase::Startup;
+    std::atomic<bool> armed = false;
+
+    // Main thread only
+    long failFrame = -1;
+    uint64_t frame = 0;
+    uint64_t warmupStartFrame = 0;
+    uint64_t frameStartCount = 0;
+    uint64_t allocatingFrames = 0, reportedFrames = 0, maxPerFrame = 0;
+};
+
+constinit inline AllocationTracker allocationTracker;
+
+// malloc-family functions that count into allocationTracker, for libraries that take their own
+// memory functions like SDL_SetMemoryFunctions
+template<AllocSource source>
+void* trackedMalloc(const size_t size) {
+    allocationTracker.record(source, size);
+    return std::malloc(size);
+}
+
+template<AllocSource source>
+void* trackedCalloc(const size_t count, const size_t size) {
+    allocationTracker.record(source, count * size);
+    return std::calloc(count, size);
+}
+
+template<AllocSource source>
+void* trackedRealloc(void* memory, const size_t size) {
+    if (size > 0) allocationTracker.record(source, size);
+    return std::realloc(memory, size);
+}
+
+inline void trackedFree(void* memory) {
+    std::free(memory);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+// Tiny command line helpers shared by the bunnymark binaries.
+// Options are always of the form `--name value` or a bare `--flag`.
+
+inline const char* getArg(const int argc, char* argv[], const char* name, const char* fallback) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (std::strcmp(argv[i], name) == 0) return argv[i + 1];
+    }
+    return fallback;
+}
+
+inline bool hasArg(const int argc, char* argv[], const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+inline long getIntArg(const int argc, char* argv[], const char* name, const long fallback) {
+    const char* value = getArg(argc, argv, name, nullptr);
+    return value ? std::strtol(value, nullptr, 10) : fallback;
+}
+
+inline float getFloatArg(const int argc, char* argv[], const char* name, const float fallback) {
+    const char* value = getArg(argc, argv, name, nullptr);
+    return value ? std::strtof(value, nullptr) : fallback;
+}
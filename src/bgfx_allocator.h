@@ -0,0 +1,18 @@
+#pragma once
+
+#include <bx/allocator.h>
+
+#include "alloc_tracker.h"
+
+// bx allocator passed through bgfx::Init::allocator, counting bgfx's allocations into
+// allocationTracker before handing them to bx's default allocator. Must outlive bgfx::shutdown.
+class TrackingBgfxAllocator : public bx::AllocatorI {
+public:
+    void* realloc(void* memory, const size_t size, const size_t align, const char* filePath, const uint32_t line) override {
+        if (size > 0) allocationTracker.record(AllocSource::Bgfx, size);
+        return allocator.realloc(memory, size, align, filePath, line);
+    }
+
+private:
+    bx::DefaultAllocator allocator;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdlib>
+
+#include "bgfx/bgfx.h"
+#include "SDL3/SDL_log.h"
+
+#include "pipeline_cache.h"
+
+// bgfx callbacks that back bgfx's shader, program and pipeline cache with an on-disk
+// PipelineCache. The ids bgfx passes in already hash the shader code and the device.
+// Everything else keeps bgfx's default behaviour of doing nothing.
+class BgfxCallback : public bgfx::CallbackI {
+public:
+    explicit BgfxCallback(PipelineCache& cache) : cache(cache) {}
+
+    void fatal(const char* filePath, const uint16_t line, const bgfx::Fatal::Enum code, const char* str) override {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "bgfx fatal error at %s:%d: %s", filePath, line, str);
+        if (code != bgfx::Fatal::DebugCheck) std::abort();
+    }
+
+    void traceVargs(const char*, uint16_t, const char*, va_list) override {}
+    void profilerBegin(const char*, uint32_t, const char*, uint16_t) override {}
+    void profilerBeginLiteral(const char*, uint32_t, const char*, uint16_t) override {}
+    void profilerEnd() override {}
+
+    uint32_t cacheReadSize(const uint64_t id) override {
+        return cache.readSize(id);
+    }
+
+    bool cacheRead(const uint64_t id, void* data, const uint32_t size) override {
+        return cache.read(id, data, size);
+    }
+
+    void cacheWrite(const uint64_t id, const void* data, const uint32_t size) override {
+        cache.write(id, data, size);
+    }
+
+    void screenShot(const char*, uint32_t, uint32_t, uint32_t, const void*, uint32_t, bool) override {}
+    void captureBegin(uint32_t, uint32_t, uint32_t, bgfx::TextureFormat::Enum, bool) override {}
+    void captureEnd() override {}
+    void captureFrame(const void*, uint32_t) override {}
+
+private:
+    PipelineCache& cache;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+// Growth policy and bookkeeping for GPU-side buffers whose required size changes at runtime,
+// e.g. in churn mode. Buffers grow by at least half their capacity, so a steadily growing
+// population reallocates O(log n) times, and never shrink. Every frame that had to reallocate
+// is logged, since that is where allocation spikes come from. Allocations made before the
+// first frame are not counted.
+class BufferGrowth {
+public:
+    // Capacity to reallocate to if `required` does not fit into `capacity`, else `capacity`
+    static uint32_t grow(const uint32_t capacity, const uint32_t required, const uint32_t limit) {
+        if (required <= capacity) return capacity;
+        return std::min(limit, std::max(required, capacity + capacity / 2));
+    }
+
+    void beginFrame() {
+        frame++;
+        reallocatedThisFrame = false;
+    }
+
+    void recordReallocation(const char* buffer, const uint64_t oldBytes, const uint64_t newBytes) {
+        if (frame == 0) return;
+        if (!reallocatedThisFrame) {
+            reallocatedThisFrame = true;
+            reallocatingFrames++;
+        }
+        std::cout << "Frame " << frame << " reallocated " << buffer << ": "
+            << oldBytes << " -> " << newBytes << " bytes" << std::endl;
+    }
+
+    uint32_t reallocatingFrameCount() const { return reallocatingFrames; }
+
+private:
+    uint64_t frame = 0;
+    uint32_t reallocatingFrames = 0;
+    bool reallocatedThisFrame = false;
+};
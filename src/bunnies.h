@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "args.h"
+#include "large_page_allocator.h"
+#include "world.h"
+
+constexpr float BUNNY_SIZE = 32.0f;
+
+// Bunnies are addressed by 32-bit indices everywhere (culling, sorting, collisions), so the
+// population is capped well below that. Byte sizes derived from a count are always 64-bit.
+constexpr uint32_t MAX_BUNNIES = 1u << 27;
+
+// `--bunnies N` overrides the binary's default population, e.g. 10000000 for a ten-million run
+inline uint32_t getBunnyCount(const int argc, char* argv[], const uint32_t fallback) {
+    return static_cast<uint32_t>(std::clamp<long long>(getIntArg(argc, argv, "--bunnies", fallback), 1, MAX_BUNNIES));
+}
+
+// A single bunny, only used to spawn into the store
+struct Bunny {
+    float x, y;
+    float vx, vy;
+};
+
+// One component of every bunny, backed by large pages once it holds a few hundred thousand bunnies
+using BunnyArray = std::vector<float, LargePageAllocator<float>>;
+
+// Bunny state in structure-of-arrays layout, so the per-frame loops vectorize
+struct Bunnies {
+    BunnyArray x, y;
+    BunnyArray vx, vy;
+
+    size_t size() const { return x.size(); }
+
+    void reserve(const size_t count) {
+        x.reserve(count);
+        y.reserve(count);
+        vx.reserve(count);
+        vy.reserve(count);
+    }
+
+    void push_back(const Bunny& bunny) {
+        x.push_back(bunny.x);
+        y.push_back(bunny.y);
+        vx.push_back(bunny.vx);
+        vy.push_back(bunny.vy);
+    }
+
+    // O(1) removal that moves the last bunny into the hole, so bunny order is not stable
+    void swapRemove(const size_t index) {
+        x[index] = x.back();
+        y[index] = y.back();
+        vx[index] = vx.back();
+        vy[index] = vy.back();
+        x.pop_back();
+        y.pop_back();
+        vx.pop_back();
+        vy.pop_back();
+    }
+
+    // Moves every bunny and bounces it off the world bounds
+    void update(const float dt, const World& world) {
+        const float maxX = world.width - BUNNY_SIZE;
+        const float maxY = world.height - BUNNY_SIZE;
+        float* __restrict px = x.data();
+        float* __restrict py = y.data();
+        float* __restrict pvx = vx.data();
+        float* __restrict pvy = vy.data();
+
+        const size_t count = size();
+        for (size_t i = 0; i < count; i++) {
+            px[i] += pvx[i] * dt;
+            py[i] += pvy[i] * dt;
+
+            pvx[i] = px[i] < 0 || px[i] > maxX ? -pvx[i] : pvx[i];
+            pvy[i] = py[i] < 0 || py[i] > maxY ? -pvy[i] : pvy[i];
+        }
+    }
+};
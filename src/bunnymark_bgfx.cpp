@@ -1,25 +1,66 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <ctime>
-#include <fstream>
 #include <iostream>
 #include <ostream>
 #include <random>
+#include <string>
+#include <vector>
 
 #include "SDL3/SDL_init.h"
 
 #include "bgfx/bgfx.h"
 #include "bgfx/platform.h"
-#include "bimg/decode.h"
-#include "bx/allocator.h"
 #include "bx/math.h"
 #include "SDL3/SDL_log.h"
 
+#include "ablation.h"
+#include "args.h"
+#include "bgfx_allocator.h"
+#include "bgfx_callback.h"
+#include "buffer_growth.h"
+#include "bunnies.h"
+#include "churn.h"
+#include "collision.h"
+#include "energy_meter.h"
+#include "fixed_timestep.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "mapped_file.h"
+#include "morton_order.h"
+#include "occlusion_cull.h"
+#include "perf_counters.h"
+#include "pipeline_cache.h"
+#include "spatial_grid.h"
+#include "sprite_feed.h"
+#include "sprite_sort.h"
+#include "startup_profiler.h"
+#include "static_layer.h"
+#include "texture_pack.h"
+#include "tracking_new.h"
+#include "workload_log.h"
+#include "world.h"
+
 using namespace std::chrono;
 
 constexpr int WINDOW_WIDTH = 800;
 constexpr int WINDOW_HEIGHT = 600;
 constexpr int NUM_BUNNIES = 70000;
 
+// Sprites per instance buffer and draw call. Vulkan only guarantees 128 MiB of storage buffer
+// range, i.e. 2M 64-byte sprites, and 2M sprites are 32768 cull groups, below the 65535 limit
+// on dispatch size. Larger populations are split into chunks of this many sprites.
+constexpr uint32_t MAX_SPRITES_PER_DRAW = 1 << 21;
+
+// Compute work (GPU culling) runs in a view ahead of the sprites, and so does redrawing the static
+// layer they are drawn over
+constexpr bgfx::ViewId CULL_VIEW = 0;
+constexpr bgfx::ViewId STATIC_LAYER_VIEW = 1;
+constexpr bgfx::ViewId SPRITE_VIEW = 2;
+// Blitting a captured frame into its read-back texture runs after the sprites are drawn
+constexpr bgfx::ViewId CAPTURE_VIEW = 3;
+
 struct Vertex {
     float x, y;
     float u, v;
@@ -38,11 +79,93 @@ bgfx::VertexLayout Vertex::layout;
 
 struct SpriteData {
     float x, y, w, h;
-    float rotation, p1, p2, p3; // pX = padding
+    float rotation, prevX, prevY, p3; // position before the last --tick-rate step, p3 = padding
     float tu, tv, tw, th;
     float r, g, b, a;
+
+    // Matches i_data0..3, used when sprites live in a GPU-side instance buffer
+    static bgfx::VertexLayout layout;
+    static void init() {
+        layout
+            .begin()
+            .add(bgfx::Attrib::TexCoord7, 4, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord6, 4, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord5, 4, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord4, 4, bgfx::AttribType::Float)
+            .end();
+    }
+};
+
+bgfx::VertexLayout SpriteData::layout;
+
+// GPU-side buffers of one chunk of sprites, each uploaded, culled and drawn on its own. Used for
+// GPU culling and, in churn mode, as growable instance buffers. The cull buffers only exist with
+// GPU culling.
+struct SpriteChunk {
+    uint32_t capacity;
+    bgfx::DynamicVertexBufferHandle spriteBuffer;
+    bgfx::DynamicVertexBufferHandle visibleSpriteBuffer;
+    bgfx::DynamicIndexBufferHandle visibleCountBuffer;
+    bgfx::IndirectBufferHandle drawArgsBuffer;
 };
 
+SpriteChunk createSpriteChunk(const uint32_t capacity, const bool gpuCull) {
+    if (!gpuCull) {
+        return {
+            .capacity = capacity,
+            .spriteBuffer = bgfx::createDynamicVertexBuffer(capacity, SpriteData::layout),
+            .visibleSpriteBuffer = BGFX_INVALID_HANDLE,
+            .visibleCountBuffer = BGFX_INVALID_HANDLE,
+            .drawArgsBuffer = BGFX_INVALID_HANDLE
+        };
+    }
+    constexpr uint32_t zero = 0;
+    return {
+        .capacity = capacity,
+        .spriteBuffer = bgfx::createDynamicVertexBuffer(capacity, SpriteData::layout, BGFX_BUFFER_COMPUTE_READ),
+        .visibleSpriteBuffer = bgfx::createDynamicVertexBuffer(capacity, SpriteData::layout, BGFX_BUFFER_COMPUTE_WRITE),
+        .visibleCountBuffer = bgfx::createDynamicIndexBuffer(
+            bgfx::copy(&zero, sizeof(zero)),
+            BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32
+        ),
+        .drawArgsBuffer = bgfx::createIndirectBuffer(1)
+    };
+}
+
+void destroySpriteChunk(const SpriteChunk& chunk) {
+    bgfx::destroy(chunk.spriteBuffer);
+    if (bgfx::isValid(chunk.visibleSpriteBuffer)) {
+        bgfx::destroy(chunk.visibleSpriteBuffer);
+        bgfx::destroy(chunk.visibleCountBuffer);
+        bgfx::destroy(chunk.drawArgsBuffer);
+    }
+}
+
+// Makes room for `count` sprites, growing each chunk geometrically up to MAX_SPRITES_PER_DRAW
+// and appending chunks as needed. bgfx defers destroying the old buffers until the GPU is done.
+void growSpriteChunks(std::vector<SpriteChunk>& chunks, const uint32_t count, const bool gpuCull, BufferGrowth& growth) {
+    for (uint32_t i = 0; i * static_cast<uint64_t>(MAX_SPRITES_PER_DRAW) < count; i++) {
+        const uint32_t required = std::min(count - i * MAX_SPRITES_PER_DRAW, MAX_SPRITES_PER_DRAW);
+        const uint32_t capacity = i < chunks.size() ? chunks[i].capacity : 0;
+        const uint32_t grown = BufferGrowth::grow(capacity, required, MAX_SPRITES_PER_DRAW);
+        if (grown == capacity) {
+            continue;
+        }
+
+        if (i < chunks.size()) {
+            destroySpriteChunk(chunks[i]);
+            chunks[i] = createSpriteChunk(grown, gpuCull);
+        } else {
+            chunks.push_back(createSpriteChunk(grown, gpuCull));
+        }
+        growth.recordReallocation(
+            "sprite buffers",
+            static_cast<uint64_t>(capacity) * sizeof(SpriteData),
+            static_cast<uint64_t>(grown) * sizeof(SpriteData)
+        );
+    }
+}
+
 void logError(const char* errorText) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s: %s", errorText, SDL_GetError());
 }
@@ -88,20 +211,91 @@ bgfx::ShaderHandle loadShader(const char* filename) {
             break;
     }
 
-    std::ifstream stream("shaders/bgfx/compiled/" + shaderFormat + "/" + filename + ".bin");
+    // Map the blob and hand bgfx a reference to it, bgfx unmaps it once it has created the shader
+    const std::string path = "shaders/bgfx/compiled/" + shaderFormat + "/" + filename + ".bin";
+    auto* file = new MappedFile(path.c_str());
+    if (!file->isOpen()) {
+        delete file;
+        return BGFX_INVALID_HANDLE;
+    }
+    const bgfx::Memory* mem = bgfx::makeRef(file->data(), file->size(), [](void*, void* userData) {
+        delete static_cast<MappedFile*>(userData);
+    }, file);
+    return bgfx::createShader(mem);
+}
+
+int main(int argc, char* argv[]) {
+    // Heap allocations counted per frame phase, SDL's included from its very first one
+    // (--track-allocs), optionally aborting on any allocation after N warmup frames (--no-alloc-after N)
+    SDL_SetMemoryFunctions(
+        trackedMalloc<AllocSource::SDL>,
+        trackedCalloc<AllocSource::SDL>,
+        trackedRealloc<AllocSource::SDL>,
+        trackedFree
+    );
+    const bool trackAllocations = hasArg(argc, argv, "--track-allocs") || hasArg(argc, argv, "--no-alloc-after");
+    allocationTracker.failAfterFrame(getIntArg(argc, argv, "--no-alloc-after", -1));
 
-    stream.seekg(0, std::ios::end);
-    const std::streamsize size = stream.tellg();
-    stream.seekg(0, std::ios::beg);
+    // Population (--bunnies N), defaulting to NUM_BUNNIES
+    const uint32_t population = getBunnyCount(argc, argv, NUM_BUNNIES);
+    // Sprite positions from a bunnymark_feeder process instead of the local simulation (--feed NAME)
+    SpriteFeed spriteFeed(argc, argv);
 
-    char data[size];
-    stream.read(data, size);
+    // Large-world mode (--world-scale N), optionally culled on the GPU (--gpu-cull)
+    // or on the CPU through a uniform grid (--cpu-cull)
+    const World world = getWorld(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool largeWorld = world.isLarge(WINDOW_WIDTH, WINDOW_HEIGHT);
+    bool gpuCull = hasArg(argc, argv, "--gpu-cull");
+    const bool cpuCull = !gpuCull && !spriteFeed.enabled() && hasArg(argc, argv, "--cpu-cull");
 
-    const bgfx::Memory* mem = bgfx::copy(data, size);
-    return bgfx::createShader(mem);
-}
+    // Cached static layer (--static P, --static-edits N): the frozen share of the population is drawn
+    // into a frame buffer once, only the rest of the bunnies are simulated, uploaded and drawn
+    StaticLayer staticLayer(argc, argv, population, world, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const uint32_t bunnyCount = population - staticLayer.size();
+
+    // Bunny–bunny collisions (--collide), spread over --threads N worker threads
+    const bool collide = hasArg(argc, argv, "--collide");
+    ThreadPool threadPool(static_cast<unsigned>(std::max(getIntArg(argc, argv, "--threads", std::thread::hardware_concurrency()), 1L)));
+    CollisionSystem collisions(threadPool);
+
+    // Churn mode (--churn P, --spawn P), spawning and despawning bunnies every frame
+    BunnyChurn churn(argc, argv);
+
+    // Depth sort of the drawn bunnies between simulation and fill (--sort), timed per frame
+    const bool sortSprites = !gpuCull && !spriteFeed.enabled() && hasArg(argc, argv, "--sort");
+    SpriteSorter sorter(threadPool);
+    // Z-order reordering of the bunny store every N simulation steps, for locality in the fill (--morton N)
+    MortonOrder mortonOrder(argc, argv, sorter);
+
+    // Fixed-timestep simulation, drawn interpolated between the last two steps (--tick-rate HZ)
+    FixedTimestep fixedTimestep(argc, argv);
+    // Recording of the frame times and state hashes, or a replay checking them (--record FILE, --replay FILE)
+    WorkloadLog workloadLog(argc, argv);
+    // Offscreen render of frame N, compared against a golden image (--capture-frame N, --golden FILE)
+    FrameCapture frameCapture(argc, argv);
+
+    // Culling of the sprites hidden under the opaque cores of later ones, before the fill (--occlusion-cull)
+    OcclusionCuller occlusionCuller(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Hardware counters of the main thread around simulation, fill and submit (--perf-counters, Linux only)
+    PerfCounters perfCounters(hasArg(argc, argv, "--perf-counters"));
+
+    // Package and DRAM energy over each report window (--energy, Linux powercap)
+    EnergyMeter energyMeter(hasArg(argc, argv, "--energy"));
+
+    // Bottleneck attribution (--ablate), replaying the scenario for --ablate-frames N frames per ablation
+    AblationRunner ablation(
+        hasArg(argc, argv, "--ablate"),
+        static_cast<uint32_t>(getIntArg(argc, argv, "--ablate-frames", 300)),
+        mortonOrder.enabled()
+    );
+
+    // Startup phases up to the first presented frame, with a cold pipeline cache if --cold-cache
+    // clears it first
+    StartupProfiler startup;
+    const bool coldCache = hasArg(argc, argv, "--cold-cache");
+    startup.mark("options");
 
-int main() {
     // Initial SDL setup
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         logError("Failed to initialize SDL");
@@ -122,12 +316,34 @@ int main() {
         return 1;
     }
 
+    startup.mark("SDL init");
+
+    // bgfx reads and writes its compiled shaders, programs and pipelines through the callback.
+    // Its cache ids already hash in the device, so all devices can share one directory.
+    PipelineCache pipelineCache("pipeline_cache");
+    if (coldCache) pipelineCache.clear();
+    pipelineCache.setDevice("bgfx");
+    const bool warmCache = pipelineCache.hasEntries();
+    startup.setVariant(warmCache ? "warm pipeline cache" : "cold pipeline cache");
+    BgfxCallback bgfxCallback(pipelineCache);
+    TrackingBgfxAllocator bgfxAllocator;
+
     // Initialize bgfx
     bgfx::Init init;
+    init.callback = &bgfxCallback;
+    init.allocator = &bgfxAllocator;
     // uncomment to change renderer
     // init.type = bgfx::RendererType::OpenGL;
     init.resolution.width = WINDOW_WIDTH;
     init.resolution.height = WINDOW_HEIGHT;
+    // Instance data is allocated from the transient vertex buffer, which bgfx sizes once at init. The
+    // static layer is drawn as one more sprite.
+    const uint64_t instanceBytesPerFrame = (static_cast<uint64_t>(bunnyCount) + 1) * sizeof(SpriteData);
+    init.limits.transientVbSize = static_cast<uint32_t>(std::clamp<uint64_t>(
+        instanceBytesPerFrame,
+        init.limits.transientVbSize,
+        UINT32_MAX
+    ));
     const SDL_PropertiesID props = SDL_GetWindowProperties(window);
 #if defined(SDL_PLATFORM_WIN32)
     init.platformData.nwh = SDL_GetPointerProperty(props, SDL_PROP_WINDOW_WIN32_HWND_POINTER, NULL);
@@ -150,44 +366,55 @@ int main() {
     init.platformData.nwh = reinterpret_cast<void*>("#canvas");
 #endif
     bgfx::init(init);
+    startup.mark("device creation");
 
-    bgfx::setViewClear(0, BGFX_CLEAR_COLOR, 0x8080ffff);
+    bgfx::setViewClear(SPRITE_VIEW, BGFX_CLEAR_COLOR, 0x8080ffff);
+
+    constexpr uint64_t requiredCullCaps = BGFX_CAPS_COMPUTE | BGFX_CAPS_DRAW_INDIRECT;
+    if (gpuCull && (bgfx::getCaps()->supported & requiredCullCaps) != requiredCullCaps) {
+        std::cout << "GPU culling needs compute and indirect draw support, drawing all sprites instead" << std::endl;
+        gpuCull = false;
+    }
 
     bgfx::setDebug(BGFX_DEBUG_STATS);
 
     // Load shaders
     const bgfx::ShaderHandle vertShader = loadShader("vs_bunny.sc");
     const bgfx::ShaderHandle fragShader = loadShader("fs_bunny.sc");
+    startup.mark("shader load");
     const bgfx::ProgramHandle program = bgfx::createProgram(vertShader, fragShader, true);
+    startup.mark("pipeline creation");
 
     //
     // Load bunny texture
     //
 
-    std::ifstream stream("../bunny.png", std::ios::binary);
-
-    stream.seekg(0, std::ios::end);
-    const std::streamsize size = stream.tellg();
-    stream.seekg(0, std::ios::beg);
-
-    char data[size];
-    stream.read(data, size);
-
-    bx::DefaultAllocator allocator;
-    bimg::ImageContainer* image = bimg::imageParse(&allocator, data, size);
-    const float w = image->m_width;
-    const float h = image->m_height;
+    // Uploaded straight from the memory-mapped texture pack made by the cook_textures target,
+    // the pack stays mapped until the end of main, after bgfx has consumed the reference
+    TexturePack texturePack;
+    const PackTexture* bunnyImage = texturePack.open("sprites.pack") ? texturePack.find("bunny") : nullptr;
+    if (!bunnyImage) {
+        SDL_SetError("No bunny in sprites.pack, build the cook_textures target");
+        logError("Failed to load texture");
+        bgfx::destroy(program);
+        bgfx::shutdown();
+        SDL_Quit();
+        return 1;
+    }
+    const float w = bunnyImage->width;
+    const float h = bunnyImage->height;
+    occlusionCuller.setSprite(texturePack.data(*bunnyImage), bunnyImage->width, bunnyImage->height, 0, 0);
     bgfx::TextureHandle bunnyTexture = bgfx::createTexture2D(
         w,
         h,
-        image->m_numMips > 1,
-        bx::max(image->m_numLayers, 1u),
-        static_cast<bgfx::TextureFormat::Enum>(image->m_format),
+        bunnyImage->mipCount > 1,
+        1,
+        bgfx::TextureFormat::RGBA8,
         // BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT,
     BGFX_TEXTURE_NONE,
-        bgfx::copy(image->m_data, image->m_size)
+        bgfx::makeRef(texturePack.data(*bunnyImage), static_cast<uint32_t>(bunnyImage->dataSize))
     );
-    bimg::imageFree(image);
+    startup.mark("texture upload");
 
     if (!bgfx::isValid(bunnyTexture)) {
         SDL_SetError("Texture invalid");
@@ -217,30 +444,69 @@ int main() {
     bgfx::InstanceDataBuffer instanceBuffer;
     size_t stride = sizeof(SpriteData);
 
-    // Create the sampler
+    // Create the sampler, and the factor the vertex shader interpolates sprite positions by
     const bgfx::UniformHandle sampler = bgfx::createUniform("s_texColor",  bgfx::UniformType::Sampler);
+    const bgfx::UniformHandle interpolation = bgfx::createUniform("u_interpolation", bgfx::UniformType::Vec4);
+
+    // Create the sprite chunks and the GPU culling resources: per chunk, the cull pass compacts
+    // visible sprites into visibleSpriteBuffer and counts them, then the args pass writes the
+    // indirect draw. In churn mode the chunks also replace the transient instance buffer, which
+    // bgfx sizes once at init, and grow with the population. The ablation mode uses them too, so
+    // the upload ablation has last frame's sprites to draw again, and so does --tick-rate, which
+    // only uploads on frames that stepped the simulation. With --feed they keep the last frame
+    // that arrived whole, rather than reading it again from a slot the feeder may be rewriting.
+    SpriteData::init();
+    const bool useSpriteChunks = gpuCull || churn.enabled() || ablation.enabled() || fixedTimestep.enabled()
+        || spriteFeed.enabled();
+    std::vector<SpriteChunk> spriteChunks;
+    BufferGrowth bufferGrowth;
+    if (useSpriteChunks) {
+        growSpriteChunks(spriteChunks, bunnyCount, gpuCull, bufferGrowth);
+    }
+
+    // The static layer's sprites get chunks of their own, only updated and drawn when it is redrawn
+    std::vector<SpriteChunk> staticChunks;
+    growSpriteChunks(staticChunks, staticLayer.size(), false, bufferGrowth);
+
+    bgfx::ProgramHandle cullProgram = BGFX_INVALID_HANDLE;
+    bgfx::ProgramHandle cullArgsProgram = BGFX_INVALID_HANDLE;
+    bgfx::UniformHandle cullView = BGFX_INVALID_HANDLE;
+    bgfx::UniformHandle cullParams = BGFX_INVALID_HANDLE;
+    if (gpuCull) {
+        cullProgram = bgfx::createProgram(loadShader("cs_cull.sc"), true);
+        cullArgsProgram = bgfx::createProgram(loadShader("cs_cull_args.sc"), true);
+        cullView = bgfx::createUniform("u_cullView", bgfx::UniformType::Vec4);
+        cullParams = bgfx::createUniform("u_cullParams", bgfx::UniformType::Vec4);
+    }
 
     //
     // Set up the bunnies
     //
 
-    struct Bunny {
-        float x, y;
-        float vx, vy;
-    };
-
-    std::vector<Bunny> bunnies;
+    Bunnies bunnies;
+    bunnies.reserve(bunnyCount);
     std::mt19937 rng; // NOLINT deterministic but that's fine here
     std::uniform_real_distribution dis{-1.0f, 1.0f};
 
-    for (int i = 0; i < NUM_BUNNIES; i++) {
-        bunnies.push_back({
-            .x = static_cast<float>(WINDOW_WIDTH) / 2,
-            .y = static_cast<float>(WINDOW_HEIGHT) / 2,
+    // In large-world and collision mode the bunnies start spread over the whole world instead of
+    // stacked at the center, where every bunny would overlap every other one. --uniform-spawn
+    // spreads them in any mode.
+    const bool spreadSpawn = largeWorld || collide || hasArg(argc, argv, "--uniform-spawn");
+    std::uniform_real_distribution spawnX{0.0f, world.width - 32};
+    std::uniform_real_distribution spawnY{0.0f, world.height - 32};
+
+    auto spawnBunny = [&] {
+        return Bunny{
+            .x = spreadSpawn ? spawnX(rng) : static_cast<float>(WINDOW_WIDTH) / 2,
+            .y = spreadSpawn ? spawnY(rng) : static_cast<float>(WINDOW_HEIGHT) / 2,
             .vx = dis(rng),
             .vy = dis(rng)
-        });
+        };
+    };
+    for (uint32_t i = 0; i < bunnyCount; i++) {
+        bunnies.push_back(spawnBunny());
     }
+    workloadLog.start(bunnies, world, fixedTimestep.tickMillis());
 
     //
     // Position the camera
@@ -264,23 +530,85 @@ int main() {
         false
     );
 
-    bgfx::setViewTransform(0, view, proj);
+    bgfx::setViewTransform(SPRITE_VIEW, view, proj);
+
+    Camera camera{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    SpatialGrid grid(world.width, world.height, getFloatArg(argc, argv, "--grid-cell", 128.0f));
+
+    // Per-frame CPU staging (culled index lists, sort keys, ...), --frame-arena N MiB to start with
+    FrameArena frameArena(static_cast<size_t>(std::max(getIntArg(argc, argv, "--frame-arena", DEFAULT_FRAME_ARENA_MIB), 1L)) << 20);
+
+    uint32_t drawCount = bunnyCount;
+
+    // bgfx always swaps the backbuffer in bgfx::frame(), so the present ablation can only render
+    // into this offscreen target instead and leave the swap of an untouched backbuffer
+    bgfx::FrameBufferHandle ablationTarget = BGFX_INVALID_HANDLE;
+    if (ablation.enabled()) {
+        ablationTarget = bgfx::createFrameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT, bgfx::TextureFormat::BGRA8);
+    }
+
+    // The captured frame is rendered into this frame buffer instead of the backbuffer, then blitted
+    // into a texture the CPU can read back, which arrives a couple of frames later
+    bgfx::FrameBufferHandle captureTarget = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle captureReadBack = BGFX_INVALID_HANDLE;
+    std::vector<uint8_t> capturePixels;
+    uint32_t captureReadyFrame = 0;
+    constexpr uint64_t requiredCaptureCaps = BGFX_CAPS_TEXTURE_BLIT | BGFX_CAPS_TEXTURE_READ_BACK;
+    if (frameCapture.enabled() && (bgfx::getCaps()->supported & requiredCaptureCaps) != requiredCaptureCaps) {
+        std::cout << "Frame capture needs texture blit and read-back support, not capturing" << std::endl;
+    } else if (frameCapture.enabled()) {
+        captureTarget = bgfx::createFrameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT, bgfx::TextureFormat::BGRA8);
+        captureReadBack = bgfx::createTexture2D(
+            WINDOW_WIDTH,
+            WINDOW_HEIGHT,
+            false,
+            1,
+            bgfx::TextureFormat::BGRA8,
+            BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK
+        );
+        capturePixels.resize(static_cast<size_t>(WINDOW_WIDTH) * WINDOW_HEIGHT * 4);
+    }
+
+    // The static layer, only rendered into when it changes and drawn under the moving bunnies as a
+    // single sprite every frame. The sprite view keeps submission order, so it stays underneath.
+    bgfx::FrameBufferHandle staticLayerTarget = BGFX_INVALID_HANDLE;
+    if (staticLayer.enabled()) {
+        staticLayerTarget = bgfx::createFrameBuffer(
+            static_cast<uint16_t>(staticLayer.width()),
+            static_cast<uint16_t>(staticLayer.height()),
+            bgfx::TextureFormat::BGRA8,
+            BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT
+        );
+        bgfx::setViewFrameBuffer(STATIC_LAYER_VIEW, staticLayerTarget);
+        bgfx::setViewRect(STATIC_LAYER_VIEW, 0, 0, static_cast<uint16_t>(staticLayer.width()), static_cast<uint16_t>(staticLayer.height()));
+        bgfx::setViewClear(STATIC_LAYER_VIEW, BGFX_CLEAR_COLOR, 0x8080ffff);
+        bgfx::setViewMode(SPRITE_VIEW, bgfx::ViewMode::Sequential);
+    }
+    float staticLayerProj[16];
+
+    startup.mark("other setup");
 
     //
     // Start the game loop
     //
 
+    const auto startTime = steady_clock::now();
     auto lastTick = steady_clock::now();
+    energyMeter.restart();
     auto lastFpsMeasurement = steady_clock::now();
     float dt = 0;
+    float sortMillis = 0;
     uint32_t framesInLastSecond = 0;
 
     bool running = true;
     SDL_Event event;
 
-    bgfx::setViewRect(0, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    bgfx::setViewRect(SPRITE_VIEW, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
     while (running) {
+        allocationTracker.beginFrame();
+        frameArena.beginFrame();
+
         // Listen for quit event
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_EVENT_QUIT) {
@@ -293,62 +621,414 @@ int main() {
         dt = getMillisElapsed(now, lastTick);
         lastTick = now;
 
+        // The simulation and the camera run on the frame's times, or on the recorded ones in a replay,
+        // which stops once they run out
+        float simulationMillis = dt;
+        float sceneMillis = getMillisElapsed(now, startTime);
+        if (!workloadLog.beginFrame(simulationMillis, sceneMillis)) {
+            running = false;
+        }
+
+        // Move on to the next ablation run once this one has its frames, and stop after the last
+        if (ablation.beginFrame(dt, bunnies, rng)) {
+            if (ablation.done()) {
+                ablation.report(std::cout);
+                running = false;
+            }
+            drawCount = static_cast<uint32_t>(bunnies.size());
+            const bool tinyViewport = ablation.active(Ablation::Viewport);
+            bgfx::setViewRect(SPRITE_VIEW, 0, 0, tinyViewport ? 1 : WINDOW_WIDTH, tinyViewport ? 1 : WINDOW_HEIGHT);
+            bgfx::FrameBufferHandle target = BGFX_INVALID_HANDLE; // the backbuffer
+            if (ablation.active(Ablation::Present)) {
+                target = ablationTarget;
+            }
+            bgfx::setViewFrameBuffer(SPRITE_VIEW, target);
+            staticLayer.invalidate();
+            fixedTimestep.reset(bunnies);
+        }
+
         // Measure FPS and report every second
+        allocationTracker.setPhase(AllocPhase::Report);
         framesInLastSecond++;
         if (getMillisElapsed(now, lastFpsMeasurement) > 1000) {
-            std::cout << "FPS: " << framesInLastSecond << std::endl;
+            std::cout << "FPS: " << framesInLastSecond;
+            if (churn.enabled()) {
+                std::cout << ", bunnies: " << bunnies.size() << " (+" << churn.takeSpawned()
+                    << "/-" << churn.takeDespawned() << "), reallocating frames: "
+                    << bufferGrowth.reallocatingFrameCount();
+            }
+            if (cpuCull) {
+                std::cout << ", drawn: " << drawCount << ", culled: " << bunnies.size() - drawCount;
+            }
+            staticLayer.report(std::cout);
+            if (collide) {
+                std::cout << ", colliding: " << collisions.lastCollidingCount();
+            }
+            if (sortSprites) {
+                std::cout << ", sort: " << sortMillis / framesInLastSecond << " ms/frame";
+                sortMillis = 0;
+            }
+            fixedTimestep.report(std::cout);
+            workloadLog.report(std::cout);
+            spriteFeed.report(std::cout, getMillisElapsed(now, lastFpsMeasurement));
+            mortonOrder.report(std::cout);
+            occlusionCuller.report(std::cout);
+            if (const size_t arenaPeak = frameArena.takePeakBytes(); arenaPeak > 0) {
+                std::cout << ", frame arena: " << arenaPeak / 1024 << " of " << frameArena.capacity() / 1024 << " KiB";
+            }
+            energyMeter.report(std::cout, framesInLastSecond, bunnies.size(), getMillisElapsed(now, lastFpsMeasurement));
+            std::cout << std::endl;
+            if (trackAllocations) {
+                allocationTracker.report(std::cout);
+            }
+            perfCounters.report(std::cout);
             framesInLastSecond = 0;
             lastFpsMeasurement = now;
         }
 
-        // Update the bunnies
-        for (auto&[x, y, vx, vy] : bunnies) {
-            x += vx * dt;
-            y += vy * dt;
+        // Spawn and despawn bunnies, then update them, optionally colliding them with each other. With
+        // --tick-rate this runs in fixed steps, as many as are due, instead of once by the frame time
+        allocationTracker.setPhase(AllocPhase::Simulate);
+        perfCounters.begin(PerfPhase::Simulate);
+        if (!ablation.active(Ablation::Simulation) && !spriteFeed.enabled()) {
+            const uint32_t ticks = fixedTimestep.enabled() ? fixedTimestep.advance(simulationMillis) : 1;
+            const float stepMillis = fixedTimestep.enabled() ? fixedTimestep.tickMillis() : simulationMillis;
+            for (uint32_t tick = 0; tick < ticks; tick++) {
+                if (churn.enabled()) {
+                    churn.update(bunnies, rng, spawnBunny);
+                    drawCount = static_cast<uint32_t>(bunnies.size());
+                }
+                if (!ablation.active(Ablation::Unordered)) {
+                    mortonOrder.update(bunnies, frameArena);
+                }
+                fixedTimestep.snapshot(bunnies);
+                bunnies.update(stepMillis, world);
+                if (collide) {
+                    collisions.resolve(bunnies);
+                }
+            }
+        }
+
+        perfCounters.end(PerfPhase::Simulate, bunnies.size());
+        workloadLog.endSimulation(bunnies);
+
+        // Pan the camera across the world
+        if (largeWorld) {
+            camera.update(world, sceneMillis);
+            bx::mtxOrtho(
+                proj,
+                camera.x,
+                camera.x + camera.width,
+                camera.y + camera.height,
+                camera.y,
+                0,
+                1,
+                0,
+                false
+            );
+            bgfx::setViewTransform(SPRITE_VIEW, view, proj);
+        }
 
-            if (x < 0 || x > WINDOW_WIDTH - 32) vx *= -1;
-            if (y < 0 || y > WINDOW_HEIGHT - 32) vy *= -1;
+        // The captured frame goes to its offscreen target, the frames after it back to the window
+        const bool captureFrame = bgfx::isValid(captureTarget) && frameCapture.beginFrame();
+        if (captureFrame) {
+            bgfx::setViewFrameBuffer(SPRITE_VIEW, captureTarget);
         }
 
-        // Send bunny instance data to the GPU
-        bgfx::allocInstanceDataBuffer(&instanceBuffer, NUM_BUNNIES, stride);
-        auto* spriteData = reinterpret_cast<SpriteData*>(instanceBuffer.data);
-        for (int i = 0; i < NUM_BUNNIES; i++) {
-            Bunny bunny = bunnies[i];
-            spriteData[i] = {
-                .x = bunny.x,
-                .y = bunny.y,
-                .w = w,
-                .h = h,
+        // Redraw the static layer if it changed, then draw the view's part of it as the first sprite
+        allocationTracker.setPhase(AllocPhase::Render);
+        const float spriteWidth = ablation.active(Ablation::Fill) ? 0.0f : w;
+        const float spriteHeight = ablation.active(Ablation::Fill) ? 0.0f : h;
+        if (staticLayer.beginFrame(camera)) {
+            bx::mtxOrtho(
+                staticLayerProj,
+                staticLayer.originX(),
+                staticLayer.originX() + static_cast<float>(staticLayer.width()),
+                staticLayer.originY() + static_cast<float>(staticLayer.height()),
+                staticLayer.originY(),
+                0,
+                1,
+                0,
+                false
+            );
+            bgfx::setViewTransform(STATIC_LAYER_VIEW, view, staticLayerProj);
+            const Bunnies& frozen = staticLayer.bunnies();
+            for (uint32_t first = 0, chunk = 0; first < staticLayer.size(); first += MAX_SPRITES_PER_DRAW, chunk++) {
+                const uint32_t chunkCount = std::min(staticLayer.size() - first, MAX_SPRITES_PER_DRAW);
+                SpriteData* spriteData = frameArena.allocate<SpriteData>(chunkCount);
+                for (uint32_t i = 0; i < chunkCount; i++) {
+                    spriteData[i] = {
+                        .x = frozen.x[first + i],
+                        .y = frozen.y[first + i],
+                        .w = spriteWidth,
+                        .h = spriteHeight,
+                        .rotation = 0.0f,
+                        .prevX = frozen.x[first + i],
+                        .prevY = frozen.y[first + i],
+                        .tu = 0.0f,
+                        .tv = 0.0f,
+                        .tw = 1.0f,
+                        .th = 1.0f,
+                        .r = 1.0f,
+                        .g = 1.0f,
+                        .b = 1.0f,
+                        .a = 1.0f
+                    };
+                }
+                bgfx::update(staticChunks[chunk].spriteBuffer, 0, bgfx::makeRef(spriteData, chunkCount * sizeof(SpriteData)));
+                bgfx::setInstanceDataBuffer(staticChunks[chunk].spriteBuffer, 0, chunkCount);
+                bgfx::setVertexBuffer(0, vertexBuffer);
+                bgfx::setTexture(0, sampler, bunnyTexture);
+                bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
+                bgfx::submit(STATIC_LAYER_VIEW, program);
+            }
+        }
+        if (staticLayer.enabled() && bgfx::getAvailInstanceDataBuffer(1, stride) == 1) {
+            // Render targets are stored upside down where the origin is bottom-left (OpenGL)
+            const float layerWidth = static_cast<float>(staticLayer.width());
+            const float layerHeight = static_cast<float>(staticLayer.height());
+            float tv = static_cast<float>(staticLayer.sourceY(camera)) / layerHeight;
+            float th = camera.height / layerHeight;
+            if (bgfx::getCaps()->originBottomLeft) {
+                tv = 1.0f - tv;
+                th = -th;
+            }
+            bgfx::allocInstanceDataBuffer(&instanceBuffer, 1, stride);
+            *reinterpret_cast<SpriteData*>(instanceBuffer.data) = {
+                .x = camera.x,
+                .y = camera.y,
+                .w = camera.width,
+                .h = camera.height,
                 .rotation = 0.0f,
-                .tu = 0.0f,
-                .tv = 0.0f,
-                .tw = 1.0f,
-                .th = 1.0f,
+                .prevX = camera.x,
+                .prevY = camera.y,
+                .tu = static_cast<float>(staticLayer.sourceX(camera)) / layerWidth,
+                .tv = tv,
+                .tw = camera.width / layerWidth,
+                .th = th,
                 .r = 1.0f,
                 .g = 1.0f,
                 .b = 1.0f,
                 .a = 1.0f
             };
+            bgfx::setInstanceDataBuffer(&instanceBuffer);
+            bgfx::setVertexBuffer(0, vertexBuffer);
+            bgfx::setTexture(0, sampler, bgfx::getTexture(staticLayerTarget));
+            bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
+            bgfx::submit(SPRITE_VIEW, program);
+        }
+
+        // With --tick-rate the sprites are only culled, sorted and uploaded on frames that stepped the
+        // simulation, the frames in between draw them again with a new interpolation factor
+        const bool uploadSprites = fixedTimestep.snapshotChanged();
+
+        // Only bunnies in grid cells touching the camera get uploaded and drawn
+        allocationTracker.setPhase(AllocPhase::Cull);
+        uint32_t* visibleBunnies = nullptr;
+        if (cpuCull && uploadSprites) {
+            grid.build(bunnies.x.data(), bunnies.y.data(), bunnies.size());
+            visibleBunnies = frameArena.allocate<uint32_t>(bunnies.size());
+            drawCount = grid.query(
+                camera.x - 32,
+                camera.y - 32,
+                camera.x + camera.width,
+                camera.y + camera.height,
+                visibleBunnies
+            );
+            if (drawCount == 0 && !captureFrame) {
+                bgfx::frame();
+                continue;
+            }
         }
-        bgfx::setInstanceDataBuffer(&instanceBuffer);
 
-        bgfx::setVertexBuffer(0, vertexBuffer);
+        // Sort the drawn bunnies back to front by y, which the fill then follows. They all
+        // share one texture, so the texture half of the key is constant and costs no passes.
+        const uint32_t* drawOrder = visibleBunnies;
+        if (sortSprites && uploadSprites) {
+            const auto sortStart = steady_clock::now();
+            drawOrder = sorter.sort(frameArena, drawOrder, drawCount, [&](const uint32_t index) {
+                return spriteSortKey(bunnies.y[index], 0);
+            });
+            sortMillis += getMillisElapsed(steady_clock::now(), sortStart);
+        }
+
+        // Drop the bunnies completely hidden under the ones drawn after them, for this frame only
+        uint32_t fillCount = drawCount;
+        if (occlusionCuller.enabled() && !fixedTimestep.enabled() && !spriteFeed.enabled()) {
+            drawOrder = occlusionCuller.cull(frameArena, bunnies, camera, drawOrder, fillCount);
+        }
+        allocationTracker.setPhase(AllocPhase::Render);
+
+        // With --feed the sprites are the feeder's latest frame, filled straight out of shared memory.
+        // Until the feeder publishes a new one, the sprite chunks still hold the last.
+        FeedFrame feedFrame;
+        bool fillSprites = uploadSprites;
+        if (spriteFeed.enabled()) {
+            fillSprites = spriteFeed.acquire(feedFrame);
+            drawCount = feedFrame.count;
+            fillCount = feedFrame.count;
+        }
+
+        // Grow the sprite buffers to the drawn population, which only changes in churn and feed mode
+        bufferGrowth.beginFrame();
+        if (useSpriteChunks) {
+            growSpriteChunks(spriteChunks, fillCount, gpuCull, bufferGrowth);
+        }
 
-        bgfx::setTexture(0, sampler, bunnyTexture);
+        // Send bunny instance data to the GPU and draw it, one chunk at a time. With GPU culling every
+        // sprite goes into its chunk's compute-readable buffer instead of the transient instance buffer.
+        // The upload ablation, and frames between --tick-rate steps, draw whatever the chunks still hold
+        // from the last upload, and the fill ablation collapses every sprite to zero area.
+        const float* sourceX = spriteFeed.enabled() ? feedFrame.x : bunnies.x.data();
+        const float* sourceY = spriteFeed.enabled() ? feedFrame.y : bunnies.y.data();
+        const float* previousX = spriteFeed.enabled() ? feedFrame.x : fixedTimestep.previousXs(bunnies);
+        const float* previousY = spriteFeed.enabled() ? feedFrame.y : fixedTimestep.previousYs(bunnies);
+        const float interpolationParams[4] = {fixedTimestep.alpha(), 0.0f, 0.0f, 0.0f};
+        perfCounters.begin(PerfPhase::Fill);
+        for (uint32_t first = 0, chunk = 0; first < fillCount; first += MAX_SPRITES_PER_DRAW, chunk++) {
+            const uint32_t chunkCount = std::min(fillCount - first, MAX_SPRITES_PER_DRAW);
+            const bgfx::Memory* spriteMemory = nullptr;
+            SpriteData* spriteData = nullptr;
+            if (useSpriteChunks) {
+                if (fillSprites && !ablation.active(Ablation::Upload)) {
+                    // bgfx reads referenced memory up to a frame late, which the double-buffered arena outlives
+                    spriteData = frameArena.allocate<SpriteData>(chunkCount);
+                    spriteMemory = bgfx::makeRef(spriteData, chunkCount * sizeof(SpriteData));
+                }
+            } else {
+                // Out of transient memory (the population did not fit into its 4 GiB limit), drop the rest
+                if (bgfx::getAvailInstanceDataBuffer(chunkCount, stride) < chunkCount) {
+                    break;
+                }
+                bgfx::allocInstanceDataBuffer(&instanceBuffer, chunkCount, stride);
+                spriteData = reinterpret_cast<SpriteData*>(instanceBuffer.data);
+            }
+            if (spriteData) {
+                for (uint32_t i = 0; i < chunkCount; i++) {
+                    const uint32_t index = drawOrder ? drawOrder[first + i] : first + i;
+                    spriteData[i] = {
+                        .x = sourceX[index],
+                        .y = sourceY[index],
+                        .w = spriteWidth,
+                        .h = spriteHeight,
+                        .rotation = 0.0f,
+                        .prevX = previousX[index],
+                        .prevY = previousY[index],
+                        .tu = 0.0f,
+                        .tv = 0.0f,
+                        .tw = 1.0f,
+                        .th = 1.0f,
+                        .r = 1.0f,
+                        .g = 1.0f,
+                        .b = 1.0f,
+                        .a = 1.0f
+                    };
+                }
+            }
+
+            if (spriteMemory) {
+                bgfx::update(spriteChunks[chunk].spriteBuffer, 0, spriteMemory);
+            }
+            if (gpuCull) {
+                const SpriteChunk& cullChunk = spriteChunks[chunk];
+
+                const float cullRect[4] = {camera.x, camera.y, camera.x + camera.width, camera.y + camera.height};
+                const float params[4] = {static_cast<float>(chunkCount), 0.0f, 0.0f, 0.0f};
+                bgfx::setUniform(cullView, cullRect);
+                bgfx::setUniform(cullParams, params);
+                bgfx::setBuffer(0, cullChunk.spriteBuffer, bgfx::Access::Read);
+                bgfx::setBuffer(1, cullChunk.visibleSpriteBuffer, bgfx::Access::Write);
+                bgfx::setBuffer(2, cullChunk.visibleCountBuffer, bgfx::Access::ReadWrite);
+                bgfx::dispatch(CULL_VIEW, cullProgram, (chunkCount + 63) / 64);
+
+                bgfx::setBuffer(0, cullChunk.visibleCountBuffer, bgfx::Access::ReadWrite);
+                bgfx::setBuffer(1, cullChunk.drawArgsBuffer, bgfx::Access::ReadWrite);
+                bgfx::dispatch(CULL_VIEW, cullArgsProgram, 1);
+
+                bgfx::setInstanceDataBuffer(cullChunk.visibleSpriteBuffer, 0, chunkCount);
+            } else if (useSpriteChunks) {
+                bgfx::setInstanceDataBuffer(spriteChunks[chunk].spriteBuffer, 0, chunkCount);
+            } else {
+                bgfx::setInstanceDataBuffer(&instanceBuffer);
+            }
 
-        bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
+            bgfx::setVertexBuffer(0, vertexBuffer);
 
-        bgfx::submit(0, program);
+            bgfx::setTexture(0, sampler, bunnyTexture);
+            bgfx::setUniform(interpolation, interpolationParams);
 
-        bgfx::frame();
+            bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
+
+            if (gpuCull) {
+                bgfx::submit(SPRITE_VIEW, program, spriteChunks[chunk].drawArgsBuffer, 0, 1);
+            } else {
+                bgfx::submit(SPRITE_VIEW, program);
+            }
+        }
+        if (spriteFeed.enabled() && fillSprites) {
+            spriteFeed.release(feedFrame);
+        }
+        fixedTimestep.markUploaded();
+        perfCounters.end(PerfPhase::Fill, fillCount);
+
+        // Blit the captured frame into the read-back texture and check it once it arrived, then stop.
+        // Render targets are stored upside down where the origin is bottom-left (OpenGL).
+        if (captureFrame) {
+            bgfx::blit(CAPTURE_VIEW, captureReadBack, 0, 0, bgfx::getTexture(captureTarget));
+            captureReadyFrame = bgfx::readTexture(captureReadBack, capturePixels.data());
+        }
+
+        perfCounters.begin(PerfPhase::Submit);
+        const uint32_t frameNumber = bgfx::frame();
+        perfCounters.end(PerfPhase::Submit, fillCount);
+        if (captureFrame) {
+            bgfx::setViewFrameBuffer(SPRITE_VIEW, ablation.active(Ablation::Present) ? ablationTarget : BGFX_INVALID_HANDLE);
+        }
+        if (captureReadyFrame > 0 && frameNumber >= captureReadyFrame) {
+            frameCapture.check(
+                capturePixels.data(),
+                WINDOW_WIDTH,
+                WINDOW_HEIGHT,
+                static_cast<size_t>(WINDOW_WIDTH) * 4,
+                PixelOrder::BGRA,
+                bgfx::getCaps()->originBottomLeft
+            );
+            captureReadyFrame = 0;
+            running = false;
+        }
+        if (startup.reportFirstFrame()) {
+            pipelineCache.reportStartup(warmCache, startup.totalMillis());
+        }
     }
 
+    if (bgfx::isValid(ablationTarget)) {
+        bgfx::destroy(ablationTarget);
+    }
+    if (bgfx::isValid(captureTarget)) {
+        bgfx::destroy(captureTarget);
+        bgfx::destroy(captureReadBack);
+    }
     bgfx::destroy(bunnyTexture);
     bgfx::destroy(sampler);
+    bgfx::destroy(interpolation);
     bgfx::destroy(vertexBuffer);
+    if (bgfx::isValid(staticLayerTarget)) {
+        bgfx::destroy(staticLayerTarget);
+    }
+    for (const SpriteChunk& chunk : spriteChunks) {
+        destroySpriteChunk(chunk);
+    }
+    for (const SpriteChunk& chunk : staticChunks) {
+        destroySpriteChunk(chunk);
+    }
+    if (gpuCull) {
+        bgfx::destroy(cullProgram);
+        bgfx::destroy(cullArgsProgram);
+        bgfx::destroy(cullView);
+        bgfx::destroy(cullParams);
+    }
     bgfx::destroy(program);
     bgfx::shutdown();
     SDL_Quit();
-    return 0;
+    return workloadLog.failed() || frameCapture.failed() ? 1 : 0;
 }
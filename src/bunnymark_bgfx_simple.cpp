@@ -1,25 +1,60 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <ctime>
-#include <fstream>
 #include <iostream>
 #include <ostream>
 #include <random>
+#include <string>
+#include <vector>
 
 #include "SDL3/SDL_init.h"
 
 #include "bgfx/bgfx.h"
 #include "bgfx/platform.h"
-#include "bimg/decode.h"
-#include "bx/allocator.h"
 #include "bx/math.h"
 #include "SDL3/SDL_log.h"
 
+#include "args.h"
+#include "bgfx_allocator.h"
+#include "bgfx_callback.h"
+#include "bunnies.h"
+#include "churn.h"
+#include "collision.h"
+#include "energy_meter.h"
+#include "fixed_timestep.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "mapped_file.h"
+#include "morton_order.h"
+#include "occlusion_cull.h"
+#include "perf_counters.h"
+#include "pipeline_cache.h"
+#include "spatial_grid.h"
+#include "sprite_sort.h"
+#include "startup_profiler.h"
+#include "static_layer.h"
+#include "texture_pack.h"
+#include "tracking_new.h"
+#include "workload_log.h"
+#include "world.h"
+
 using namespace std::chrono;
 
 constexpr int WINDOW_WIDTH = 800;
 constexpr int WINDOW_HEIGHT = 600;
 constexpr int NUM_BUNNIES = 70000;
 
+// Bunnies per draw call, the most whose 4 vertices each can still be addressed by 16-bit indices.
+// Large populations are drawn as several such chunks sharing one index buffer.
+constexpr uint32_t MAX_BUNNIES_PER_DRAW = 65536 / 4;
+
+// Redrawing the static layer runs ahead of the sprites, blitting a captured frame into its read-back
+// texture after them
+constexpr bgfx::ViewId STATIC_LAYER_VIEW = 0;
+constexpr bgfx::ViewId SPRITE_VIEW = 1;
+constexpr bgfx::ViewId CAPTURE_VIEW = 2;
+
 struct Vertex {
     float x, y;
     float u, v;
@@ -83,22 +118,82 @@ bgfx::ShaderHandle loadShader(const char* filename) {
             break;
     }
 
-    std::ifstream stream("shaders/bgfx_simple/" + shaderFormat + "/" + filename + ".bin");
-
-    stream.seekg(0, std::ios::end);
-    const std::streamsize size = stream.tellg();
-    stream.seekg(0, std::ios::beg);
-
-    char data[size];
-    stream.read(data, size);
-
-    const bgfx::Memory* mem = bgfx::copy(data, size);
+    // Map the blob and hand bgfx a reference to it, bgfx unmaps it once it has created the shader
+    const std::string path = "shaders/bgfx_simple/" + shaderFormat + "/" + filename + ".bin";
+    auto* file = new MappedFile(path.c_str());
+    if (!file->isOpen()) {
+        delete file;
+        return BGFX_INVALID_HANDLE;
+    }
+    const bgfx::Memory* mem = bgfx::makeRef(file->data(), file->size(), [](void*, void* userData) {
+        delete static_cast<MappedFile*>(userData);
+    }, file);
     return bgfx::createShader(mem);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Heap allocations counted per frame phase, SDL's included from its very first one
+    // (--track-allocs), optionally aborting on any allocation after N warmup frames (--no-alloc-after N)
+    SDL_SetMemoryFunctions(
+        trackedMalloc<AllocSource::SDL>,
+        trackedCalloc<AllocSource::SDL>,
+        trackedRealloc<AllocSource::SDL>,
+        trackedFree
+    );
+    const bool trackAllocations = hasArg(argc, argv, "--track-allocs") || hasArg(argc, argv, "--no-alloc-after");
+    allocationTracker.failAfterFrame(getIntArg(argc, argv, "--no-alloc-after", -1));
+
     Vertex::init();
 
+    // Population (--bunnies N), defaulting to NUM_BUNNIES
+    const uint32_t population = getBunnyCount(argc, argv, NUM_BUNNIES);
+
+    // Large-world mode (--world-scale N), optionally culled on the CPU through a uniform grid (--cpu-cull)
+    const World world = getWorld(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool largeWorld = world.isLarge(WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool cpuCull = hasArg(argc, argv, "--cpu-cull");
+
+    // Cached static layer (--static P, --static-edits N): the frozen share of the population is drawn
+    // into a frame buffer once, only the rest of the bunnies are simulated, expanded and drawn
+    StaticLayer staticLayer(argc, argv, population, world, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const uint32_t bunnyCount = population - staticLayer.size();
+
+    // Bunny–bunny collisions (--collide), spread over --threads N worker threads
+    const bool collide = hasArg(argc, argv, "--collide");
+    ThreadPool threadPool(static_cast<unsigned>(std::max(getIntArg(argc, argv, "--threads", std::thread::hardware_concurrency()), 1L)));
+    CollisionSystem collisions(threadPool);
+
+    // Churn mode (--churn P, --spawn P), spawning and despawning bunnies every frame
+    BunnyChurn churn(argc, argv);
+
+    // Depth sort of the drawn bunnies between simulation and fill (--sort), timed per frame
+    const bool sortSprites = hasArg(argc, argv, "--sort");
+    SpriteSorter sorter(threadPool);
+    // Z-order reordering of the bunny store every N simulation steps, for locality in the fill (--morton N)
+    MortonOrder mortonOrder(argc, argv, sorter);
+
+    // Fixed-timestep simulation, drawn interpolated between the last two steps (--tick-rate HZ)
+    FixedTimestep fixedTimestep(argc, argv);
+    // Recording of the frame times and state hashes, or a replay checking them (--record FILE, --replay FILE)
+    WorkloadLog workloadLog(argc, argv);
+    // Offscreen render of frame N, compared against a golden image (--capture-frame N, --golden FILE)
+    FrameCapture frameCapture(argc, argv);
+
+    // Culling of the sprites hidden under the opaque cores of later ones, before the fill (--occlusion-cull)
+    OcclusionCuller occlusionCuller(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Hardware counters of the main thread around simulation, fill and submit (--perf-counters, Linux only)
+    PerfCounters perfCounters(hasArg(argc, argv, "--perf-counters"));
+
+    // Package and DRAM energy over each report window (--energy, Linux powercap)
+    EnergyMeter energyMeter(hasArg(argc, argv, "--energy"));
+
+    // Startup phases up to the first presented frame, with a cold pipeline cache if --cold-cache
+    // clears it first
+    StartupProfiler startup;
+    const bool coldCache = hasArg(argc, argv, "--cold-cache");
+    startup.mark("options");
+
     // Initial SDL setup
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         logError("Failed to initialize SDL");
@@ -119,12 +214,34 @@ int main() {
         return 1;
     }
 
+    startup.mark("SDL init");
+
+    // bgfx reads and writes its compiled shaders, programs and pipelines through the callback.
+    // Its cache ids already hash in the device, so all devices can share one directory.
+    PipelineCache pipelineCache("pipeline_cache");
+    if (coldCache) pipelineCache.clear();
+    pipelineCache.setDevice("bgfx");
+    const bool warmCache = pipelineCache.hasEntries();
+    startup.setVariant(warmCache ? "warm pipeline cache" : "cold pipeline cache");
+    BgfxCallback bgfxCallback(pipelineCache);
+    TrackingBgfxAllocator bgfxAllocator;
+
     // Initialize bgfx
     bgfx::Init init;
+    init.callback = &bgfxCallback;
+    init.allocator = &bgfxAllocator;
     // uncomment to change renderer
     // init.type = bgfx::RendererType::OpenGL;
     init.resolution.width = WINDOW_WIDTH;
     init.resolution.height = WINDOW_HEIGHT;
+    // Every frame streams all vertices through the transient buffer, which bgfx sizes once at init. A
+    // frame that redraws the static layer streams the frozen bunnies too, and the layer is one more quad.
+    const uint64_t vertexBytesPerFrame = (static_cast<uint64_t>(population) + 1) * 4 * sizeof(Vertex);
+    init.limits.transientVbSize = static_cast<uint32_t>(std::clamp<uint64_t>(
+        vertexBytesPerFrame,
+        init.limits.transientVbSize,
+        UINT32_MAX
+    ));
     const SDL_PropertiesID props = SDL_GetWindowProperties(window);
 #if defined(SDL_PLATFORM_WIN32)
     init.platformData.nwh = SDL_GetPointerProperty(props, SDL_PROP_WINDOW_WIN32_HWND_POINTER, NULL);
@@ -147,44 +264,49 @@ int main() {
     init.platformData.nwh = reinterpret_cast<void*>("#canvas");
 #endif
     bgfx::init(init);
+    startup.mark("device creation");
 
-    bgfx::setViewClear(0, BGFX_CLEAR_COLOR, 0x8080ffff);
+    bgfx::setViewClear(SPRITE_VIEW, BGFX_CLEAR_COLOR, 0x8080ffff);
 
     // Load shaders
     const bgfx::ShaderHandle vertShader = loadShader("vs_bunny.sc");
     const bgfx::ShaderHandle fragShader = loadShader("fs_bunny.sc");
+    startup.mark("shader load");
     const bgfx::ProgramHandle program = bgfx::createProgram(vertShader, fragShader, true);
+    startup.mark("pipeline creation");
 
     //
     // Load bunny texture
     //
 
-    std::ifstream stream("../bunny.png", std::ios::binary);
-
-    stream.seekg(0, std::ios::end);
-    const std::streamsize size = stream.tellg();
-    stream.seekg(0, std::ios::beg);
-
-    char data[size];
-    stream.read(data, size);
-
-    bx::DefaultAllocator allocator;
-    bimg::ImageContainer* image = bimg::imageParse(&allocator, data, size);
-    const uint16_t w = image->m_width;
-    const uint16_t h = image->m_height;
+    // Uploaded straight from the memory-mapped texture pack made by the cook_textures target,
+    // the pack stays mapped until the end of main, after bgfx has consumed the reference
+    TexturePack texturePack;
+    const PackTexture* bunnyImage = texturePack.open("sprites.pack") ? texturePack.find("bunny") : nullptr;
+    if (!bunnyImage) {
+        SDL_SetError("No bunny in sprites.pack, build the cook_textures target");
+        logError("Failed to load texture");
+        bgfx::destroy(program);
+        bgfx::shutdown();
+        SDL_Quit();
+        return 1;
+    }
+    const uint16_t w = bunnyImage->width;
+    const uint16_t h = bunnyImage->height;
     const uint16_t hw = w / 2;
     const uint16_t hh = h / 2;
+    occlusionCuller.setSprite(texturePack.data(*bunnyImage), w, h, hw, hh);
     bgfx::TextureHandle bunnyTexture = bgfx::createTexture2D(
         w,
         h,
-        image->m_numMips > 1,
-        bx::max(image->m_numLayers, 1u),
-        static_cast<bgfx::TextureFormat::Enum>(image->m_format),
+        bunnyImage->mipCount > 1,
+        1,
+        bgfx::TextureFormat::RGBA8,
         // BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT,
     BGFX_TEXTURE_NONE,
-        bgfx::copy(image->m_data, image->m_size)
+        bgfx::makeRef(texturePack.data(*bunnyImage), static_cast<uint32_t>(bunnyImage->dataSize))
     );
-    bimg::imageFree(image);
+    startup.mark("texture upload");
 
     if (!bgfx::isValid(bunnyTexture)) {
         SDL_SetError("Texture invalid");
@@ -195,11 +317,11 @@ int main() {
         return 1;
     }
 
-    // Create index buffer
-    uint32_t indices[NUM_BUNNIES * 6];
+    // Create the index buffer shared by all chunks, 6 indices per bunny of one chunk
+    std::vector<uint16_t> indices(static_cast<size_t>(MAX_BUNNIES_PER_DRAW) * 6);
     uint32_t idx = -1;
-    for (uint32_t i = 0; i < NUM_BUNNIES; i++) {
-        uint32_t base = i * 4;
+    for (uint32_t i = 0; i < MAX_BUNNIES_PER_DRAW; i++) {
+        auto base = static_cast<uint16_t>(i * 4);
         indices[++idx] = base + 0;
         indices[++idx] = base + 1;
         indices[++idx] = base + 2;
@@ -208,12 +330,18 @@ int main() {
         indices[++idx] = base + 3;
     }
 
-    // create index buffer (note: using 32-bit indices)
+    // create index buffer (16-bit indices, so it works without BGFX_CAPS_INDEX32)
     bgfx::IndexBufferHandle indexBuffer = bgfx::createIndexBuffer(
-        bgfx::makeRef(indices, sizeof(indices)),
-        BGFX_BUFFER_INDEX32
+        bgfx::makeRef(indices.data(), static_cast<uint32_t>(indices.size() * sizeof(uint16_t)))
     );
 
+    // One draw call per chunk, so the draw call limit caps how many bunnies can be drawn
+    const uint64_t maxDrawableBunnies = static_cast<uint64_t>(bgfx::getCaps()->limits.maxDrawCalls) * MAX_BUNNIES_PER_DRAW;
+    if (bunnyCount > maxDrawableBunnies) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Only %llu of %u bunnies fit into the draw call limit",
+            static_cast<unsigned long long>(maxDrawableBunnies), bunnyCount);
+    }
+
     // Create the sampler
     const bgfx::UniformHandle sampler = bgfx::createUniform("s_texColor",  bgfx::UniformType::Sampler);
 
@@ -221,23 +349,30 @@ int main() {
     // Set up the bunnies
     //
 
-    struct Bunny {
-        float x, y;
-        float vx, vy;
-    };
-
-    std::vector<Bunny> bunnies;
+    Bunnies bunnies;
+    bunnies.reserve(bunnyCount);
     std::mt19937 rng; // NOLINT deterministic but that's fine here
     std::uniform_real_distribution dis{-1.0f, 1.0f};
 
-    for (int i = 0; i < NUM_BUNNIES; i++) {
-        bunnies.push_back({
-            .x = static_cast<float>(WINDOW_WIDTH) / 2,
-            .y = static_cast<float>(WINDOW_HEIGHT) / 2,
+    // In large-world and collision mode the bunnies start spread over the whole world instead of
+    // stacked at the center, where every bunny would overlap every other one. --uniform-spawn
+    // spreads them in any mode.
+    const bool spreadSpawn = largeWorld || collide || hasArg(argc, argv, "--uniform-spawn");
+    std::uniform_real_distribution spawnX{0.0f, world.width - 32};
+    std::uniform_real_distribution spawnY{0.0f, world.height - 32};
+
+    auto spawnBunny = [&] {
+        return Bunny{
+            .x = spreadSpawn ? spawnX(rng) : static_cast<float>(WINDOW_WIDTH) / 2,
+            .y = spreadSpawn ? spawnY(rng) : static_cast<float>(WINDOW_HEIGHT) / 2,
             .vx = dis(rng),
             .vy = dis(rng)
-        });
+        };
+    };
+    for (uint32_t i = 0; i < bunnyCount; i++) {
+        bunnies.push_back(spawnBunny());
     }
+    workloadLog.start(bunnies, world, fixedTimestep.tickMillis());
 
     //
     // Position the camera
@@ -261,23 +396,78 @@ int main() {
         false
     );
 
-    bgfx::setViewTransform(0, view, proj);
+    bgfx::setViewTransform(SPRITE_VIEW, view, proj);
+
+    Camera camera{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    SpatialGrid grid(world.width, world.height, getFloatArg(argc, argv, "--grid-cell", 128.0f));
+
+    // Per-frame CPU staging (culled index lists, sort keys, ...), --frame-arena N MiB to start with
+    FrameArena frameArena(static_cast<size_t>(std::max(getIntArg(argc, argv, "--frame-arena", DEFAULT_FRAME_ARENA_MIB), 1L)) << 20);
+
+    uint32_t drawCount = bunnyCount;
+
+    // The captured frame is rendered into this frame buffer instead of the backbuffer, then blitted
+    // into a texture the CPU can read back, which arrives a couple of frames later
+    bgfx::FrameBufferHandle captureTarget = BGFX_INVALID_HANDLE;
+    bgfx::TextureHandle captureReadBack = BGFX_INVALID_HANDLE;
+    std::vector<uint8_t> capturePixels;
+    uint32_t captureReadyFrame = 0;
+    constexpr uint64_t requiredCaptureCaps = BGFX_CAPS_TEXTURE_BLIT | BGFX_CAPS_TEXTURE_READ_BACK;
+    if (frameCapture.enabled() && (bgfx::getCaps()->supported & requiredCaptureCaps) != requiredCaptureCaps) {
+        std::cout << "Frame capture needs texture blit and read-back support, not capturing" << std::endl;
+    } else if (frameCapture.enabled()) {
+        captureTarget = bgfx::createFrameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT, bgfx::TextureFormat::BGRA8);
+        captureReadBack = bgfx::createTexture2D(
+            WINDOW_WIDTH,
+            WINDOW_HEIGHT,
+            false,
+            1,
+            bgfx::TextureFormat::BGRA8,
+            BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK
+        );
+        capturePixels.resize(static_cast<size_t>(WINDOW_WIDTH) * WINDOW_HEIGHT * 4);
+    }
+
+    // The static layer, only rendered into when it changes and drawn under the moving bunnies as a
+    // single quad every frame. The sprite view keeps submission order, so it stays underneath.
+    bgfx::FrameBufferHandle staticLayerTarget = BGFX_INVALID_HANDLE;
+    if (staticLayer.enabled()) {
+        staticLayerTarget = bgfx::createFrameBuffer(
+            static_cast<uint16_t>(staticLayer.width()),
+            static_cast<uint16_t>(staticLayer.height()),
+            bgfx::TextureFormat::BGRA8,
+            BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT
+        );
+        bgfx::setViewFrameBuffer(STATIC_LAYER_VIEW, staticLayerTarget);
+        bgfx::setViewRect(STATIC_LAYER_VIEW, 0, 0, static_cast<uint16_t>(staticLayer.width()), static_cast<uint16_t>(staticLayer.height()));
+        bgfx::setViewClear(STATIC_LAYER_VIEW, BGFX_CLEAR_COLOR, 0x8080ffff);
+        bgfx::setViewMode(SPRITE_VIEW, bgfx::ViewMode::Sequential);
+    }
+    float staticLayerProj[16];
+
+    startup.mark("other setup");
 
     //
     // Start the game loop
     //
 
+    const auto startTime = steady_clock::now();
     auto lastTick = steady_clock::now();
+    energyMeter.restart();
     auto lastFpsMeasurement = steady_clock::now();
     float dt = 0;
+    float sortMillis = 0;
     uint32_t framesInLastSecond = 0;
 
     bool running = true;
     SDL_Event event;
 
-    bgfx::setViewRect(0, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    bgfx::setViewRect(SPRITE_VIEW, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
     while (running) {
+        allocationTracker.beginFrame();
+        frameArena.beginFrame();
+
         // Listen for quit event
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_EVENT_QUIT) {
@@ -290,52 +480,274 @@ int main() {
         dt = getMillisElapsed(now, lastTick);
         lastTick = now;
 
+        // The simulation and the camera run on the frame's times, or on the recorded ones in a replay,
+        // which stops once they run out
+        float simulationMillis = dt;
+        float sceneMillis = getMillisElapsed(now, startTime);
+        if (!workloadLog.beginFrame(simulationMillis, sceneMillis)) {
+            running = false;
+        }
+
         // Measure FPS and report every second
+        allocationTracker.setPhase(AllocPhase::Report);
         framesInLastSecond++;
         if (getMillisElapsed(now, lastFpsMeasurement) > 1000) {
-            std::cout << "FPS: " << framesInLastSecond << std::endl;
+            std::cout << "FPS: " << framesInLastSecond;
+            if (churn.enabled()) {
+                std::cout << ", bunnies: " << bunnies.size() << " (+" << churn.takeSpawned()
+                    << "/-" << churn.takeDespawned() << ")";
+            }
+            if (cpuCull) {
+                std::cout << ", drawn: " << drawCount << ", culled: " << bunnies.size() - drawCount;
+            }
+            staticLayer.report(std::cout);
+            if (collide) {
+                std::cout << ", colliding: " << collisions.lastCollidingCount();
+            }
+            if (sortSprites) {
+                std::cout << ", sort: " << sortMillis / framesInLastSecond << " ms/frame";
+                sortMillis = 0;
+            }
+            fixedTimestep.report(std::cout);
+            workloadLog.report(std::cout);
+            mortonOrder.report(std::cout);
+            occlusionCuller.report(std::cout);
+            if (const size_t arenaPeak = frameArena.takePeakBytes(); arenaPeak > 0) {
+                std::cout << ", frame arena: " << arenaPeak / 1024 << " of " << frameArena.capacity() / 1024 << " KiB";
+            }
+            energyMeter.report(std::cout, framesInLastSecond, bunnies.size(), getMillisElapsed(now, lastFpsMeasurement));
+            std::cout << std::endl;
+            if (trackAllocations) {
+                allocationTracker.report(std::cout);
+            }
+            perfCounters.report(std::cout);
             framesInLastSecond = 0;
             lastFpsMeasurement = now;
         }
 
-        // Update the bunnies
-        for (auto&[x, y, vx, vy] : bunnies) {
-            x += vx * dt;
-            y += vy * dt;
+        // Spawn and despawn bunnies, then update them, optionally colliding them with each other. With
+        // --tick-rate this runs in fixed steps, as many as are due, instead of once by the frame time
+        allocationTracker.setPhase(AllocPhase::Simulate);
+        perfCounters.begin(PerfPhase::Simulate);
+        const uint32_t ticks = fixedTimestep.enabled() ? fixedTimestep.advance(simulationMillis) : 1;
+        const float stepMillis = fixedTimestep.enabled() ? fixedTimestep.tickMillis() : simulationMillis;
+        for (uint32_t tick = 0; tick < ticks; tick++) {
+            if (churn.enabled()) {
+                churn.update(bunnies, rng, spawnBunny);
+                drawCount = static_cast<uint32_t>(bunnies.size());
+            }
+            mortonOrder.update(bunnies, frameArena);
+            fixedTimestep.snapshot(bunnies);
+            bunnies.update(stepMillis, world);
+            if (collide) {
+                collisions.resolve(bunnies);
+            }
+        }
+
+        perfCounters.end(PerfPhase::Simulate, bunnies.size());
+        workloadLog.endSimulation(bunnies);
+
+        // Pan the camera across the world
+        if (largeWorld) {
+            camera.update(world, sceneMillis);
+            bx::mtxOrtho(
+                proj,
+                camera.x,
+                camera.x + camera.width,
+                camera.y + camera.height,
+                camera.y,
+                0,
+                1,
+                0,
+                false
+            );
+            bgfx::setViewTransform(SPRITE_VIEW, view, proj);
+        }
+
+        // The captured frame goes to its offscreen target, the frames after it back to the backbuffer
+        const bool captureFrame = bgfx::isValid(captureTarget) && frameCapture.beginFrame();
+        if (captureFrame) {
+            bgfx::setViewFrameBuffer(SPRITE_VIEW, captureTarget);
+        }
+
+        // Redraw the static layer if it changed, then draw the view's part of it as the first quad
+        allocationTracker.setPhase(AllocPhase::Render);
+        if (staticLayer.beginFrame(camera)) {
+            bx::mtxOrtho(
+                staticLayerProj,
+                staticLayer.originX(),
+                staticLayer.originX() + static_cast<float>(staticLayer.width()),
+                staticLayer.originY() + static_cast<float>(staticLayer.height()),
+                staticLayer.originY(),
+                0,
+                1,
+                0,
+                false
+            );
+            bgfx::setViewTransform(STATIC_LAYER_VIEW, view, staticLayerProj);
+            const Bunnies& frozen = staticLayer.bunnies();
+            for (uint32_t first = 0; first < staticLayer.size(); first += MAX_BUNNIES_PER_DRAW) {
+                const uint32_t chunkCount = std::min(staticLayer.size() - first, MAX_BUNNIES_PER_DRAW);
+                if (bgfx::getAvailTransientVertexBuffer(chunkCount * 4, Vertex::layout) < chunkCount * 4) {
+                    break;
+                }
+                bgfx::TransientVertexBuffer vertexBuffer;
+                bgfx::allocTransientVertexBuffer(&vertexBuffer, chunkCount * 4, Vertex::layout);
+                auto data = reinterpret_cast<Vertex*>(vertexBuffer.data);
+                int idx = -1;
+                for (uint32_t i = first; i < first + chunkCount; i++) {
+                    const float x = frozen.x[i];
+                    const float y = frozen.y[i];
+                    data[++idx] = {x - hw, y + hh, 0, 1, 0xffffffff};
+                    data[++idx] = {x + hw, y + hh, 1, 1, 0xffffffff};
+                    data[++idx] = {x + hw, y - hh, 1, 0, 0xffffffff};
+                    data[++idx] = {x - hw, y - hh, 0, 0, 0xffffffff};
+                }
+                bgfx::setVertexBuffer(0, &vertexBuffer);
+                bgfx::setTexture(0, sampler, bunnyTexture);
+                bgfx::setIndexBuffer(indexBuffer, 0, chunkCount * 6);
+                bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
+                bgfx::submit(STATIC_LAYER_VIEW, program);
+            }
+        }
+        if (staticLayer.enabled() && bgfx::getAvailTransientVertexBuffer(4, Vertex::layout) == 4) {
+            // Render targets are stored upside down where the origin is bottom-left (OpenGL)
+            const float u0 = static_cast<float>(staticLayer.sourceX(camera)) / static_cast<float>(staticLayer.width());
+            const float u1 = u0 + camera.width / static_cast<float>(staticLayer.width());
+            float v0 = static_cast<float>(staticLayer.sourceY(camera)) / static_cast<float>(staticLayer.height());
+            float v1 = v0 + camera.height / static_cast<float>(staticLayer.height());
+            if (bgfx::getCaps()->originBottomLeft) {
+                v0 = 1.0f - v0;
+                v1 = 1.0f - v1;
+            }
+            bgfx::TransientVertexBuffer vertexBuffer;
+            bgfx::allocTransientVertexBuffer(&vertexBuffer, 4, Vertex::layout);
+            auto data = reinterpret_cast<Vertex*>(vertexBuffer.data);
+            data[0] = {camera.x, camera.y + camera.height, u0, v1, 0xffffffff};
+            data[1] = {camera.x + camera.width, camera.y + camera.height, u1, v1, 0xffffffff};
+            data[2] = {camera.x + camera.width, camera.y, u1, v0, 0xffffffff};
+            data[3] = {camera.x, camera.y, u0, v0, 0xffffffff};
+            bgfx::setVertexBuffer(0, &vertexBuffer);
+            bgfx::setTexture(0, sampler, bgfx::getTexture(staticLayerTarget));
+            bgfx::setIndexBuffer(indexBuffer, 0, 6);
+            bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
+            bgfx::submit(SPRITE_VIEW, program);
+        }
+
+        // Only bunnies in grid cells touching the camera get expanded and drawn
+        allocationTracker.setPhase(AllocPhase::Cull);
+        uint32_t* visibleBunnies = nullptr;
+        if (cpuCull) {
+            grid.build(bunnies.x.data(), bunnies.y.data(), bunnies.size());
+            visibleBunnies = frameArena.allocate<uint32_t>(bunnies.size());
+            drawCount = grid.query(
+                camera.x - 32,
+                camera.y - 32,
+                camera.x + camera.width + 32,
+                camera.y + camera.height + 32,
+                visibleBunnies
+            );
+            if (drawCount == 0 && !captureFrame) {
+                bgfx::frame();
+                continue;
+            }
+        }
 
-            if (x < 0 || x > WINDOW_WIDTH - 32) vx *= -1;
-            if (y < 0 || y > WINDOW_HEIGHT - 32) vy *= -1;
+        // Sort the drawn bunnies back to front by y, which the fill then follows. They all
+        // share one texture, so the texture half of the key is constant and costs no passes.
+        const uint32_t* drawOrder = visibleBunnies;
+        if (sortSprites) {
+            const auto sortStart = steady_clock::now();
+            drawOrder = sorter.sort(frameArena, drawOrder, drawCount, [&](const uint32_t index) {
+                return spriteSortKey(bunnies.y[index], 0);
+            });
+            sortMillis += getMillisElapsed(steady_clock::now(), sortStart);
         }
 
-        bgfx::TransientVertexBuffer vertexBuffer;
-        bgfx::allocTransientVertexBuffer(&vertexBuffer, NUM_BUNNIES * 4, Vertex::layout);
-        auto data = reinterpret_cast<Vertex*>(vertexBuffer.data);
-        int idx = -1;
-        for (int i = 0; i < NUM_BUNNIES; i++) {
-            Bunny& b = bunnies[i];
-            data[++idx] = {b.x - hw, b.y + hh, 0, 1, 0xffffffff}; // top-left
-            data[++idx] = {b.x + hw, b.y + hh, 1, 1, 0xffffffff}; // top-right
-            data[++idx] = {b.x + hw, b.y - hh, 1, 0, 0xffffffff}; // bottom-right
-            data[++idx] = {b.x - hw, b.y - hh, 0, 0, 0xffffffff}; // bottom-left
+        // Drop the bunnies completely hidden under the ones drawn after them, for this frame only
+        uint32_t fillCount = drawCount;
+        if (occlusionCuller.enabled() && !fixedTimestep.enabled()) {
+            drawOrder = occlusionCuller.cull(frameArena, bunnies, camera, drawOrder, fillCount);
         }
-        bgfx::setVertexBuffer(0, &vertexBuffer);
+        allocationTracker.setPhase(AllocPhase::Render);
+
+        // One transient vertex buffer and draw call per chunk. If the transient buffer runs out
+        // anyway (the population did not fit into its 4 GiB limit), the remaining chunks are dropped.
+        // The quads are expanded on the CPU, so --tick-rate interpolates their positions here too.
+        perfCounters.begin(PerfPhase::Fill);
+        for (uint32_t first = 0; first < fillCount; first += MAX_BUNNIES_PER_DRAW) {
+            const uint32_t chunkCount = std::min(fillCount - first, MAX_BUNNIES_PER_DRAW);
+            if (bgfx::getAvailTransientVertexBuffer(chunkCount * 4, Vertex::layout) < chunkCount * 4) {
+                break;
+            }
 
-        bgfx::setTexture(0, sampler, bunnyTexture);
+            bgfx::TransientVertexBuffer vertexBuffer;
+            bgfx::allocTransientVertexBuffer(&vertexBuffer, chunkCount * 4, Vertex::layout);
+            auto data = reinterpret_cast<Vertex*>(vertexBuffer.data);
+            int idx = -1;
+            for (uint32_t i = first; i < first + chunkCount; i++) {
+                const uint32_t index = drawOrder ? drawOrder[i] : i;
+                const float x = fixedTimestep.x(bunnies, index);
+                const float y = fixedTimestep.y(bunnies, index);
+                data[++idx] = {x - hw, y + hh, 0, 1, 0xffffffff}; // top-left
+                data[++idx] = {x + hw, y + hh, 1, 1, 0xffffffff}; // top-right
+                data[++idx] = {x + hw, y - hh, 1, 0, 0xffffffff}; // bottom-right
+                data[++idx] = {x - hw, y - hh, 0, 0, 0xffffffff}; // bottom-left
+            }
+            bgfx::setVertexBuffer(0, &vertexBuffer);
 
-        bgfx::setIndexBuffer(indexBuffer);
+            bgfx::setTexture(0, sampler, bunnyTexture);
 
-        bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
+            bgfx::setIndexBuffer(indexBuffer, 0, chunkCount * 6);
 
-        bgfx::submit(0, program);
+            bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
 
-        bgfx::frame();
+            bgfx::submit(SPRITE_VIEW, program);
+        }
+        perfCounters.end(PerfPhase::Fill, fillCount);
+
+        // Blit the captured frame into the read-back texture and check it once it arrived, then stop.
+        // Render targets are stored upside down where the origin is bottom-left (OpenGL).
+        if (captureFrame) {
+            bgfx::blit(CAPTURE_VIEW, captureReadBack, 0, 0, bgfx::getTexture(captureTarget));
+            captureReadyFrame = bgfx::readTexture(captureReadBack, capturePixels.data());
+        }
+
+        perfCounters.begin(PerfPhase::Submit);
+        const uint32_t frameNumber = bgfx::frame();
+        perfCounters.end(PerfPhase::Submit, fillCount);
+        if (captureFrame) {
+            bgfx::setViewFrameBuffer(SPRITE_VIEW, BGFX_INVALID_HANDLE);
+        }
+        if (captureReadyFrame > 0 && frameNumber >= captureReadyFrame) {
+            frameCapture.check(
+                capturePixels.data(),
+                WINDOW_WIDTH,
+                WINDOW_HEIGHT,
+                static_cast<size_t>(WINDOW_WIDTH) * 4,
+                PixelOrder::BGRA,
+                bgfx::getCaps()->originBottomLeft
+            );
+            captureReadyFrame = 0;
+            running = false;
+        }
+        if (startup.reportFirstFrame()) {
+            pipelineCache.reportStartup(warmCache, startup.totalMillis());
+        }
     }
 
+    if (bgfx::isValid(captureTarget)) {
+        bgfx::destroy(captureTarget);
+        bgfx::destroy(captureReadBack);
+    }
+    if (bgfx::isValid(staticLayerTarget)) {
+        bgfx::destroy(staticLayerTarget);
+    }
     bgfx::destroy(bunnyTexture);
     bgfx::destroy(sampler);
     bgfx::destroy(indexBuffer);
     bgfx::destroy(program);
     bgfx::shutdown();
     SDL_Quit();
-    return 0;
+    return workloadLog.failed() || frameCapture.failed() ? 1 : 0;
 }
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "args.h"
+#include "bunnies.h"
+#include "sprite_feed.h"
+#include "world.h"
+
+// Companion simulation process for the renderers' --feed mode: moves the bunnies and publishes
+// their positions into a shared-memory ring (see sprite_feed.h) every frame, the way a simulation
+// running apart from its renderer would. Spawns like the renderers do, at the center of the
+// window or, in a large world or with --uniform-spawn, spread over it.
+//
+// Usage: bunnymark_feeder [--feed NAME] [--bunnies N] [--world-scale N] [--uniform-spawn] [--feed-rate HZ]
+//
+// --feed NAME names the ring, /bunnymark_feed by default. --feed-rate HZ publishes at a fixed rate,
+// 60 by default, each frame stepping the simulation by 1000 / HZ ms, and 0 publishes as fast as
+// possible, stepping by the time elapsed. Runs until interrupted, which removes the ring again.
+
+constexpr float WINDOW_WIDTH = 800;
+constexpr float WINDOW_HEIGHT = 600;
+
+using namespace std::chrono;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+constexpr float NANOS_IN_MILLIS = 1000000.0;
+float getMillisElapsed(const time_point<steady_clock>& a, const time_point<steady_clock>& b) {
+    return static_cast<float>(duration_cast<nanoseconds>(a - b).count()) / NANOS_IN_MILLIS;
+}
+
+int main(int argc, char* argv[]) {
+    const char* feedName = getArg(argc, argv, "--feed", "/bunnymark_feed");
+    const uint32_t bunnyCount = getBunnyCount(argc, argv, 100000);
+    const World world = getWorld(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const float rate = std::max(getFloatArg(argc, argv, "--feed-rate", 60.0f), 0.0f);
+
+    Bunnies bunnies;
+    bunnies.reserve(bunnyCount);
+    std::mt19937 rng; // NOLINT deterministic but that's fine here
+    std::uniform_real_distribution dis{-1.0f, 1.0f};
+    const bool spreadSpawn = world.isLarge(WINDOW_WIDTH, WINDOW_HEIGHT) || hasArg(argc, argv, "--uniform-spawn");
+    std::uniform_real_distribution spawnX{0.0f, world.width - 32};
+    std::uniform_real_distribution spawnY{0.0f, world.height - 32};
+    for (uint32_t i = 0; i < bunnyCount; i++) {
+        bunnies.push_back({
+            .x = spreadSpawn ? spawnX(rng) : WINDOW_WIDTH / 2,
+            .y = spreadSpawn ? spawnY(rng) : WINDOW_HEIGHT / 2,
+            .vx = dis(rng),
+            .vy = dis(rng)
+        });
+    }
+
+    SpriteFeedRing ring;
+    if (!ring.create(feedName, bunnyCount)) {
+        std::cerr << "Failed to create shared memory " << feedName << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, [](int) { interrupted = 1; });
+    std::signal(SIGTERM, [](int) { interrupted = 1; });
+    std::cout << "Feeding " << bunnyCount << " bunnies into " << feedName << " ("
+        << spriteFeedBytes(bunnyCount) / (1 << 20) << " MiB) at ";
+    if (rate > 0) {
+        std::cout << rate << " Hz" << std::endl;
+    } else {
+        std::cout << "full speed" << std::endl;
+    }
+
+    const auto frameInterval = duration_cast<steady_clock::duration>(duration<double, std::milli>(rate > 0 ? 1000.0 / rate : 0.0));
+    auto lastFrame = steady_clock::now();
+    auto nextFrame = lastFrame;
+    auto lastReport = lastFrame;
+    uint32_t framesInLastSecond = 0;
+    float publishMillis = 0;
+    while (!interrupted) {
+        const auto now = steady_clock::now();
+        const float dt = rate > 0 ? 1000.0f / rate : getMillisElapsed(now, lastFrame);
+        lastFrame = now;
+        bunnies.update(dt, world);
+
+        const auto publishStart = steady_clock::now();
+        ring.publish(bunnies.x.data(), bunnies.y.data(), bunnyCount);
+        publishMillis += getMillisElapsed(steady_clock::now(), publishStart);
+        framesInLastSecond++;
+
+        if (getMillisElapsed(now, lastReport) > 1000) {
+            const float seconds = getMillisElapsed(now, lastReport) / 1000;
+            std::cout << "Published: " << framesInLastSecond << " frames, "
+                << static_cast<double>(framesInLastSecond) * bunnyCount / seconds / 1e6 << " M sprites/s, publish: "
+                << publishMillis / static_cast<float>(framesInLastSecond) << " ms/frame" << std::endl;
+            framesInLastSecond = 0;
+            publishMillis = 0;
+            lastReport = now;
+        }
+
+        // A fixed rate that falls behind starts over from now instead of catching up
+        if (rate > 0) {
+            nextFrame = std::max(nextFrame + frameInterval, steady_clock::now());
+            std::this_thread::sleep_until(nextFrame);
+        }
+    }
+
+    std::cout << "Interrupted, removing " << feedName << std::endl;
+    return 0;
+}
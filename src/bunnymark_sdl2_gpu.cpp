@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <iostream>
@@ -9,6 +10,25 @@
 
 #include <vector>
 
+#include "args.h"
+#include "bunnies.h"
+#include "churn.h"
+#include "collision.h"
+#include "energy_meter.h"
+#include "fixed_timestep.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "morton_order.h"
+#include "occlusion_cull.h"
+#include "perf_counters.h"
+#include "spatial_grid.h"
+#include "sprite_sort.h"
+#include "static_layer.h"
+#include "texture_pack.h"
+#include "tracking_new.h"
+#include "workload_log.h"
+#include "world.h"
+
 using namespace std::chrono;
 
 constexpr int WINDOW_WIDTH = 800;
@@ -24,7 +44,62 @@ float getMillisElapsed(const time_point<steady_clock>& a, const time_point<stead
     return static_cast<float>(duration_cast<nanoseconds>(a - b).count()) / NANOS_IN_MILLIS;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Heap allocations counted per frame phase, SDL's included from its very first one
+    // (--track-allocs), optionally aborting on any allocation after N warmup frames (--no-alloc-after N)
+    SDL_SetMemoryFunctions(
+        trackedMalloc<AllocSource::SDL>,
+        trackedCalloc<AllocSource::SDL>,
+        trackedRealloc<AllocSource::SDL>,
+        trackedFree
+    );
+    const bool trackAllocations = hasArg(argc, argv, "--track-allocs") || hasArg(argc, argv, "--no-alloc-after");
+    allocationTracker.failAfterFrame(getIntArg(argc, argv, "--no-alloc-after", -1));
+
+    // Population (--bunnies N), defaulting to NUM_BUNNIES. SDL_gpu flushes its blit batch
+    // whenever it fills up, so any count is drawn without further chunking.
+    const uint32_t population = getBunnyCount(argc, argv, NUM_BUNNIES);
+
+    // Large-world mode (--world-scale N), optionally culled on the CPU through a uniform grid (--cpu-cull)
+    const World world = getWorld(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool largeWorld = world.isLarge(WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool cpuCull = hasArg(argc, argv, "--cpu-cull");
+
+    // Cached static layer (--static P, --static-edits N): the frozen share of the population is blitted
+    // into an offscreen image once, only the rest of the bunnies are simulated and blitted
+    StaticLayer staticLayer(argc, argv, population, world, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const uint32_t bunnyCount = population - staticLayer.size();
+
+    // Bunny–bunny collisions (--collide), spread over --threads N worker threads
+    const bool collide = hasArg(argc, argv, "--collide");
+    ThreadPool threadPool(static_cast<unsigned>(std::max(getIntArg(argc, argv, "--threads", std::thread::hardware_concurrency()), 1L)));
+    CollisionSystem collisions(threadPool);
+
+    // Churn mode (--churn P, --spawn P), spawning and despawning bunnies every frame
+    BunnyChurn churn(argc, argv);
+
+    // Depth sort of the drawn bunnies between simulation and fill (--sort), timed per frame
+    const bool sortSprites = hasArg(argc, argv, "--sort");
+    SpriteSorter sorter(threadPool);
+    // Z-order reordering of the bunny store every N simulation steps, for locality in the fill (--morton N)
+    MortonOrder mortonOrder(argc, argv, sorter);
+
+    // Fixed-timestep simulation, drawn interpolated between the last two steps (--tick-rate HZ)
+    FixedTimestep fixedTimestep(argc, argv);
+    // Recording of the frame times and state hashes, or a replay checking them (--record FILE, --replay FILE)
+    WorkloadLog workloadLog(argc, argv);
+    // Offscreen render of frame N, compared against a golden image (--capture-frame N, --golden FILE)
+    FrameCapture frameCapture(argc, argv);
+
+    // Culling of the sprites hidden under the opaque cores of later ones, before the fill (--occlusion-cull)
+    OcclusionCuller occlusionCuller(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Hardware counters of the main thread around simulation, fill and submit (--perf-counters, Linux only)
+    PerfCounters perfCounters(hasArg(argc, argv, "--perf-counters"));
+
+    // Package and DRAM energy over each report window (--energy, Linux powercap)
+    EnergyMeter energyMeter(hasArg(argc, argv, "--energy"));
+
     // Initial SDL_gpu setup
     GPU_SetPreInitFlags(GPU_INIT_DISABLE_VSYNC);
     GPU_Target* screen = GPU_Init(WINDOW_WIDTH, WINDOW_HEIGHT, GPU_DEFAULT_INIT_FLAGS);
@@ -43,44 +118,124 @@ int main() {
     }
     SDL_SetWindowTitle(window, "SDL_gpu Bunnymark");
 
-    // Load the bunny image
-    GPU_Image* bunnyTexture = GPU_LoadImage("../bunny.png");
+    // Create the bunny image from the memory-mapped texture pack made by the cook_textures target,
+    // uploading its top mip level straight from the mapping
+    TexturePack texturePack;
+    const PackTexture* bunnyImage = texturePack.open("sprites.pack") ? texturePack.find("bunny") : nullptr;
+    if (!bunnyImage) {
+        SDL_SetError("No bunny in sprites.pack, build the cook_textures target");
+        logError("Failed to load texture");
+        GPU_Quit();
+        return 1;
+    }
+    GPU_Image* bunnyTexture = GPU_CreateImage(bunnyImage->width, bunnyImage->height, GPU_FORMAT_RGBA);
+    if (!bunnyTexture) {
+        logError("Failed to create image");
+        GPU_Quit();
+        return 1;
+    }
+    GPU_UpdateImageBytes(bunnyTexture, nullptr, texturePack.data(*bunnyImage), static_cast<int>(bunnyImage->width) * 4);
+
+    // GPU_Blit centers the image on the bunny's position
+    occlusionCuller.setSprite(
+        texturePack.data(*bunnyImage),
+        bunnyImage->width,
+        bunnyImage->height,
+        static_cast<float>(bunnyImage->width) / 2,
+        static_cast<float>(bunnyImage->height) / 2
+    );
+
+    // The static layer, only blitted into when it changes and copied over the target every frame in
+    // place of the clear
+    GPU_Image* staticLayerImage = nullptr;
+    GPU_Target* staticLayerTarget = nullptr;
+    if (staticLayer.enabled()) {
+        staticLayerImage = GPU_CreateImage(
+            static_cast<Uint16>(staticLayer.width()),
+            static_cast<Uint16>(staticLayer.height()),
+            GPU_FORMAT_RGBA
+        );
+        staticLayerTarget = staticLayerImage ? GPU_LoadTarget(staticLayerImage) : nullptr;
+        if (!staticLayerTarget) {
+            logError("Failed to create static layer");
+            if (staticLayerImage) {
+                GPU_FreeImage(staticLayerImage);
+            }
+            GPU_FreeImage(bunnyTexture);
+            GPU_Quit();
+            return 1;
+        }
+        GPU_SetBlending(staticLayerImage, false);
+        GPU_SetImageFilter(staticLayerImage, GPU_FILTER_NEAREST);
+    }
+
+    // The captured frame is blitted into this image instead of the screen and read back from it
+    GPU_Image* captureImage = nullptr;
+    GPU_Target* captureTarget = nullptr;
+    if (frameCapture.enabled()) {
+        captureImage = GPU_CreateImage(WINDOW_WIDTH, WINDOW_HEIGHT, GPU_FORMAT_RGBA);
+        captureTarget = captureImage ? GPU_LoadTarget(captureImage) : nullptr;
+        if (!captureTarget) {
+            logError("Failed to create capture target, the frame will not be captured");
+        }
+    }
 
     //
     // Set up the bunnies
     //
 
-    struct Bunny {
-        float x, y;
-        float vx, vy;
-    };
-
-    std::vector<Bunny> bunnies;
+    Bunnies bunnies;
+    bunnies.reserve(bunnyCount);
     std::mt19937 rng; // NOLINT deterministic but that's fine here
     std::uniform_real_distribution dis{-1.0f, 1.0f};
 
-    for (int i = 0; i < NUM_BUNNIES; i++) {
-        bunnies.push_back({
-            .x = static_cast<float>(WINDOW_WIDTH) / 2,
-            .y = static_cast<float>(WINDOW_HEIGHT) / 2,
+    // In large-world and collision mode the bunnies start spread over the whole world instead of
+    // stacked at the center, where every bunny would overlap every other one. --uniform-spawn
+    // spreads them in any mode.
+    const bool spreadSpawn = largeWorld || collide || hasArg(argc, argv, "--uniform-spawn");
+    std::uniform_real_distribution spawnX{0.0f, world.width - 32};
+    std::uniform_real_distribution spawnY{0.0f, world.height - 32};
+
+    auto spawnBunny = [&] {
+        return Bunny{
+            .x = spreadSpawn ? spawnX(rng) : static_cast<float>(WINDOW_WIDTH) / 2,
+            .y = spreadSpawn ? spawnY(rng) : static_cast<float>(WINDOW_HEIGHT) / 2,
             .vx = dis(rng),
             .vy = dis(rng)
-        });
+        };
+    };
+    for (uint32_t i = 0; i < bunnyCount; i++) {
+        bunnies.push_back(spawnBunny());
     }
+    workloadLog.start(bunnies, world, fixedTimestep.tickMillis());
+
+    Camera camera{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    SpatialGrid grid(world.width, world.height, getFloatArg(argc, argv, "--grid-cell", 128.0f));
+
+    // Per-frame CPU staging (culled index lists, sort keys, ...), --frame-arena N MiB to start with
+    FrameArena frameArena(static_cast<size_t>(std::max(getIntArg(argc, argv, "--frame-arena", DEFAULT_FRAME_ARENA_MIB), 1L)) << 20);
+
+    uint32_t drawCount = bunnyCount;
 
     //
     // Start the game loop
     //
 
+    const auto startTime = steady_clock::now();
     auto lastTick = steady_clock::now();
+    energyMeter.restart();
     auto lastFpsMeasurement = steady_clock::now();
     float dt = 0;
+    float sortMillis = 0;
     uint32_t framesInLastSecond = 0;
 
     bool running = true;
     SDL_Event event;
 
     while (running) {
+        allocationTracker.beginFrame();
+        frameArena.beginFrame();
+
         // Listen for quit event
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
@@ -93,31 +248,190 @@ int main() {
         dt = getMillisElapsed(now, lastTick);
         lastTick = now;
 
+        // The simulation and the camera run on the frame's times, or on the recorded ones in a replay,
+        // which stops once they run out
+        float simulationMillis = dt;
+        float sceneMillis = getMillisElapsed(now, startTime);
+        if (!workloadLog.beginFrame(simulationMillis, sceneMillis)) {
+            running = false;
+        }
+
         // Measure FPS and report every second
+        allocationTracker.setPhase(AllocPhase::Report);
         framesInLastSecond++;
         if (getMillisElapsed(now, lastFpsMeasurement) > 1000) {
-            std::cout << "FPS: " << framesInLastSecond << std::endl;
+            std::cout << "FPS: " << framesInLastSecond;
+            if (churn.enabled()) {
+                std::cout << ", bunnies: " << bunnies.size() << " (+" << churn.takeSpawned()
+                    << "/-" << churn.takeDespawned() << ")";
+            }
+            if (cpuCull) {
+                std::cout << ", drawn: " << drawCount << ", culled: " << bunnies.size() - drawCount;
+            }
+            staticLayer.report(std::cout);
+            if (collide) {
+                std::cout << ", colliding: " << collisions.lastCollidingCount();
+            }
+            if (sortSprites) {
+                std::cout << ", sort: " << sortMillis / framesInLastSecond << " ms/frame";
+                sortMillis = 0;
+            }
+            fixedTimestep.report(std::cout);
+            workloadLog.report(std::cout);
+            mortonOrder.report(std::cout);
+            occlusionCuller.report(std::cout);
+            if (const size_t arenaPeak = frameArena.takePeakBytes(); arenaPeak > 0) {
+                std::cout << ", frame arena: " << arenaPeak / 1024 << " of " << frameArena.capacity() / 1024 << " KiB";
+            }
+            energyMeter.report(std::cout, framesInLastSecond, bunnies.size(), getMillisElapsed(now, lastFpsMeasurement));
+            std::cout << std::endl;
+            if (trackAllocations) {
+                allocationTracker.report(std::cout);
+            }
+            perfCounters.report(std::cout);
             framesInLastSecond = 0;
             lastFpsMeasurement = now;
         }
 
-        GPU_ClearColor(screen, SDL_Color{128, 128, 255});
+        allocationTracker.setPhase(AllocPhase::Render);
+        GPU_Target* target = captureTarget && frameCapture.beginFrame() ? captureTarget : screen;
+        if (!staticLayer.enabled()) {
+            GPU_ClearColor(target, SDL_Color{128, 128, 255});
+        }
+
+        // Spawn and despawn bunnies, then update them, optionally colliding them with each other. With
+        // --tick-rate this runs in fixed steps, as many as are due, instead of once by the frame time
+        allocationTracker.setPhase(AllocPhase::Simulate);
+        perfCounters.begin(PerfPhase::Simulate);
+        const uint32_t ticks = fixedTimestep.enabled() ? fixedTimestep.advance(simulationMillis) : 1;
+        const float stepMillis = fixedTimestep.enabled() ? fixedTimestep.tickMillis() : simulationMillis;
+        for (uint32_t tick = 0; tick < ticks; tick++) {
+            if (churn.enabled()) {
+                churn.update(bunnies, rng, spawnBunny);
+                drawCount = static_cast<uint32_t>(bunnies.size());
+            }
+            mortonOrder.update(bunnies, frameArena);
+            fixedTimestep.snapshot(bunnies);
+            bunnies.update(stepMillis, world);
+            if (collide) {
+                collisions.resolve(bunnies);
+            }
+        }
+
+        perfCounters.end(PerfPhase::Simulate, bunnies.size());
+        workloadLog.endSimulation(bunnies);
 
-        // Update the bunnies
-        for (auto&[x, y, vx, vy] : bunnies) {
-            x += vx * dt;
-            y += vy * dt;
+        // Pan the camera across the world
+        if (largeWorld) {
+            camera.update(world, sceneMillis);
+        }
+
+        // Redraw the static layer if it changed, then copy the view's part of it over the whole target
+        allocationTracker.setPhase(AllocPhase::Render);
+        if (staticLayer.beginFrame(camera)) {
+            GPU_ClearColor(staticLayerTarget, SDL_Color{128, 128, 255});
+            const Bunnies& frozen = staticLayer.bunnies();
+            for (uint32_t i = 0; i < staticLayer.size(); i++) {
+                GPU_Blit(
+                    bunnyTexture,
+                    nullptr,
+                    staticLayerTarget,
+                    frozen.x[i] - staticLayer.originX(),
+                    frozen.y[i] - staticLayer.originY()
+                );
+            }
+        }
+        if (staticLayer.enabled()) {
+            GPU_Rect source{
+                static_cast<float>(staticLayer.sourceX(camera)),
+                static_cast<float>(staticLayer.sourceY(camera)),
+                camera.width,
+                camera.height
+            };
+            GPU_BlitRect(staticLayerImage, &source, target, nullptr);
+        }
+
+        // Only bunnies in grid cells touching the camera get blitted
+        allocationTracker.setPhase(AllocPhase::Cull);
+        uint32_t* visibleBunnies = nullptr;
+        if (cpuCull) {
+            grid.build(bunnies.x.data(), bunnies.y.data(), bunnies.size());
+            visibleBunnies = frameArena.allocate<uint32_t>(bunnies.size());
+            drawCount = grid.query(
+                camera.x - 32,
+                camera.y - 32,
+                camera.x + camera.width + 32,
+                camera.y + camera.height + 32,
+                visibleBunnies
+            );
+        }
+
+        // Sort the drawn bunnies back to front by y, which the fill then follows. They all
+        // share one texture, so the texture half of the key is constant and costs no passes.
+        const uint32_t* drawOrder = visibleBunnies;
+        if (sortSprites) {
+            const auto sortStart = steady_clock::now();
+            drawOrder = sorter.sort(frameArena, drawOrder, drawCount, [&](const uint32_t index) {
+                return spriteSortKey(bunnies.y[index], 0);
+            });
+            sortMillis += getMillisElapsed(steady_clock::now(), sortStart);
+        }
+
+        // Drop the bunnies completely hidden under the ones blitted after them, for this frame only
+        uint32_t fillCount = drawCount;
+        if (occlusionCuller.enabled() && !fixedTimestep.enabled()) {
+            drawOrder = occlusionCuller.cull(frameArena, bunnies, camera, drawOrder, fillCount);
+        }
+        allocationTracker.setPhase(AllocPhase::Render);
+
+        // Blit at the positions interpolated between the last two steps with --tick-rate
+        perfCounters.begin(PerfPhase::Fill);
+        for (uint32_t i = 0; i < fillCount; i++) {
+            const uint32_t index = drawOrder ? drawOrder[i] : i;
+            GPU_Blit(
+                bunnyTexture,
+                nullptr,
+                target,
+                fixedTimestep.x(bunnies, index) - camera.x,
+                fixedTimestep.y(bunnies, index) - camera.y
+            );
+        }
 
-            if (x < 0 || x > WINDOW_WIDTH - 32) vx *= -1;
-            if (y < 0 || y > WINDOW_HEIGHT - 32) vy *= -1;
+        perfCounters.end(PerfPhase::Fill, fillCount);
 
-            GPU_Blit(bunnyTexture, nullptr, screen, x, y);
+        // Read the captured frame back in RGBA, check it and stop
+        if (target == captureTarget) {
+            SDL_Surface* readBack = GPU_CopySurfaceFromTarget(captureTarget);
+            SDL_Surface* captured = readBack ? SDL_ConvertSurfaceFormat(readBack, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+            if (captured) {
+                frameCapture.check(
+                    static_cast<const uint8_t*>(captured->pixels),
+                    static_cast<uint32_t>(captured->w),
+                    static_cast<uint32_t>(captured->h),
+                    static_cast<size_t>(captured->pitch),
+                    PixelOrder::RGBA,
+                    false
+                );
+            } else {
+                logError("Failed to read back the captured frame");
+            }
+            SDL_FreeSurface(captured);
+            SDL_FreeSurface(readBack);
+            running = false;
         }
 
+        perfCounters.begin(PerfPhase::Submit);
         GPU_Flip(screen);
+        perfCounters.end(PerfPhase::Submit, fillCount);
     }
 
+    if (captureImage) {
+        GPU_FreeImage(captureImage); // along with its target
+    }
+    if (staticLayerImage) {
+        GPU_FreeImage(staticLayerImage);
+    }
     GPU_FreeImage(bunnyTexture);
     GPU_Quit();
-    return 0;
+    return workloadLog.failed() || frameCapture.failed() ? 1 : 0;
 }
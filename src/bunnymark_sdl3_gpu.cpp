@@ -1,15 +1,47 @@
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <ctime>
+#include <filesystem>
 #include <iostream>
 #include <ostream>
 #include <random>
+#include <string>
 
+#include "SDL3/SDL_filesystem.h"
 #include "SDL3/SDL_gpu.h"
 #include "SDL3/SDL_init.h"
 #include <vector>
 
 #include "SDL3/SDL_log.h"
 
+#include "ablation.h"
+#include "args.h"
+#include "buffer_growth.h"
+#include "bunnies.h"
+#include "churn.h"
+#include "collision.h"
+#include "energy_meter.h"
+#include "fixed_timestep.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "frame_pacing.h"
+#include "gpu_frame_timer.h"
+#include "mapped_file.h"
+#include "morton_order.h"
+#include "occlusion_cull.h"
+#include "perf_counters.h"
+#include "pipeline_cache.h"
+#include "spatial_grid.h"
+#include "sprite_feed.h"
+#include "sprite_sort.h"
+#include "startup_profiler.h"
+#include "static_layer.h"
+#include "texture_pack.h"
+#include "tracking_new.h"
+#include "workload_log.h"
+#include "world.h"
+
 using namespace std::chrono;
 
 constexpr int WINDOW_WIDTH = 800;
@@ -17,15 +49,219 @@ constexpr int WINDOW_HEIGHT = 600;
 
 constexpr int NUM_BUNNIES = 50000;
 
+// Frames the swapchain lets the CPU run ahead of the GPU, SDL's default made explicit so the
+// present ablation can keep the same depth without a swapchain to block on
+constexpr Uint32 FRAMES_IN_FLIGHT = 2;
+
+// Sprites per GPU buffer and draw call. Vulkan only guarantees 128 MiB of storage buffer range,
+// i.e. 2M 64-byte sprites, and 2M sprites are 32768 cull groups, below the 65535 limit on
+// dispatch size. Larger populations are split into chunks of this many sprites.
+constexpr Uint32 MAX_SPRITES_PER_DRAW = 1 << 21;
+
 typedef struct SpriteInstance
 {
     float x, y, z;
     float rotation;
-    float w, h, padding_a, padding_b;
+    float w, h;
+    float prev_x, prev_y; // position before the last --tick-rate step
     float tex_u, tex_v, tex_w, tex_h;
     float r, g, b, a;
 } SpriteInstance;
 
+// Used by SubmitMode::Vertex, where quads are expanded on the CPU
+typedef struct SpriteVertex
+{
+    float x, y;
+    float u, v;
+    Uint32 color;
+} SpriteVertex;
+
+enum class SubmitMode {
+    Storage,   // bunny count * 6 non-indexed vertices pulling sprites from a storage buffer
+    Instanced, // one shared 4-vertex indexed quad, instanced once per bunny
+    Vertex,    // classic vertex buffer with 4 CPU-expanded vertices per sprite
+    Indirect   // same as Storage, but the draw arguments come from an indirect buffer
+};
+
+// Sprite data buffers are sized in 32 bits, which every chunk stays well within
+static_assert(Uint64{MAX_SPRITES_PER_DRAW} * 4 * sizeof(SpriteVertex) <= SDL_MAX_UINT32);
+static_assert(Uint64{MAX_SPRITES_PER_DRAW} * 6 * sizeof(Uint32) <= SDL_MAX_UINT32);
+
+// Upper bound on the number of chunks, used to size the indirect argument uploads once
+constexpr Uint32 MAX_SPRITE_CHUNKS = (MAX_BUNNIES + MAX_SPRITES_PER_DRAW - 1) / MAX_SPRITES_PER_DRAW;
+
+// GPU buffers of one chunk of sprites, each uploaded, culled and drawn on its own
+typedef struct SpriteChunk
+{
+    Uint32 first, capacity;
+    Uint32 drawCount; // uploaded this frame
+    SDL_GPUBuffer* spriteDataBuffer;
+    SDL_GPUBuffer* visibleSpriteBuffer; // --gpu-cull only
+    SDL_GPUBuffer* drawArgsBuffer;      // SubmitMode::Indirect only
+} SpriteChunk;
+
+void releaseSpriteChunk(SDL_GPUDevice* device, const SpriteChunk& chunk) {
+    SDL_ReleaseGPUBuffer(device, chunk.spriteDataBuffer);
+    SDL_ReleaseGPUBuffer(device, chunk.visibleSpriteBuffer);
+    SDL_ReleaseGPUBuffer(device, chunk.drawArgsBuffer);
+}
+
+void releaseSpriteChunks(SDL_GPUDevice* device, const std::vector<SpriteChunk>& chunks) {
+    for (const SpriteChunk& chunk : chunks) {
+        releaseSpriteChunk(device, chunk);
+    }
+}
+
+// Creates the buffers of a chunk with room for `capacity` sprites: the sprite data, plus the
+// visible sprites when culling on the GPU and the draw arguments when drawing indirectly
+bool createSpriteChunk(
+    SDL_GPUDevice* device,
+    SpriteChunk& chunk,
+    const Uint32 capacity,
+    const SubmitMode submitMode,
+    const bool gpuCull
+) {
+    chunk.capacity = capacity;
+    SDL_GPUBufferCreateInfo spriteDataBufferCreateInfo {
+        .usage = submitMode == SubmitMode::Vertex
+            ? SDL_GPU_BUFFERUSAGE_VERTEX
+            : SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ | (gpuCull ? SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_READ : 0),
+        .size = capacity * static_cast<Uint32>(submitMode == SubmitMode::Vertex ? 4 * sizeof(SpriteVertex) : sizeof(SpriteInstance))
+    };
+    chunk.spriteDataBuffer = SDL_CreateGPUBuffer(device, &spriteDataBufferCreateInfo);
+
+    chunk.visibleSpriteBuffer = nullptr;
+    if (gpuCull) {
+        SDL_GPUBufferCreateInfo visibleSpriteBufferCreateInfo {
+            .usage = SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE | SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
+            .size = capacity * static_cast<Uint32>(sizeof(SpriteInstance))
+        };
+        chunk.visibleSpriteBuffer = SDL_CreateGPUBuffer(device, &visibleSpriteBufferCreateInfo);
+    }
+
+    chunk.drawArgsBuffer = nullptr;
+    if (submitMode == SubmitMode::Indirect) {
+        SDL_GPUBufferCreateInfo drawArgsBufferCreateInfo {
+            .usage = SDL_GPU_BUFFERUSAGE_INDIRECT | (gpuCull ? SDL_GPU_BUFFERUSAGE_COMPUTE_STORAGE_WRITE : 0),
+            .size = sizeof(SDL_GPUIndirectDrawCommand)
+        };
+        chunk.drawArgsBuffer = SDL_CreateGPUBuffer(device, &drawArgsBufferCreateInfo);
+    }
+
+    if (!chunk.spriteDataBuffer || (gpuCull && !chunk.visibleSpriteBuffer)
+        || (submitMode == SubmitMode::Indirect && !chunk.drawArgsBuffer)) {
+        releaseSpriteChunk(device, chunk);
+        return false;
+    }
+    return true;
+}
+
+// Makes room for `count` sprites, growing each chunk geometrically up to MAX_SPRITES_PER_DRAW
+// and appending chunks as needed. The old buffers are released once the GPU is done with them.
+// Returns false if a buffer could not be created, leaving that chunk as it was.
+bool growSpriteChunks(
+    SDL_GPUDevice* device,
+    std::vector<SpriteChunk>& chunks,
+    const Uint32 count,
+    const SubmitMode submitMode,
+    const bool gpuCull,
+    BufferGrowth& growth
+) {
+    for (Uint32 i = 0; i * static_cast<Uint64>(MAX_SPRITES_PER_DRAW) < count; i++) {
+        const Uint32 required = std::min(count - i * MAX_SPRITES_PER_DRAW, MAX_SPRITES_PER_DRAW);
+        const Uint32 capacity = i < chunks.size() ? chunks[i].capacity : 0;
+        const Uint32 grown = BufferGrowth::grow(capacity, required, MAX_SPRITES_PER_DRAW);
+        if (grown == capacity) {
+            continue;
+        }
+
+        SpriteChunk chunk{ .first = i * MAX_SPRITES_PER_DRAW };
+        if (!createSpriteChunk(device, chunk, grown, submitMode, gpuCull)) {
+            return false;
+        }
+        if (i < chunks.size()) {
+            releaseSpriteChunk(device, chunks[i]);
+            chunks[i] = chunk;
+        } else {
+            chunks.push_back(chunk);
+        }
+        const Uint64 stride = submitMode == SubmitMode::Vertex ? 4 * sizeof(SpriteVertex) : sizeof(SpriteInstance);
+        growth.recordReallocation("sprite buffers", capacity * stride, grown * stride);
+    }
+    return true;
+}
+
+// Creates the index buffer of SubmitMode::Vertex, 6 indices for each of `quadCount` quads, and
+// records its upload into `copyPass`. The transfer buffer is released once the upload is done.
+SDL_GPUBuffer* createQuadIndexBuffer(SDL_GPUDevice* device, SDL_GPUCopyPass* copyPass, const Uint32 quadCount) {
+    const Uint32 size = quadCount * 6 * sizeof(Uint32);
+    SDL_GPUBufferCreateInfo indexBufferCreateInfo {
+        .usage = SDL_GPU_BUFFERUSAGE_INDEX,
+        .size = size
+    };
+    SDL_GPUBuffer* indexBuffer = SDL_CreateGPUBuffer(device, &indexBufferCreateInfo);
+    SDL_GPUTransferBufferCreateInfo indexTransferBufferCreateInfo {
+        .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+        .size = size
+    };
+    SDL_GPUTransferBuffer* indexTransferBuffer = SDL_CreateGPUTransferBuffer(device, &indexTransferBufferCreateInfo);
+    if (!indexBuffer || !indexTransferBuffer) {
+        SDL_ReleaseGPUTransferBuffer(device, indexTransferBuffer);
+        SDL_ReleaseGPUBuffer(device, indexBuffer);
+        return nullptr;
+    }
+
+    auto indices = static_cast<Uint32*>(SDL_MapGPUTransferBuffer(device, indexTransferBuffer, false));
+    for (Uint32 i = 0; i < quadCount; i++) {
+        const Uint32 base = i * 4;
+        indices[i * 6 + 0] = base + 0;
+        indices[i * 6 + 1] = base + 1;
+        indices[i * 6 + 2] = base + 2;
+        indices[i * 6 + 3] = base + 3;
+        indices[i * 6 + 4] = base + 2;
+        indices[i * 6 + 5] = base + 1;
+    }
+    SDL_UnmapGPUTransferBuffer(device, indexTransferBuffer);
+
+    SDL_GPUTransferBufferLocation indexLocation{
+        .transfer_buffer = indexTransferBuffer,
+        .offset = 0
+    };
+    SDL_GPUBufferRegion indexRegion{
+        .buffer = indexBuffer,
+        .offset = 0,
+        .size = size
+    };
+    SDL_UploadToGPUBuffer(copyPass, &indexLocation, &indexRegion, false);
+    SDL_ReleaseGPUTransferBuffer(device, indexTransferBuffer);
+    return indexBuffer;
+}
+
+// Uniforms of CullSprites.comp
+typedef struct CullParams
+{
+    float viewMinX, viewMinY, viewMaxX, viewMaxY;
+    Uint32 spriteCount;
+    Uint32 padding[3];
+} CullParams;
+
+bool parseSubmitMode(const char* name, SubmitMode& mode) {
+    if (SDL_strcmp(name, "storage") == 0) mode = SubmitMode::Storage;
+    else if (SDL_strcmp(name, "instanced") == 0) mode = SubmitMode::Instanced;
+    else if (SDL_strcmp(name, "vertex") == 0) mode = SubmitMode::Vertex;
+    else if (SDL_strcmp(name, "indirect") == 0) mode = SubmitMode::Indirect;
+    else return false;
+    return true;
+}
+
+bool parsePresentMode(const char* name, SDL_GPUPresentMode& mode) {
+    if (SDL_strcmp(name, "immediate") == 0) mode = SDL_GPU_PRESENTMODE_IMMEDIATE;
+    else if (SDL_strcmp(name, "mailbox") == 0) mode = SDL_GPU_PRESENTMODE_MAILBOX;
+    else if (SDL_strcmp(name, "vsync") == 0) mode = SDL_GPU_PRESENTMODE_VSYNC;
+    else return false;
+    return true;
+}
+
 typedef struct Matrix4x4
 {
     float m11, m12, m13, m14;
@@ -34,6 +270,14 @@ typedef struct Matrix4x4
     float m41, m42, m43, m44;
 } Matrix4x4;
 
+// Vertex uniforms of the sprite pipelines. The storage and instanced shaders move every sprite
+// interpolation[0] of the way from its previous position to its current one.
+typedef struct SpriteUniforms
+{
+    Matrix4x4 viewProjection;
+    float interpolation[4];
+} SpriteUniforms;
+
 Matrix4x4 Matrix4x4_CreateOrthographicOffCenter(
     const float left,
     const float right,
@@ -59,48 +303,78 @@ float getMillisElapsed(const time_point<steady_clock>& a, const time_point<stead
     return static_cast<float>(duration_cast<nanoseconds>(a - b).count()) / NANOS_IN_MILLIS;
 }
 
-SDL_GPUShader* loadShader(
+constexpr const char* SHADER_PATH = "../shaders/sdl/compiled";
+
+// True if the `extension` blob of `shaderFilename` exists. The SPIR-V and MSL blobs are committed,
+// DXIL ones only exist once the sdl_shaders target has built them on a machine with DXC.
+bool isShaderCompiled(const char* shaderFilename, const char* extension) {
+    char fullPath[256];
+    SDL_snprintf(fullPath, sizeof(fullPath), "%s/%s.%s", SHADER_PATH, shaderFilename, extension);
+    return SDL_GetPathInfo(fullPath, nullptr);
+}
+
+// Maps the compiled shader blob matching the device's preferred shader format. The mapping
+// is passed to SDL as-is, so the blob is never copied into an intermediate buffer.
+bool loadShaderCode(
     SDL_GPUDevice* device,
     const char* shaderFilename,
-    const SDL_GPUShaderStage stage,
-    const Uint32 samplerCount,
-    const Uint32 storageTextureCount,
-    const Uint32 storageBufferCount,
-    const Uint32 uniformBufferCount
+    MappedFile& code,
+    SDL_GPUShaderFormat* format,
+    const char** entrypoint
 ) {
     char fullPath[256];
     const SDL_GPUShaderFormat supportedFormats = SDL_GetGPUShaderFormats(device);
-    SDL_GPUShaderFormat format;
-    const char* entrypoint;
-    const auto basePath = "../shaders/sdl/compiled";
+    const auto basePath = SHADER_PATH;
 
     if (supportedFormats & SDL_GPU_SHADERFORMAT_SPIRV) {
         SDL_snprintf(fullPath, sizeof(fullPath), "%s/%s.spv", basePath, shaderFilename);
-        format = SDL_GPU_SHADERFORMAT_SPIRV;
-        entrypoint = "main";
+        *format = SDL_GPU_SHADERFORMAT_SPIRV;
+        *entrypoint = "main";
     } else if (supportedFormats & SDL_GPU_SHADERFORMAT_MSL) {
         SDL_snprintf(fullPath, sizeof(fullPath), "%s/%s.msl", basePath, shaderFilename);
-        format = SDL_GPU_SHADERFORMAT_MSL;
-        entrypoint = "main0";
+        *format = SDL_GPU_SHADERFORMAT_MSL;
+        *entrypoint = "main0";
     } else if (supportedFormats & SDL_GPU_SHADERFORMAT_DXIL) {
         SDL_snprintf(fullPath, sizeof(fullPath), "%s/%s.dxil", basePath, shaderFilename);
-        format = SDL_GPU_SHADERFORMAT_DXIL;
-        entrypoint = "main";
+        *format = SDL_GPU_SHADERFORMAT_DXIL;
+        *entrypoint = "main";
     } else {
         SDL_SetError("Unknown shader format");
-        return nullptr;
+        return false;
     }
 
-    size_t codeSize;
-    void* code = SDL_LoadFile(fullPath, &codeSize);
-    if (!code) {
+    if (!code.open(fullPath)) {
         SDL_SetError("Shader file not found");
+        return false;
+    }
+    return true;
+}
+
+SDL_GPUShader* loadShader(
+    SDL_GPUDevice* device,
+    const char* shaderFilename,
+    const SDL_GPUShaderStage stage,
+    const Uint32 samplerCount,
+    const Uint32 storageTextureCount,
+    const Uint32 storageBufferCount,
+    const Uint32 uniformBufferCount,
+    Uint64* codeHash = nullptr
+) {
+    MappedFile code;
+    SDL_GPUShaderFormat format;
+    const char* entrypoint;
+    if (!loadShaderCode(device, shaderFilename, code, &format, &entrypoint)) {
         return nullptr;
     }
 
+    // Folds the blob into the caller's running hash, which keys the pipeline cache
+    if (codeHash) {
+        *codeHash = PipelineCache::hash({reinterpret_cast<const char*>(code.data()), code.size()}, *codeHash);
+    }
+
     SDL_GPUShaderCreateInfo shaderInfo = {
-        .code_size = codeSize,
-        .code =  static_cast<Uint8*>(code),
+        .code_size = code.size(),
+        .code = code.data(),
         .entrypoint = entrypoint,
         .format = format,
         .stage = stage,
@@ -110,11 +384,176 @@ SDL_GPUShader* loadShader(
         .num_uniform_buffers = uniformBufferCount
     };
     SDL_GPUShader* shader = SDL_CreateGPUShader(device, &shaderInfo);
-    SDL_free(code);
     return shader;
 }
 
-int main() {
+SDL_GPUComputePipeline* loadComputePipeline(
+    SDL_GPUDevice* device,
+    const char* shaderFilename,
+    const Uint32 readonlyStorageBufferCount,
+    const Uint32 readwriteStorageBufferCount,
+    const Uint32 uniformBufferCount,
+    const Uint32 threadCountX
+) {
+    MappedFile code;
+    SDL_GPUShaderFormat format;
+    const char* entrypoint;
+    if (!loadShaderCode(device, shaderFilename, code, &format, &entrypoint)) {
+        return nullptr;
+    }
+
+    SDL_GPUComputePipelineCreateInfo pipelineInfo = {
+        .code_size = code.size(),
+        .code = code.data(),
+        .entrypoint = entrypoint,
+        .format = format,
+        .num_readonly_storage_buffers = readonlyStorageBufferCount,
+        .num_readwrite_storage_buffers = readwriteStorageBufferCount,
+        .num_uniform_buffers = uniformBufferCount,
+        .threadcount_x = threadCountX,
+        .threadcount_y = 1,
+        .threadcount_z = 1
+    };
+    SDL_GPUComputePipeline* pipeline = SDL_CreateGPUComputePipeline(device, &pipelineInfo);
+    return pipeline;
+}
+
+int main(int argc, char* argv[]) {
+    // Heap allocations counted per frame phase, SDL's included from its very first one
+    // (--track-allocs), optionally aborting on any allocation after N warmup frames (--no-alloc-after N)
+    SDL_SetMemoryFunctions(
+        trackedMalloc<AllocSource::SDL>,
+        trackedCalloc<AllocSource::SDL>,
+        trackedRealloc<AllocSource::SDL>,
+        trackedFree
+    );
+    const bool trackAllocations = hasArg(argc, argv, "--track-allocs") || hasArg(argc, argv, "--no-alloc-after");
+    allocationTracker.failAfterFrame(getIntArg(argc, argv, "--no-alloc-after", -1));
+
+    // Select the vertex submission strategy (--submit storage|instanced|vertex|indirect)
+    SubmitMode submitMode = SubmitMode::Storage;
+    const char* submitModeName = getArg(argc, argv, "--submit", "storage");
+    if (!parseSubmitMode(submitModeName, submitMode)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unknown submission strategy: %s", submitModeName);
+        return 1;
+    }
+
+    // Select the present mode (--present immediate|mailbox|vsync), whether to block until a
+    // swapchain image is free or skip the frame (--acquire wait|poll), and optionally pace frames
+    // to a fixed interval (--frame-interval MS)
+    SDL_GPUPresentMode presentMode = SDL_GPU_PRESENTMODE_IMMEDIATE;
+    const char* presentModeName = getArg(argc, argv, "--present", "immediate");
+    if (!parsePresentMode(presentModeName, presentMode)) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unknown present mode: %s", presentModeName);
+        return 1;
+    }
+    const char* acquireName = getArg(argc, argv, "--acquire", "wait");
+    const bool pollSwapchain = SDL_strcmp(acquireName, "poll") == 0;
+    if (!pollSwapchain && SDL_strcmp(acquireName, "wait") != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unknown acquire strategy: %s", acquireName);
+        return 1;
+    }
+    FramePacer pacer(getFloatArg(argc, argv, "--frame-interval", 0.0f));
+
+    // Population (--bunnies N), defaulting to NUM_BUNNIES
+    const Uint32 population = getBunnyCount(argc, argv, NUM_BUNNIES);
+    // Sprite positions from a bunnymark_feeder process instead of the local simulation (--feed NAME)
+    SpriteFeed spriteFeed(argc, argv);
+
+    // Large-world mode (--world-scale N), optionally culled on the GPU (--gpu-cull)
+    // or on the CPU through a uniform grid (--cpu-cull). The GPU cull pass writes the
+    // indirect draw arguments, so it always draws indirectly.
+    const World world = getWorld(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool largeWorld = world.isLarge(WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool gpuCull = hasArg(argc, argv, "--gpu-cull");
+    const bool cpuCull = !gpuCull && !spriteFeed.enabled() && hasArg(argc, argv, "--cpu-cull");
+
+    // Cached static layer (--static P, --static-edits N): the frozen share of the population is drawn
+    // into an offscreen texture once, only the rest of the bunnies are simulated, uploaded and drawn
+    StaticLayer staticLayer(argc, argv, population, world, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const Uint32 bunnyCount = population - staticLayer.size();
+
+    // Bunny–bunny collisions (--collide), spread over --threads N worker threads
+    const bool collide = hasArg(argc, argv, "--collide");
+    ThreadPool threadPool(static_cast<unsigned>(std::max(getIntArg(argc, argv, "--threads", std::thread::hardware_concurrency()), 1L)));
+    CollisionSystem collisions(threadPool);
+
+    // Churn mode (--churn P, --spawn P), spawning and despawning bunnies every frame
+    BunnyChurn churn(argc, argv);
+
+    // Depth sort of the drawn bunnies between simulation and fill (--sort), timed per frame
+    const bool sortSprites = !gpuCull && !spriteFeed.enabled() && hasArg(argc, argv, "--sort");
+    SpriteSorter sorter(threadPool);
+    // Z-order reordering of the bunny store every N simulation steps, for locality in the fill (--morton N)
+    MortonOrder mortonOrder(argc, argv, sorter);
+
+    // Fixed-timestep simulation, drawn interpolated between the last two steps (--tick-rate HZ)
+    FixedTimestep fixedTimestep(argc, argv);
+    // Recording of the frame times and state hashes, or a replay checking them (--record FILE, --replay FILE)
+    WorkloadLog workloadLog(argc, argv);
+    // Offscreen render of frame N, compared against a golden image (--capture-frame N, --golden FILE)
+    FrameCapture frameCapture(argc, argv);
+
+    // Culling of the sprites hidden under the opaque cores of later ones, before the fill (--occlusion-cull)
+    OcclusionCuller occlusionCuller(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Hardware counters of the main thread around simulation, fill and submit (--perf-counters, Linux only)
+    PerfCounters perfCounters(hasArg(argc, argv, "--perf-counters"));
+
+    // Package and DRAM energy over each report window (--energy, Linux powercap)
+    EnergyMeter energyMeter(hasArg(argc, argv, "--energy"));
+
+    // Bottleneck attribution (--ablate), replaying the scenario for --ablate-frames N frames per ablation
+    AblationRunner ablation(
+        hasArg(argc, argv, "--ablate"),
+        static_cast<Uint32>(getIntArg(argc, argv, "--ablate-frames", 300)),
+        mortonOrder.enabled()
+    );
+
+    if (gpuCull) {
+        submitMode = SubmitMode::Indirect;
+        submitModeName = "indirect (GPU culled)";
+    }
+    std::cout << "Submission strategy: " << submitModeName << std::endl;
+    const char* vertShaderName = "PullSpriteBatch.vert";
+    if (submitMode == SubmitMode::Instanced) vertShaderName = "InstancedSpriteBatch.vert";
+    if (submitMode == SubmitMode::Vertex) vertShaderName = "SpriteVertex.vert";
+
+    // Culled indirect draws, and those of a churning or fed population, rewrite their arguments
+    // every frame from a persistent transfer buffer
+    const bool dynamicDrawArgs = submitMode == SubmitMode::Indirect
+        && (gpuCull || cpuCull || occlusionCuller.enabled() || churn.enabled() || spriteFeed.enabled());
+
+    // Startup phases up to the first presented frame, with a cold pipeline cache if --cold-cache
+    // clears it first
+    StartupProfiler startup;
+    const bool coldCache = hasArg(argc, argv, "--cold-cache");
+    PipelineCache pipelineCache("pipeline_cache");
+    if (coldCache) pipelineCache.clear();
+
+    // SDL3 GPU has no public pipeline cache, the Vulkan, D3D12 and Metal drivers keep their own on
+    // disk. Mesa's and NVIDIA's are pointed into pipeline_cache/driver before the device exists,
+    // unless the environment already points them elsewhere, so --cold-cache empties them too. The
+    // start is only called warm or cold once the driver turns out to write there, other drivers'
+    // runs are told apart as the first or a repeated run of the shader and device combination.
+    const std::filesystem::path driverCacheDirectory = std::filesystem::absolute("pipeline_cache/driver");
+    auto driverCacheHasFiles = [&driverCacheDirectory] {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(driverCacheDirectory, error)) {
+            if (entry.is_regular_file()) return true;
+        }
+        return false;
+    };
+    {
+        std::error_code error;
+        std::filesystem::create_directories(driverCacheDirectory, error);
+        const std::string driverCachePath = driverCacheDirectory.string();
+        SDL_setenv_unsafe("MESA_SHADER_CACHE_DIR", driverCachePath.c_str(), 0);
+        SDL_setenv_unsafe("__GL_SHADER_DISK_CACHE_PATH", driverCachePath.c_str(), 0);
+    }
+    const bool driverCacheFilled = driverCacheHasFiles();
+    startup.mark("options");
+
     // Initial SDL setup
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         logError("Failed to initialize SDL");
@@ -135,10 +574,18 @@ int main() {
         return 1;
     }
 
-    // Create the GPU device
+    startup.mark("SDL init");
+
+    // Create the GPU device. D3D12 only takes DXIL, so it is only offered when the shaders of this
+    // run have DXIL blobs, otherwise SDL picks Vulkan
+    SDL_GPUShaderFormat shaderFormats = SDL_GPU_SHADERFORMAT_SPIRV | SDL_GPU_SHADERFORMAT_MSL;
+    if (isShaderCompiled(vertShaderName, "dxil") && isShaderCompiled("TexturedQuadColor.frag", "dxil")
+        && (!gpuCull || isShaderCompiled("CullSprites.comp", "dxil"))) {
+        shaderFormats |= SDL_GPU_SHADERFORMAT_DXIL;
+    }
     SDL_GPUDevice* gpuDevice = SDL_CreateGPUDevice(
-    SDL_GPU_SHADERFORMAT_SPIRV | SDL_GPU_SHADERFORMAT_DXIL | SDL_GPU_SHADERFORMAT_MSL,
-    false,
+        shaderFormats,
+        false,
         nullptr
     );
     if (!gpuDevice) {
@@ -157,12 +604,18 @@ int main() {
         return 1;
     }
 
-    // Set swapchain parameters
+    // Set swapchain parameters, falling back to vsync, which every driver supports
+    if (!SDL_WindowSupportsGPUPresentMode(gpuDevice, window, presentMode)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Present mode %s is not supported, using vsync", presentModeName);
+        presentMode = SDL_GPU_PRESENTMODE_VSYNC;
+        presentModeName = "vsync";
+    }
+    std::cout << "Present mode: " << presentModeName << ", acquire: " << acquireName << std::endl;
     if (!SDL_SetGPUSwapchainParameters(
         gpuDevice,
         window,
         SDL_GPU_SWAPCHAINCOMPOSITION_SDR,
-        SDL_GPU_PRESENTMODE_IMMEDIATE
+        presentMode
     )) {
         logError("Failed to set GPU swapchain parameters");
         SDL_DestroyGPUDevice(gpuDevice);
@@ -170,16 +623,32 @@ int main() {
         SDL_Quit();
         return 1;
     }
+    if (!SDL_SetGPUAllowedFramesInFlight(gpuDevice, FRAMES_IN_FLIGHT)) {
+        logError("Failed to set the GPU frames in flight");
+    }
+
+    startup.mark("device creation");
+
+    // Recording which shader and device combinations have been built before tells repeated runs
+    // from first ones, and keeps the pipeline creation time of each
+    const SDL_PropertiesID deviceProps = SDL_GetGPUDeviceProperties(gpuDevice);
+    pipelineCache.setDevice(
+        std::string(SDL_GetGPUDeviceDriver(gpuDevice))
+        + "/" + SDL_GetStringProperty(deviceProps, SDL_PROP_GPU_DEVICE_NAME_STRING, "")
+        + "/" + SDL_GetStringProperty(deviceProps, SDL_PROP_GPU_DEVICE_DRIVER_VERSION_STRING, "")
+    );
+    Uint64 pipelineId = PipelineCache::hash("sprites");
 
     // Load shaders
     SDL_GPUShader* vertShader = loadShader(
         gpuDevice,
-        "PullSpriteBatch.vert",
+        vertShaderName,
         SDL_GPU_SHADERSTAGE_VERTEX,
         0,
         0,
+        submitMode == SubmitMode::Vertex ? 0 : 1,
         1,
-        1
+        &pipelineId
     );
     SDL_GPUShader* fragShader = loadShader(
         gpuDevice,
@@ -188,7 +657,8 @@ int main() {
         1,
         0,
         0,
-        0
+        0,
+        &pipelineId
     );
     if (!vertShader || !fragShader) {
         logError("Failed to load shaders");
@@ -197,6 +667,9 @@ int main() {
         SDL_Quit();
         return 1;
     }
+    startup.mark("shader load");
+    float cachedPipelineMillis;
+    const bool repeatRun = pipelineCache.read(pipelineId, &cachedPipelineMillis, sizeof(cachedPipelineMillis));
 
     // Create graphics pipeline
 
@@ -218,14 +691,54 @@ int main() {
         .num_color_targets = 1
     };
 
+    // Only the CPU-expanded strategy feeds vertex attributes, the others pull from storage
+    SDL_GPUVertexBufferDescription vertexBufferDescriptions[] {{
+        .slot = 0,
+        .pitch = sizeof(SpriteVertex),
+        .input_rate = SDL_GPU_VERTEXINPUTRATE_VERTEX,
+        .instance_step_rate = 0
+    }};
+    SDL_GPUVertexAttribute vertexAttributes[] {
+        {
+            .location = 0,
+            .buffer_slot = 0,
+            .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2,
+            .offset = offsetof(SpriteVertex, x)
+        },
+        {
+            .location = 1,
+            .buffer_slot = 0,
+            .format = SDL_GPU_VERTEXELEMENTFORMAT_FLOAT2,
+            .offset = offsetof(SpriteVertex, u)
+        },
+        {
+            .location = 2,
+            .buffer_slot = 0,
+            .format = SDL_GPU_VERTEXELEMENTFORMAT_UBYTE4_NORM,
+            .offset = offsetof(SpriteVertex, color)
+        }
+    };
+    SDL_GPUVertexInputState vertexInputState{};
+    if (submitMode == SubmitMode::Vertex) {
+        vertexInputState = {
+            .vertex_buffer_descriptions = vertexBufferDescriptions,
+            .num_vertex_buffers = 1,
+            .vertex_attributes = vertexAttributes,
+            .num_vertex_attributes = 3
+        };
+    }
+
     SDL_GPUGraphicsPipelineCreateInfo pipelineCreateInfo{
         .vertex_shader = vertShader,
         .fragment_shader = fragShader,
+        .vertex_input_state = vertexInputState,
         .primitive_type = SDL_GPU_PRIMITIVETYPE_TRIANGLELIST,
         .target_info = targetInfo
     };
 
+    const auto pipelineStart = steady_clock::now();
     auto graphicsPipeline = SDL_CreateGPUGraphicsPipeline(gpuDevice, &pipelineCreateInfo);
+    const float pipelineMillis = getMillisElapsed(steady_clock::now(), pipelineStart);
 
     SDL_ReleaseGPUShader(gpuDevice, vertShader);
     SDL_ReleaseGPUShader(gpuDevice, fragShader);
@@ -235,12 +748,18 @@ int main() {
         SDL_DestroyGPUDevice(gpuDevice);
         SDL_DestroyWindow(window);
         SDL_Quit();
+        return 1;
     }
-
-    // Load bunny texture from disk into an SDL_Surface
-    SDL_Surface* bunnySurface = SDL_LoadPNG("../bunny.png");
-    if (!bunnySurface) {
-        logError("Failed to load image bunny.png");
+    startup.mark("pipeline creation");
+    pipelineCache.write(pipelineId, &pipelineMillis, sizeof(pipelineMillis));
+
+    // The bunny texture comes pre-cooked from the memory-mapped texture pack made by the
+    // cook_textures target, so there is nothing to decode
+    TexturePack texturePack;
+    const PackTexture* bunnyImage = texturePack.open("sprites.pack") ? texturePack.find("bunny") : nullptr;
+    if (!bunnyImage) {
+        SDL_SetError("No bunny in sprites.pack, build the cook_textures target");
+        logError("Failed to load texture");
         SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
         SDL_DestroyGPUDevice(gpuDevice);
         SDL_DestroyWindow(window);
@@ -248,13 +767,14 @@ int main() {
         return 1;
     }
 
-    auto bunnyWidth = static_cast<Uint32>(bunnySurface->w);
-    auto bunnyHeight = static_cast<Uint32>(bunnySurface->h);
+    auto bunnyWidth = bunnyImage->width;
+    auto bunnyHeight = bunnyImage->height;
+    occlusionCuller.setSprite(texturePack.data(*bunnyImage), bunnyWidth, bunnyHeight, 0, 0);
 
     // Upload the texture to the GPU
     SDL_GPUTransferBufferCreateInfo textureBufferCreateInfo{
         .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
-        .size = static_cast<Uint32>(bunnySurface->w * bunnySurface->h * 4)
+        .size = static_cast<Uint32>(bunnyImage->dataSize)
     };
     SDL_GPUTransferBuffer* textureTransferBuffer = SDL_CreateGPUTransferBuffer(gpuDevice, &textureBufferCreateInfo);
     if (!textureTransferBuffer) {
@@ -270,7 +790,7 @@ int main() {
         textureTransferBuffer,
         false
     ));
-    SDL_memcpy(textureTransferPtr, bunnySurface->pixels, bunnySurface->w * bunnySurface->h * 4);
+    SDL_memcpy(textureTransferPtr, texturePack.data(*bunnyImage), bunnyImage->dataSize);
     SDL_UnmapGPUTransferBuffer(gpuDevice, textureTransferBuffer);
 
     // Create the actual GPU texture
@@ -281,7 +801,7 @@ int main() {
         .width = bunnyWidth,
         .height = bunnyHeight,
         .layer_count_or_depth = 1,
-        .num_levels = 1
+        .num_levels = bunnyImage->mipCount
     };
     SDL_GPUTexture* bunnyTexture = SDL_CreateGPUTexture(gpuDevice, &textureCreateInfo);
     if (!bunnyTexture) {
@@ -292,6 +812,7 @@ int main() {
         SDL_Quit();
         return 1;
     }
+    startup.mark("texture upload");
 
     // Create a sampler, used to bind textures
     SDL_GPUSamplerCreateInfo sampler_info {
@@ -313,14 +834,36 @@ int main() {
         return 1;
     }
 
-    // Create sprite data transfer buffer
+    // Split the sprites into chunks, each with its own sprite data buffer, plus a visible sprite
+    // buffer when culling on the GPU and a draw argument buffer when drawing indirectly. In churn
+    // mode the chunks, the sprite data transfer buffer and the quad index buffer grow with the
+    // population.
+    const Uint32 spriteDataStride = submitMode == SubmitMode::Vertex
+        ? 4 * sizeof(SpriteVertex)
+        : sizeof(SpriteInstance);
+    std::vector<SpriteChunk> chunks;
+    BufferGrowth bufferGrowth;
+    // The static layer's sprites get chunks of their own, only uploaded and drawn when the layer is
+    // redrawn. They are never culled, so they are drawn directly even when the rest is indirect.
+    const SubmitMode staticSubmitMode = submitMode == SubmitMode::Indirect ? SubmitMode::Storage : submitMode;
+    std::vector<SpriteChunk> staticChunks;
+    const bool chunksCreated = growSpriteChunks(gpuDevice, chunks, bunnyCount, submitMode, gpuCull, bufferGrowth)
+        && growSpriteChunks(gpuDevice, staticChunks, staticLayer.size(), staticSubmitMode, false, bufferGrowth);
+    const Uint32 staticChunkCapacity = staticChunks.empty() ? 0 : staticChunks[0].capacity;
+
+    // Create sprite data transfer buffer, refilled and cycled for every chunk
+    Uint32 spriteDataTransferCapacity = chunksCreated ? std::max(chunks[0].capacity, staticChunkCapacity) : 0;
     SDL_GPUTransferBufferCreateInfo spriteDataTransferBufferCreateInfo {
         .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
-        .size = NUM_BUNNIES * sizeof(SpriteInstance)
+        .size = spriteDataTransferCapacity * spriteDataStride
     };
-    SDL_GPUTransferBuffer* spriteDataTransferBuffer = SDL_CreateGPUTransferBuffer(gpuDevice, &spriteDataTransferBufferCreateInfo);
+    SDL_GPUTransferBuffer* spriteDataTransferBuffer = chunksCreated
+        ? SDL_CreateGPUTransferBuffer(gpuDevice, &spriteDataTransferBufferCreateInfo)
+        : nullptr;
     if (!spriteDataTransferBuffer) {
-        logError("Failed to create sprite data transfer buffer");
+        logError("Failed to create sprite data buffers");
+        releaseSpriteChunks(gpuDevice, chunks);
+        releaseSpriteChunks(gpuDevice, staticChunks);
         SDL_ReleaseGPUSampler(gpuDevice, sampler);
         SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
         SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
@@ -330,22 +873,95 @@ int main() {
         return 1;
     }
 
-    // Create sprite data buffer
-    SDL_GPUBufferCreateInfo spriteDataBufferCreateInfo {
-        .usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ,
-        .size = NUM_BUNNIES * sizeof(SpriteInstance)
-    };
-    SDL_GPUBuffer* spriteDataBuffer = SDL_CreateGPUBuffer(gpuDevice, &spriteDataBufferCreateInfo);
-    if (!spriteDataBuffer) {
-        logError("Failed to create sprite data buffer");
-        SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
-        SDL_ReleaseGPUSampler(gpuDevice, sampler);
-        SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
-        SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
-        SDL_DestroyGPUDevice(gpuDevice);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
+    // Create the static data needed by the submission strategy: the 6 indices shared by every
+    // instanced quad, or one indirect draw command per chunk. The CPU-expanded quads get their
+    // index buffer along with the texture upload below.
+    Uint32 staticDataSize = 0;
+    switch (submitMode) {
+        case SubmitMode::Instanced:
+            staticDataSize = 6 * sizeof(Uint16);
+            break;
+        case SubmitMode::Indirect:
+            staticDataSize = MAX_SPRITE_CHUNKS * sizeof(SDL_GPUIndirectDrawCommand);
+            break;
+        case SubmitMode::Storage:
+        case SubmitMode::Vertex:
+            break;
+    }
+
+    SDL_GPUBuffer* staticDataBuffer = nullptr;
+    SDL_GPUTransferBuffer* staticDataTransferBuffer = nullptr;
+    if (staticDataSize > 0) {
+        if (submitMode == SubmitMode::Instanced) {
+            SDL_GPUBufferCreateInfo staticDataBufferCreateInfo {
+                .usage = SDL_GPU_BUFFERUSAGE_INDEX,
+                .size = staticDataSize
+            };
+            staticDataBuffer = SDL_CreateGPUBuffer(gpuDevice, &staticDataBufferCreateInfo);
+        }
+
+        SDL_GPUTransferBufferCreateInfo staticDataTransferBufferCreateInfo {
+            .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+            .size = staticDataSize
+        };
+        staticDataTransferBuffer = SDL_CreateGPUTransferBuffer(gpuDevice, &staticDataTransferBufferCreateInfo);
+
+        if ((submitMode == SubmitMode::Instanced && !staticDataBuffer) || !staticDataTransferBuffer) {
+            logError("Failed to create index/indirect buffer");
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+            SDL_ReleaseGPUBuffer(gpuDevice, staticDataBuffer);
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
+            releaseSpriteChunks(gpuDevice, chunks);
+            releaseSpriteChunks(gpuDevice, staticChunks);
+            SDL_ReleaseGPUSampler(gpuDevice, sampler);
+            SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
+            SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
+            SDL_DestroyGPUDevice(gpuDevice);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
+
+        void* staticDataPtr = SDL_MapGPUTransferBuffer(gpuDevice, staticDataTransferBuffer, false);
+        if (submitMode == SubmitMode::Instanced) {
+            constexpr Uint16 quadIndices[6] = {0, 1, 2, 3, 2, 1};
+            SDL_memcpy(staticDataPtr, quadIndices, sizeof(quadIndices));
+        } else {
+            // With culling or churn this transfer buffer is kept around to update the vertex counts
+            // every frame
+            auto drawArgs = static_cast<SDL_GPUIndirectDrawCommand*>(staticDataPtr);
+            for (size_t i = 0; i < chunks.size(); i++) {
+                drawArgs[i] = {
+                    .num_vertices = gpuCull ? 0 : std::min(bunnyCount - chunks[i].first, chunks[i].capacity) * 6,
+                    .num_instances = 1,
+                    .first_vertex = 0,
+                    .first_instance = 0
+                };
+            }
+        }
+        SDL_UnmapGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+    }
+
+    // Create the culling compute pipeline
+    SDL_GPUComputePipeline* cullPipeline = nullptr;
+    if (gpuCull) {
+        cullPipeline = loadComputePipeline(gpuDevice, "CullSprites.comp", 1, 2, 1, 64);
+
+        if (!cullPipeline) {
+            logError("Failed to create GPU culling resources");
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+            SDL_ReleaseGPUBuffer(gpuDevice, staticDataBuffer);
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
+            releaseSpriteChunks(gpuDevice, chunks);
+            releaseSpriteChunks(gpuDevice, staticChunks);
+            SDL_ReleaseGPUSampler(gpuDevice, sampler);
+            SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
+            SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
+            SDL_DestroyGPUDevice(gpuDevice);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
     }
 
     // Upload data to the GPU texture
@@ -353,57 +969,129 @@ int main() {
     SDL_GPUCommandBuffer* uploadCommandBuffer = SDL_AcquireGPUCommandBuffer(gpuDevice);
     SDL_GPUCopyPass* copyPass = SDL_BeginGPUCopyPass(uploadCommandBuffer);
 
-    SDL_GPUTextureTransferInfo textureTransferInfo {
-        .transfer_buffer = textureTransferBuffer,
-        .offset = 0, /* Zeroes out the rest */
-    };
-    SDL_GPUTextureRegion textureRegion {
-        .texture = bunnyTexture,
-        .w = bunnyWidth,
-        .h = bunnyHeight,
-        .d = 1
-    };
-    SDL_UploadToGPUTexture(
-        copyPass,
-        &textureTransferInfo,
-        &textureRegion,
-        false
-    );
+    // One upload per mip level, each tightly packed after the previous one
+    for (Uint32 level = 0; level < bunnyImage->mipCount; level++) {
+        SDL_GPUTextureTransferInfo textureTransferInfo {
+            .transfer_buffer = textureTransferBuffer,
+            .offset = static_cast<Uint32>(packMipOffset(*bunnyImage, level)), /* Zeroes out the rest */
+        };
+        SDL_GPUTextureRegion textureRegion {
+            .texture = bunnyTexture,
+            .mip_level = level,
+            .w = packMipDimension(bunnyWidth, level),
+            .h = packMipDimension(bunnyHeight, level),
+            .d = 1
+        };
+        SDL_UploadToGPUTexture(
+            copyPass,
+            &textureTransferInfo,
+            &textureRegion,
+            false
+        );
+    }
+
+    if (staticDataBuffer) {
+        SDL_GPUTransferBufferLocation staticDataLocation{
+            .transfer_buffer = staticDataTransferBuffer,
+            .offset = 0
+        };
+        SDL_GPUBufferRegion staticDataRegion{
+            .buffer = staticDataBuffer,
+            .offset = 0,
+            .size = staticDataSize
+        };
+        SDL_UploadToGPUBuffer(copyPass, &staticDataLocation, &staticDataRegion, false);
+    }
+    if (submitMode == SubmitMode::Indirect) {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            SDL_GPUTransferBufferLocation drawArgsLocation{
+                .transfer_buffer = staticDataTransferBuffer,
+                .offset = static_cast<Uint32>(i * sizeof(SDL_GPUIndirectDrawCommand))
+            };
+            SDL_GPUBufferRegion drawArgsRegion{
+                .buffer = chunks[i].drawArgsBuffer,
+                .offset = 0,
+                .size = sizeof(SDL_GPUIndirectDrawCommand)
+            };
+            SDL_UploadToGPUBuffer(copyPass, &drawArgsLocation, &drawArgsRegion, false);
+        }
+    }
+
+    // The CPU-expanded quads of a chunk share one index buffer, 6 indices per sprite
+    Uint32 quadIndexCapacity = 0;
+    SDL_GPUBuffer* quadIndexBuffer = nullptr;
+    if (submitMode == SubmitMode::Vertex) {
+        quadIndexCapacity = std::max(chunks[0].capacity, staticChunkCapacity);
+        quadIndexBuffer = createQuadIndexBuffer(gpuDevice, copyPass, quadIndexCapacity);
+    }
 
     SDL_EndGPUCopyPass(copyPass);
     SDL_SubmitGPUCommandBuffer(uploadCommandBuffer);
 
-    SDL_DestroySurface(bunnySurface);
     SDL_ReleaseGPUTransferBuffer(gpuDevice, textureTransferBuffer);
+    if (!dynamicDrawArgs) {
+        SDL_ReleaseGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+        staticDataTransferBuffer = nullptr;
+    }
+    if (submitMode == SubmitMode::Vertex && !quadIndexBuffer) {
+        logError("Failed to create index buffer");
+        SDL_ReleaseGPUComputePipeline(gpuDevice, cullPipeline);
+        SDL_ReleaseGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+        SDL_ReleaseGPUBuffer(gpuDevice, staticDataBuffer);
+        SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
+        releaseSpriteChunks(gpuDevice, chunks);
+        releaseSpriteChunks(gpuDevice, staticChunks);
+        SDL_ReleaseGPUSampler(gpuDevice, sampler);
+        SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
+        SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
+        SDL_DestroyGPUDevice(gpuDevice);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
 
 
     //
     // Set up the bunnies
     //
 
-    struct Bunny {
-        float x, y;
-        float vx, vy;
-    };
-
-    std::vector<Bunny> bunnies;
+    Bunnies bunnies;
+    bunnies.reserve(bunnyCount);
     std::mt19937 rng; // NOLINT deterministic but that's fine here
     std::uniform_real_distribution dis{-1.0f, 1.0f};
 
-    for (int i = 0; i < NUM_BUNNIES; i++) {
-        bunnies.push_back({
-            .x = static_cast<float>(WINDOW_WIDTH) / 2,
-            .y = static_cast<float>(WINDOW_HEIGHT) / 2,
+    // In large-world and collision mode the bunnies start spread over the whole world instead of
+    // stacked at the center, where every bunny would overlap every other one. --uniform-spawn
+    // spreads them in any mode.
+    const bool spreadSpawn = largeWorld || collide || hasArg(argc, argv, "--uniform-spawn");
+    std::uniform_real_distribution spawnX{0.0f, world.width - 32};
+    std::uniform_real_distribution spawnY{0.0f, world.height - 32};
+
+    auto spawnBunny = [&] {
+        return Bunny{
+            .x = spreadSpawn ? spawnX(rng) : static_cast<float>(WINDOW_WIDTH) / 2,
+            .y = spreadSpawn ? spawnY(rng) : static_cast<float>(WINDOW_HEIGHT) / 2,
             .vx = dis(rng),
             .vy = dis(rng)
-        });
+        };
+    };
+    for (Uint32 i = 0; i < bunnyCount; i++) {
+        bunnies.push_back(spawnBunny());
     }
+    workloadLog.start(bunnies, world, fixedTimestep.tickMillis());
 
     SDL_GPUTextureSamplerBinding samplerBinding{
         .texture = bunnyTexture,
         .sampler = sampler
     };
 
+    Camera camera{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+    SpatialGrid grid(world.width, world.height, getFloatArg(argc, argv, "--grid-cell", 128.0f));
+
+    // Per-frame CPU staging (culled index lists, sort keys, ...), --frame-arena N MiB to start with
+    FrameArena frameArena(static_cast<size_t>(std::max(getIntArg(argc, argv, "--frame-arena", DEFAULT_FRAME_ARENA_MIB), 1L)) << 20);
+
+    Uint32 drawCount = bunnyCount;
     Matrix4x4 cameraMatrix = Matrix4x4_CreateOrthographicOffCenter(
         0,
         WINDOW_WIDTH,
@@ -414,19 +1102,297 @@ int main() {
     );
 
 
+    // The present ablation renders into this offscreen target instead of a swapchain texture, and
+    // waits for the previous frame to complete so the CPU does not run ahead of the GPU
+    SDL_GPUTexture* ablationTarget = nullptr;
+    constexpr SDL_GPUViewport tinyViewport{0, 0, 1, 1, 0, 1};
+    if (ablation.enabled()) {
+        SDL_GPUTextureCreateInfo ablationTargetCreateInfo{
+            .type = SDL_GPU_TEXTURETYPE_2D,
+            .format = SDL_GetGPUSwapchainTextureFormat(gpuDevice, window),
+            .usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+            .width = WINDOW_WIDTH,
+            .height = WINDOW_HEIGHT,
+            .layer_count_or_depth = 1,
+            .num_levels = 1
+        };
+        ablationTarget = SDL_CreateGPUTexture(gpuDevice, &ablationTargetCreateInfo);
+        if (!ablationTarget) {
+            logError("Failed to create offscreen target, the present ablation will still present");
+        }
+    }
+
+    // The captured frame is rendered into this texture instead of a swapchain texture and downloaded
+    // from it. The pipelines target the swapchain format, so it has to be one with 8-bit channels.
+    const SDL_GPUTextureFormat swapchainFormat = SDL_GetGPUSwapchainTextureFormat(gpuDevice, window);
+    const bool bgraSwapchain = swapchainFormat == SDL_GPU_TEXTUREFORMAT_B8G8R8A8_UNORM
+        || swapchainFormat == SDL_GPU_TEXTUREFORMAT_B8G8R8A8_UNORM_SRGB;
+    const bool rgbaSwapchain = swapchainFormat == SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM
+        || swapchainFormat == SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM_SRGB;
+    SDL_GPUTexture* captureTarget = nullptr;
+    SDL_GPUTransferBuffer* captureTransferBuffer = nullptr;
+    if (frameCapture.enabled() && !bgraSwapchain && !rgbaSwapchain) {
+        std::cout << "Frame capture needs an RGBA8 or BGRA8 swapchain, not capturing" << std::endl;
+    } else if (frameCapture.enabled()) {
+        SDL_GPUTextureCreateInfo captureTargetCreateInfo{
+            .type = SDL_GPU_TEXTURETYPE_2D,
+            .format = swapchainFormat,
+            .usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+            .width = WINDOW_WIDTH,
+            .height = WINDOW_HEIGHT,
+            .layer_count_or_depth = 1,
+            .num_levels = 1
+        };
+        captureTarget = SDL_CreateGPUTexture(gpuDevice, &captureTargetCreateInfo);
+        SDL_GPUTransferBufferCreateInfo captureTransferBufferCreateInfo{
+            .usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD,
+            .size = WINDOW_WIDTH * WINDOW_HEIGHT * 4
+        };
+        captureTransferBuffer = SDL_CreateGPUTransferBuffer(gpuDevice, &captureTransferBufferCreateInfo);
+        if (!captureTarget || !captureTransferBuffer) {
+            logError("Failed to create capture target, the frame will not be captured");
+            SDL_ReleaseGPUTexture(gpuDevice, captureTarget);
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, captureTransferBuffer);
+            captureTarget = nullptr;
+            captureTransferBuffer = nullptr;
+        }
+    }
+
+    // The static layer, only rendered into when it changes and blitted into the swapchain texture
+    // every frame in place of the clear
+    SDL_GPUTexture* staticLayerTexture = nullptr;
+    Matrix4x4 staticLayerMatrix{};
+    if (staticLayer.enabled()) {
+        SDL_GPUTextureCreateInfo staticLayerCreateInfo{
+            .type = SDL_GPU_TEXTURETYPE_2D,
+            .format = SDL_GetGPUSwapchainTextureFormat(gpuDevice, window),
+            .usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET | SDL_GPU_TEXTUREUSAGE_SAMPLER,
+            .width = staticLayer.width(),
+            .height = staticLayer.height(),
+            .layer_count_or_depth = 1,
+            .num_levels = 1
+        };
+        staticLayerTexture = SDL_CreateGPUTexture(gpuDevice, &staticLayerCreateInfo);
+        if (!staticLayerTexture) {
+            logError("Failed to create static layer");
+            SDL_ReleaseGPUTexture(gpuDevice, ablationTarget);
+            SDL_ReleaseGPUTexture(gpuDevice, captureTarget);
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, captureTransferBuffer);
+            SDL_ReleaseGPUComputePipeline(gpuDevice, cullPipeline);
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+            SDL_ReleaseGPUBuffer(gpuDevice, staticDataBuffer);
+            SDL_ReleaseGPUBuffer(gpuDevice, quadIndexBuffer);
+            SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
+            releaseSpriteChunks(gpuDevice, chunks);
+            releaseSpriteChunks(gpuDevice, staticChunks);
+            SDL_ReleaseGPUSampler(gpuDevice, sampler);
+            SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
+            SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
+            SDL_DestroyGPUDevice(gpuDevice);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
+    }
+
+    // Fills the sprites of a chunk from the positions `sourceX`, `sourceY` and those before the last
+    // step, in `order` if there is one, and records their upload. Expanded quads are interpolated
+    // right here.
+    auto uploadChunk = [&](
+        SDL_GPUCopyPass* copyPass,
+        const SpriteChunk& chunk,
+        const float* sourceX,
+        const float* sourceY,
+        const float* previousX,
+        const float* previousY,
+        const Uint32* order,
+        const float spriteWidth,
+        const float spriteHeight
+    ) {
+        void* transferPtr = SDL_MapGPUTransferBuffer(
+            gpuDevice,
+            spriteDataTransferBuffer,
+            true
+        );
+        if (submitMode == SubmitMode::Vertex) {
+            auto vertexPtr = static_cast<SpriteVertex*>(transferPtr);
+            const float bw = spriteWidth;
+            const float bh = spriteHeight;
+            const float alpha = fixedTimestep.alpha();
+            for (Uint32 i = 0; i < chunk.drawCount; i++) {
+                const Uint32 index = order ? order[chunk.first + i] : chunk.first + i;
+                const float x = previousX[index] + (sourceX[index] - previousX[index]) * alpha;
+                const float y = previousY[index] + (sourceY[index] - previousY[index]) * alpha;
+                vertexPtr[i * 4 + 0] = {x,      y,      0, 0, 0xffffffff};
+                vertexPtr[i * 4 + 1] = {x + bw, y,      1, 0, 0xffffffff};
+                vertexPtr[i * 4 + 2] = {x,      y + bh, 0, 1, 0xffffffff};
+                vertexPtr[i * 4 + 3] = {x + bw, y + bh, 1, 1, 0xffffffff};
+            }
+        } else {
+            auto dataPtr = static_cast<SpriteInstance*>(transferPtr);
+            for (Uint32 i = 0; i < chunk.drawCount; i++) {
+                const Uint32 index = order ? order[chunk.first + i] : chunk.first + i;
+                dataPtr[i].x = sourceX[index];
+                dataPtr[i].y = sourceY[index];
+                dataPtr[i].z = 0;
+                dataPtr[i].rotation = 0;
+                dataPtr[i].w = spriteWidth;
+                dataPtr[i].h = spriteHeight;
+                dataPtr[i].prev_x = previousX[index];
+                dataPtr[i].prev_y = previousY[index];
+                dataPtr[i].tex_u = 0;
+                dataPtr[i].tex_v = 0;
+                dataPtr[i].tex_w = 1.0f;
+                dataPtr[i].tex_h = 1.0f;
+                dataPtr[i].r = 1.0f;
+                dataPtr[i].g = 1.0f;
+                dataPtr[i].b = 1.0f;
+                dataPtr[i].a = 1.0f;
+            }
+        }
+        SDL_UnmapGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
+
+        SDL_GPUTransferBufferLocation bufferLocation{
+            .transfer_buffer = spriteDataTransferBuffer,
+            .offset = 0
+        };
+        SDL_GPUBufferRegion bufferRegion{
+            .buffer = chunk.spriteDataBuffer,
+            .offset = 0,
+            .size = chunk.drawCount * spriteDataStride
+        };
+        SDL_UploadToGPUBuffer(
+            copyPass,
+            &bufferLocation,
+            &bufferRegion,
+            true
+        );
+    };
+
+    // Starts a render pass into `target` with the sprite pipeline, its index buffer and the bunny
+    // texture bound, projecting through `matrix`
+    auto beginSpritePass = [&](
+        SDL_GPUCommandBuffer* commandBuffer,
+        SDL_GPUTexture* target,
+        const SDL_GPULoadOp loadOp,
+        const bool cycle,
+        const Matrix4x4& matrix
+    ) {
+        SDL_GPUColorTargetInfo colorTargetInfo{
+            .texture = target,
+            .clear_color = { 0.5, 0.5, 1, 1 },
+            .load_op = loadOp,
+            .store_op = SDL_GPU_STOREOP_STORE,
+            .cycle = cycle
+        };
+        SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(
+            commandBuffer,
+            &colorTargetInfo,
+            1,
+            nullptr
+        );
+
+        SDL_BindGPUGraphicsPipeline(renderPass, graphicsPipeline);
+        if (submitMode == SubmitMode::Instanced || submitMode == SubmitMode::Vertex) {
+            SDL_GPUBufferBinding indexBinding{
+                .buffer = submitMode == SubmitMode::Instanced ? staticDataBuffer : quadIndexBuffer,
+                .offset = 0
+            };
+            SDL_BindGPUIndexBuffer(
+                renderPass,
+                &indexBinding,
+                submitMode == SubmitMode::Instanced
+                    ? SDL_GPU_INDEXELEMENTSIZE_16BIT
+                    : SDL_GPU_INDEXELEMENTSIZE_32BIT
+            );
+        }
+        SDL_BindGPUFragmentSamplers(
+            renderPass,
+            0,
+            &samplerBinding,
+            1
+        );
+        const SpriteUniforms uniforms{matrix, {fixedTimestep.alpha(), 0.0f, 0.0f, 0.0f}};
+        SDL_PushGPUVertexUniformData(
+            commandBuffer,
+            0,
+            &uniforms,
+            sizeof(SpriteUniforms)
+        );
+        return renderPass;
+    };
+
+    // Binds the sprites of a chunk, the visible ones if it was culled on the GPU, and draws them
+    auto drawChunk = [&](SDL_GPURenderPass* renderPass, const SpriteChunk& chunk, const SubmitMode mode) {
+        if (mode == SubmitMode::Vertex) {
+            SDL_GPUBufferBinding vertexBinding{
+                .buffer = chunk.spriteDataBuffer,
+                .offset = 0
+            };
+            SDL_BindGPUVertexBuffers(renderPass, 0, &vertexBinding, 1);
+        } else {
+            SDL_BindGPUVertexStorageBuffers(
+                renderPass,
+                0,
+                chunk.visibleSpriteBuffer ? &chunk.visibleSpriteBuffer : &chunk.spriteDataBuffer,
+                1
+            );
+        }
+        switch (mode) {
+            case SubmitMode::Storage:
+                SDL_DrawGPUPrimitives(
+                    renderPass,
+                    chunk.drawCount * 6,
+                    1,
+                    0,
+                    0
+                );
+                break;
+            case SubmitMode::Instanced:
+                SDL_DrawGPUIndexedPrimitives(renderPass, 6, chunk.drawCount, 0, 0, 0);
+                break;
+            case SubmitMode::Vertex:
+                SDL_DrawGPUIndexedPrimitives(renderPass, chunk.drawCount * 6, 1, 0, 0, 0);
+                break;
+            case SubmitMode::Indirect:
+                SDL_DrawGPUPrimitivesIndirect(renderPass, chunk.drawArgsBuffer, 0, 1);
+                break;
+        }
+    };
+
+    startup.mark("buffers and uploads");
+
     //
     // Start the game loop
     //
 
+    const auto startTime = steady_clock::now();
     auto lastTick = steady_clock::now();
+    energyMeter.restart();
     auto lastFpsMeasurement = steady_clock::now();
     float dt = 0;
+    float sortMillis = 0;
     uint32_t framesInLastSecond = 0;
 
+    // Per-frame pacing measurements: frame time and its jitter, time spent waiting for a swapchain
+    // image, latency from sampling input to queueing the present, and frames skipped for lack of an image
+    TimingStat frameTimes;
+    TimingStat acquireWaits;
+    TimingStat presentLatencies;
+    uint32_t skippedFrames = 0;
+
+    // GPU busy and idle time, submit-to-completion time and queue depth, from per-frame fences
+    // queried at every phase boundary
+    GpuFrameTimer gpuFrames(gpuDevice);
+
     bool running = true;
     SDL_Event event;
 
     while (running) {
+        pacer.wait();
+        allocationTracker.beginFrame();
+        frameArena.beginFrame();
+
         // Listen for quit event
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_EVENT_QUIT) {
@@ -438,137 +1404,486 @@ int main() {
         auto now = steady_clock::now();
         dt = getMillisElapsed(now, lastTick);
         lastTick = now;
+        frameTimes.add(dt);
+        gpuFrames.poll();
+
+        // The simulation and the camera run on the frame's times, or on the recorded ones in a replay,
+        // which stops once they run out
+        float simulationMillis = dt;
+        float sceneMillis = getMillisElapsed(now, startTime);
+        if (!workloadLog.beginFrame(simulationMillis, sceneMillis)) {
+            running = false;
+        }
+
+        // Move on to the next ablation run once this one has its frames, and stop after the last
+        if (ablation.beginFrame(dt, bunnies, rng)) {
+            if (ablation.done()) {
+                ablation.report(std::cout);
+                running = false;
+            }
+            drawCount = static_cast<Uint32>(bunnies.size());
+            staticLayer.invalidate();
+            fixedTimestep.reset(bunnies);
+        }
 
         // Report FPS every second
+        allocationTracker.setPhase(AllocPhase::Report);
         framesInLastSecond++;
         if (getMillisElapsed(now, lastFpsMeasurement) > 1000) {
-            std::cout << "FPS: " << framesInLastSecond << std::endl;
+            std::cout << "FPS: " << framesInLastSecond;
+            if (churn.enabled()) {
+                std::cout << ", bunnies: " << bunnies.size() << " (+" << churn.takeSpawned()
+                    << "/-" << churn.takeDespawned() << "), reallocating frames: "
+                    << bufferGrowth.reallocatingFrameCount();
+            }
+            if (cpuCull) {
+                std::cout << ", drawn: " << drawCount << ", culled: " << bunnies.size() - drawCount;
+            }
+            staticLayer.report(std::cout);
+            if (collide) {
+                std::cout << ", colliding: " << collisions.lastCollidingCount();
+            }
+            if (sortSprites) {
+                std::cout << ", sort: " << sortMillis / framesInLastSecond << " ms/frame";
+                sortMillis = 0;
+            }
+            fixedTimestep.report(std::cout);
+            workloadLog.report(std::cout);
+            spriteFeed.report(std::cout, getMillisElapsed(now, lastFpsMeasurement));
+            mortonOrder.report(std::cout);
+            occlusionCuller.report(std::cout);
+            if (const size_t arenaPeak = frameArena.takePeakBytes(); arenaPeak > 0) {
+                std::cout << ", frame arena: " << arenaPeak / 1024 << " of " << frameArena.capacity() / 1024 << " KiB";
+            }
+            std::cout << ", frame time: ";
+            frameTimes.report(std::cout, true);
+            std::cout << ", acquire wait: ";
+            acquireWaits.report(std::cout);
+            std::cout << ", input to present: ";
+            presentLatencies.report(std::cout);
+            gpuFrames.report(std::cout);
+            if (pollSwapchain) {
+                std::cout << ", skipped: " << skippedFrames;
+                skippedFrames = 0;
+            }
+            energyMeter.report(std::cout, framesInLastSecond, bunnies.size(), getMillisElapsed(now, lastFpsMeasurement));
+            std::cout << std::endl;
+            if (trackAllocations) {
+                allocationTracker.report(std::cout);
+            }
+            perfCounters.report(std::cout);
             framesInLastSecond = 0;
             lastFpsMeasurement = now;
         }
 
-        // Update the bunnies
-        for (auto&[x, y, vx, vy] : bunnies) {
-            x += vx * dt;
-            y += vy * dt;
+        // Spawn and despawn bunnies, then update them, optionally colliding them with each other. With
+        // --tick-rate this runs in fixed steps, as many as are due, instead of once by the frame time
+        allocationTracker.setPhase(AllocPhase::Simulate);
+        perfCounters.begin(PerfPhase::Simulate);
+        if (!ablation.active(Ablation::Simulation) && !spriteFeed.enabled()) {
+            const Uint32 ticks = fixedTimestep.enabled() ? fixedTimestep.advance(simulationMillis) : 1;
+            const float stepMillis = fixedTimestep.enabled() ? fixedTimestep.tickMillis() : simulationMillis;
+            for (Uint32 tick = 0; tick < ticks; tick++) {
+                if (churn.enabled()) {
+                    churn.update(bunnies, rng, spawnBunny);
+                    drawCount = static_cast<Uint32>(bunnies.size());
+                }
+                if (!ablation.active(Ablation::Unordered)) {
+                    mortonOrder.update(bunnies, frameArena);
+                }
+                fixedTimestep.snapshot(bunnies);
+                bunnies.update(stepMillis, world);
+                if (collide) {
+                    collisions.resolve(bunnies);
+                }
+            }
+        }
 
-            if (x < 0 || x > WINDOW_WIDTH - 32) vx *= -1;
-            if (y < 0 || y > WINDOW_HEIGHT - 32) vy *= -1;
+        perfCounters.end(PerfPhase::Simulate, bunnies.size());
+        workloadLog.endSimulation(bunnies);
+        gpuFrames.poll();
+
+        // Pan the camera across the world
+        if (largeWorld) {
+            camera.update(world, sceneMillis);
+            cameraMatrix = Matrix4x4_CreateOrthographicOffCenter(
+                camera.x,
+                camera.x + camera.width,
+                camera.y + camera.height,
+                camera.y,
+                0,
+                -1
+            );
         }
 
+        // With --tick-rate the sprites are only culled, sorted and uploaded on frames that stepped the
+        // simulation, the frames in between draw them again with a new interpolation factor. Quads
+        // expanded on the CPU are interpolated there, so they are uploaded every frame regardless.
+        const bool uploadSprites = fixedTimestep.snapshotChanged() || submitMode == SubmitMode::Vertex;
+
+        // Only bunnies in grid cells touching the camera get uploaded and drawn
+        allocationTracker.setPhase(AllocPhase::Cull);
+        Uint32* visibleBunnies = nullptr;
+        if (cpuCull && uploadSprites) {
+            grid.build(bunnies.x.data(), bunnies.y.data(), bunnies.size());
+            visibleBunnies = frameArena.allocate<Uint32>(bunnies.size());
+            drawCount = grid.query(
+                camera.x - 32,
+                camera.y - 32,
+                camera.x + camera.width,
+                camera.y + camera.height,
+                visibleBunnies
+            );
+        }
+
+        // Sort the drawn bunnies back to front by y, which the fill then follows. They all
+        // share one texture, so the texture half of the key is constant and costs no passes.
+        const Uint32* drawOrder = visibleBunnies;
+        if (sortSprites && uploadSprites) {
+            const auto sortStart = steady_clock::now();
+            drawOrder = sorter.sort(frameArena, drawOrder, drawCount, [&](const Uint32 index) {
+                return spriteSortKey(bunnies.y[index], 0);
+            });
+            sortMillis += getMillisElapsed(steady_clock::now(), sortStart);
+        }
+
+        // Drop the bunnies completely hidden under the ones drawn after them, for this frame only
+        Uint32 fillCount = drawCount;
+        if (occlusionCuller.enabled() && !fixedTimestep.enabled() && !spriteFeed.enabled()) {
+            drawOrder = occlusionCuller.cull(frameArena, bunnies, camera, drawOrder, fillCount);
+        }
+        gpuFrames.poll();
+        allocationTracker.setPhase(AllocPhase::Render);
+
         //
         // Render the bunnies to the screen
         //
 
         SDL_GPUCommandBuffer* commandBuffer = SDL_AcquireGPUCommandBuffer(gpuDevice);
 
-        SDL_GPUTexture* swapchainTexture;
-        SDL_WaitAndAcquireGPUSwapchainTexture(
-            commandBuffer,
-            window,
-            &swapchainTexture,
-            nullptr,
-            nullptr
-        );
+        // Without a free swapchain image (polling, or a minimized window) the frame is not rendered.
+        // The captured frame needs none, it goes to its offscreen target.
+        const bool captureFrame = captureTarget && frameCapture.beginFrame();
+        const bool presentAblated = ablation.active(Ablation::Present) && ablationTarget;
+        SDL_GPUTexture* swapchainTexture = captureFrame ? captureTarget : ablationTarget;
+        const auto acquireStart = steady_clock::now();
+        if (!presentAblated && !captureFrame) {
+            if (pollSwapchain) {
+                SDL_AcquireGPUSwapchainTexture(commandBuffer, window, &swapchainTexture, nullptr, nullptr);
+            } else {
+                SDL_WaitAndAcquireGPUSwapchainTexture(commandBuffer, window, &swapchainTexture, nullptr, nullptr);
+            }
+        }
+        acquireWaits.add(getMillisElapsed(steady_clock::now(), acquireStart));
+        gpuFrames.poll();
+        if (!swapchainTexture) {
+            SDL_CancelGPUCommandBuffer(commandBuffer);
+            skippedFrames++;
+            continue;
+        }
 
-        // Transfer sprite data to the GPU
+        // Transfer sprite data to the GPU, one chunk at a time. With CPU or occlusion culling only
+        // the first fillCount sprites are filled, so the chunks past them draw nothing. The upload
+        // ablation, and frames between --tick-rate steps, draw whatever the buffers still hold from the
+        // last upload, and the fill ablation collapses every sprite to zero area.
 
-        auto dataPtr = static_cast<SpriteInstance*>(SDL_MapGPUTransferBuffer(
-            gpuDevice,
-            spriteDataTransferBuffer,
-            true
-        ));
-        for (Uint32 i = 0; i < NUM_BUNNIES; i++) {
-            Bunny bunny = bunnies[i];
-            dataPtr[i].x = bunny.x;
-            dataPtr[i].y = bunny.y;
-            dataPtr[i].z = 0;
-            dataPtr[i].rotation = 0;
-            dataPtr[i].w = bunnyWidth;
-            dataPtr[i].h = bunnyHeight;
-            dataPtr[i].tex_u = 0;
-            dataPtr[i].tex_v = 0;
-            dataPtr[i].tex_w = 1.0f;
-            dataPtr[i].tex_h = 1.0f;
-            dataPtr[i].r = 1.0f;
-            dataPtr[i].g = 1.0f;
-            dataPtr[i].b = 1.0f;
-            dataPtr[i].a = 1.0f;
+        perfCounters.begin(PerfPhase::Fill);
+        SDL_GPUCopyPass* spriteDataCopyPass = SDL_BeginGPUCopyPass(commandBuffer);
+
+        // With --feed the sprites are the feeder's latest frame, filled straight out of shared memory
+        // as late as possible. Until the feeder publishes a new one, the buffers still hold the last.
+        FeedFrame feedFrame;
+        bool fillSprites = uploadSprites;
+        if (spriteFeed.enabled()) {
+            fillSprites = spriteFeed.acquire(feedFrame);
+            drawCount = feedFrame.count;
+            fillCount = feedFrame.count;
         }
-        SDL_UnmapGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
 
-        SDL_GPUCopyPass* spriteDataCopyPass = SDL_BeginGPUCopyPass(commandBuffer);
-        SDL_GPUTransferBufferLocation bufferLocation{
-            .transfer_buffer = spriteDataTransferBuffer,
-            .offset = 0
-        };
-        SDL_GPUBufferRegion bufferRegion{
-            .buffer = spriteDataBuffer,
-            .offset = 0,
-            .size = NUM_BUNNIES * sizeof(SpriteInstance)
-        };
-        SDL_UploadToGPUBuffer(
-            spriteDataCopyPass,
-            &bufferLocation,
-            &bufferRegion,
-            true
-        );
+        // A churning or fed population may outgrow the buffers, which then get reallocated with headroom
+        bufferGrowth.beginFrame();
+        if (churn.enabled() || spriteFeed.enabled()) {
+            if (!growSpriteChunks(gpuDevice, chunks, fillCount, submitMode, gpuCull, bufferGrowth)) {
+                logError("Failed to grow sprite data buffers");
+                running = false;
+            }
+            if (chunks[0].capacity > spriteDataTransferCapacity) {
+                SDL_GPUTransferBufferCreateInfo grownTransferBufferCreateInfo {
+                    .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
+                    .size = chunks[0].capacity * spriteDataStride
+                };
+                SDL_GPUTransferBuffer* grownTransferBuffer = SDL_CreateGPUTransferBuffer(gpuDevice, &grownTransferBufferCreateInfo);
+                if (grownTransferBuffer) {
+                    SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
+                    spriteDataTransferBuffer = grownTransferBuffer;
+                    bufferGrowth.recordReallocation(
+                        "sprite transfer buffer",
+                        Uint64{spriteDataTransferCapacity} * spriteDataStride,
+                        Uint64{chunks[0].capacity} * spriteDataStride
+                    );
+                    spriteDataTransferCapacity = chunks[0].capacity;
+                } else {
+                    logError("Failed to grow sprite data transfer buffer");
+                    running = false;
+                }
+            }
+            if (submitMode == SubmitMode::Vertex && chunks[0].capacity > quadIndexCapacity) {
+                SDL_GPUBuffer* grownIndexBuffer = createQuadIndexBuffer(gpuDevice, spriteDataCopyPass, chunks[0].capacity);
+                if (grownIndexBuffer) {
+                    SDL_ReleaseGPUBuffer(gpuDevice, quadIndexBuffer);
+                    quadIndexBuffer = grownIndexBuffer;
+                    bufferGrowth.recordReallocation(
+                        "quad index buffer",
+                        Uint64{quadIndexCapacity} * 6 * sizeof(Uint32),
+                        Uint64{chunks[0].capacity} * 6 * sizeof(Uint32)
+                    );
+                    quadIndexCapacity = chunks[0].capacity;
+                } else {
+                    logError("Failed to grow index buffer");
+                    running = false;
+                }
+            }
+        }
+
+        // Sprites past what the buffers could hold are dropped for the frame that failed to grow them
+        Uint32 chunkLimit = spriteDataTransferCapacity;
+        if (submitMode == SubmitMode::Vertex) {
+            chunkLimit = std::min(chunkLimit, quadIndexCapacity);
+        }
+        const float spriteWidth = ablation.active(Ablation::Fill) ? 0.0f : static_cast<float>(bunnyWidth);
+        const float spriteHeight = ablation.active(Ablation::Fill) ? 0.0f : static_cast<float>(bunnyHeight);
+        for (SpriteChunk& chunk : chunks) {
+            chunk.drawCount = fillCount > chunk.first ? std::min({fillCount - chunk.first, chunk.capacity, chunkLimit}) : 0;
+            if (chunk.drawCount == 0 || !fillSprites || ablation.active(Ablation::Upload)) {
+                continue;
+            }
+            if (spriteFeed.enabled()) {
+                uploadChunk(spriteDataCopyPass, chunk, feedFrame.x, feedFrame.y, feedFrame.x, feedFrame.y, nullptr, spriteWidth, spriteHeight);
+                continue;
+            }
+            uploadChunk(
+                spriteDataCopyPass,
+                chunk,
+                bunnies.x.data(),
+                bunnies.y.data(),
+                fixedTimestep.previousXs(bunnies),
+                fixedTimestep.previousYs(bunnies),
+                drawOrder,
+                spriteWidth,
+                spriteHeight
+            );
+        }
+        if (spriteFeed.enabled() && fillSprites) {
+            spriteFeed.release(feedFrame);
+        }
+        fixedTimestep.markUploaded();
+
+        // A changed static layer gets its sprites uploaded along with the moving ones
+        const bool redrawStaticLayer = staticLayer.beginFrame(camera);
+        if (redrawStaticLayer) {
+            for (SpriteChunk& chunk : staticChunks) {
+                chunk.drawCount = std::min({staticLayer.size() - chunk.first, chunk.capacity, chunkLimit});
+                const Bunnies& frozen = staticLayer.bunnies();
+                uploadChunk(spriteDataCopyPass, chunk, frozen.x.data(), frozen.y.data(), frozen.x.data(), frozen.y.data(), nullptr, spriteWidth, spriteHeight);
+            }
+        }
+        if (dynamicDrawArgs) {
+            // GPU culling resets the vertex counts and accumulates into them, otherwise they are set
+            // directly. Cycling leaves the transfer buffer undefined, so every command is rewritten.
+            auto drawArgs = static_cast<SDL_GPUIndirectDrawCommand*>(SDL_MapGPUTransferBuffer(
+                gpuDevice,
+                staticDataTransferBuffer,
+                true
+            ));
+            for (size_t i = 0; i < chunks.size(); i++) {
+                drawArgs[i].num_vertices = gpuCull ? 0 : chunks[i].drawCount * 6;
+                drawArgs[i].num_instances = 1;
+                drawArgs[i].first_vertex = 0;
+                drawArgs[i].first_instance = 0;
+            }
+            SDL_UnmapGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+            for (size_t i = 0; i < chunks.size(); i++) {
+                SDL_GPUTransferBufferLocation drawArgsLocation{
+                    .transfer_buffer = staticDataTransferBuffer,
+                    .offset = static_cast<Uint32>(i * sizeof(SDL_GPUIndirectDrawCommand))
+                };
+                SDL_GPUBufferRegion drawArgsRegion{
+                    .buffer = chunks[i].drawArgsBuffer,
+                    .offset = 0,
+                    .size = sizeof(SDL_GPUIndirectDrawCommand)
+                };
+                SDL_UploadToGPUBuffer(spriteDataCopyPass, &drawArgsLocation, &drawArgsRegion, false);
+            }
+        }
         SDL_EndGPUCopyPass(spriteDataCopyPass);
+        perfCounters.end(PerfPhase::Fill, fillCount);
+        gpuFrames.poll();
+        perfCounters.begin(PerfPhase::Submit);
+
+        // Cull against the camera and compact the visible sprites of every chunk
+        if (gpuCull) {
+            for (const SpriteChunk& chunk : chunks) {
+                if (chunk.drawCount == 0) {
+                    continue;
+                }
+
+                SDL_GPUStorageBufferReadWriteBinding cullBindings[] {
+                    { .buffer = chunk.visibleSpriteBuffer, .cycle = false },
+                    { .buffer = chunk.drawArgsBuffer, .cycle = false }
+                };
+                SDL_GPUComputePass* cullPass = SDL_BeginGPUComputePass(commandBuffer, nullptr, 0, cullBindings, 2);
+                CullParams cullParams{
+                    .viewMinX = camera.x,
+                    .viewMinY = camera.y,
+                    .viewMaxX = camera.x + camera.width,
+                    .viewMaxY = camera.y + camera.height,
+                    .spriteCount = chunk.drawCount
+                };
+                SDL_BindGPUComputePipeline(cullPass, cullPipeline);
+                SDL_BindGPUComputeStorageBuffers(cullPass, 0, &chunk.spriteDataBuffer, 1);
+                SDL_PushGPUComputeUniformData(commandBuffer, 0, &cullParams, sizeof(CullParams));
+                SDL_DispatchGPUCompute(cullPass, (chunk.drawCount + 63) / 64, 1, 1);
+                SDL_EndGPUComputePass(cullPass);
+            }
+        }
 
-        // Start a render pass
-        SDL_GPUColorTargetInfo colorTargetInfo{
-            .texture = swapchainTexture,
-            .clear_color = { 0.5, 0.5, 1, 1 },
-            .load_op = SDL_GPU_LOADOP_CLEAR,
-            .store_op = SDL_GPU_STOREOP_STORE,
-            .cycle = false
-        };
-        SDL_GPURenderPass* renderPass = SDL_BeginGPURenderPass(
-            commandBuffer,
-            &colorTargetInfo,
-            1,
-            nullptr
-        );
+        // Redraw the static layer if it changed, then copy the view's part of it into the target in
+        // place of the clear, for the moving sprites to be drawn over
+        if (staticLayer.enabled()) {
+            if (redrawStaticLayer) {
+                staticLayerMatrix = Matrix4x4_CreateOrthographicOffCenter(
+                    staticLayer.originX(),
+                    staticLayer.originX() + static_cast<float>(staticLayer.width()),
+                    staticLayer.originY() + static_cast<float>(staticLayer.height()),
+                    staticLayer.originY(),
+                    0,
+                    -1
+                );
+                SDL_GPURenderPass* layerPass = beginSpritePass(
+                    commandBuffer,
+                    staticLayerTexture,
+                    SDL_GPU_LOADOP_CLEAR,
+                    true,
+                    staticLayerMatrix
+                );
+                for (const SpriteChunk& chunk : staticChunks) {
+                    if (chunk.drawCount > 0) {
+                        drawChunk(layerPass, chunk, staticSubmitMode);
+                    }
+                }
+                SDL_EndGPURenderPass(layerPass);
+            }
 
-        SDL_BindGPUGraphicsPipeline(renderPass, graphicsPipeline);
-        SDL_BindGPUVertexStorageBuffers(
-            renderPass,
-            0,
-            &spriteDataBuffer,
-            1
-        );
-        SDL_BindGPUFragmentSamplers(
-            renderPass,
-            0,
-            &samplerBinding,
-            1
-        );
-        SDL_PushGPUVertexUniformData(
+            SDL_GPUBlitInfo staticLayerBlit{
+                .source = {
+                    .texture = staticLayerTexture,
+                    .x = staticLayer.sourceX(camera),
+                    .y = staticLayer.sourceY(camera),
+                    .w = WINDOW_WIDTH,
+                    .h = WINDOW_HEIGHT
+                },
+                .destination = {
+                    .texture = swapchainTexture,
+                    .w = WINDOW_WIDTH,
+                    .h = WINDOW_HEIGHT
+                },
+                .load_op = SDL_GPU_LOADOP_DONT_CARE,
+                .filter = SDL_GPU_FILTER_NEAREST
+            };
+            SDL_BlitGPUTexture(commandBuffer, &staticLayerBlit);
+        }
+
+        // Start a render pass
+        SDL_GPURenderPass* renderPass = beginSpritePass(
             commandBuffer,
-            0,
-            &cameraMatrix,
-            sizeof(Matrix4x4)
-        );
-        SDL_DrawGPUPrimitives(
-            renderPass,
-            NUM_BUNNIES * 6,
-            1,
-            0,
-            0
+            swapchainTexture,
+            staticLayer.enabled() ? SDL_GPU_LOADOP_LOAD : SDL_GPU_LOADOP_CLEAR,
+            false,
+            cameraMatrix
         );
+        if (ablation.active(Ablation::Viewport)) {
+            SDL_SetGPUViewport(renderPass, &tinyViewport);
+        }
+        for (const SpriteChunk& chunk : chunks) {
+            if (chunk.drawCount > 0) {
+                drawChunk(renderPass, chunk, submitMode);
+            }
+        }
 
         SDL_EndGPURenderPass(renderPass);
 
-        SDL_SubmitGPUCommandBuffer(commandBuffer);
+        // Download the captured frame along with it, wait for it and check it, then stop
+        if (captureFrame) {
+            SDL_GPUCopyPass* captureCopyPass = SDL_BeginGPUCopyPass(commandBuffer);
+            const SDL_GPUTextureRegion captureRegion{
+                .texture = captureTarget,
+                .w = WINDOW_WIDTH,
+                .h = WINDOW_HEIGHT,
+                .d = 1
+            };
+            const SDL_GPUTextureTransferInfo captureDestination{.transfer_buffer = captureTransferBuffer};
+            SDL_DownloadFromGPUTexture(captureCopyPass, &captureRegion, &captureDestination);
+            SDL_EndGPUCopyPass(captureCopyPass);
+        }
+
+        // Without a swapchain image to wait for, the present ablation throttles to the same depth on
+        // its own, so it neither runs unboundedly ahead nor serializes the CPU and the GPU
+        if (presentAblated) {
+            gpuFrames.waitForFrames(FRAMES_IN_FLIGHT - 1);
+        }
+        gpuFrames.submit(commandBuffer);
+        if (captureFrame) {
+            gpuFrames.waitForFrames(0);
+            const auto* pixels = static_cast<const uint8_t*>(SDL_MapGPUTransferBuffer(gpuDevice, captureTransferBuffer, false));
+            if (pixels) {
+                frameCapture.check(
+                    pixels,
+                    WINDOW_WIDTH,
+                    WINDOW_HEIGHT,
+                    static_cast<size_t>(WINDOW_WIDTH) * 4,
+                    bgraSwapchain ? PixelOrder::BGRA : PixelOrder::RGBA,
+                    false
+                );
+                SDL_UnmapGPUTransferBuffer(gpuDevice, captureTransferBuffer);
+            } else {
+                logError("Failed to read back the captured frame");
+            }
+            running = false;
+        }
+        presentLatencies.add(getMillisElapsed(steady_clock::now(), now));
+        perfCounters.end(PerfPhase::Submit, fillCount);
+        if (!startup.reported()) {
+            // The driver has built and stored the pipeline by now, if it writes into our directory at all
+            const bool driverCacheManaged = driverCacheFilled || driverCacheHasFiles();
+            const bool warmCache = repeatRun && driverCacheFilled;
+            startup.setVariant(!driverCacheManaged ? (repeatRun ? "repeat run" : "first run")
+                : warmCache ? "warm driver pipeline cache" : "cold driver pipeline cache");
+            startup.reportFirstFrame();
+            if (driverCacheManaged) {
+                pipelineCache.reportStartup(warmCache, startup.totalMillis());
+            } else {
+                pipelineCache.reportStartup(repeatRun, startup.totalMillis(), "first run", "repeat run");
+            }
+        }
     }
 
+    gpuFrames.waitForFrames(0);
+    SDL_ReleaseGPUTexture(gpuDevice, ablationTarget);
+    SDL_ReleaseGPUTexture(gpuDevice, captureTarget);
+    SDL_ReleaseGPUTransferBuffer(gpuDevice, captureTransferBuffer);
+    SDL_ReleaseGPUTexture(gpuDevice, staticLayerTexture);
     SDL_ReleaseGPUGraphicsPipeline(gpuDevice, graphicsPipeline);
     SDL_ReleaseGPUSampler(gpuDevice, sampler);
     SDL_ReleaseGPUTexture(gpuDevice, bunnyTexture);
     SDL_ReleaseGPUTransferBuffer(gpuDevice, spriteDataTransferBuffer);
-    SDL_ReleaseGPUBuffer(gpuDevice, spriteDataBuffer);
+    releaseSpriteChunks(gpuDevice, chunks);
+    releaseSpriteChunks(gpuDevice, staticChunks);
+    SDL_ReleaseGPUBuffer(gpuDevice, quadIndexBuffer);
+    SDL_ReleaseGPUBuffer(gpuDevice, staticDataBuffer);
+    SDL_ReleaseGPUTransferBuffer(gpuDevice, staticDataTransferBuffer);
+    SDL_ReleaseGPUComputePipeline(gpuDevice, cullPipeline);
     SDL_DestroyGPUDevice(gpuDevice);
     SDL_DestroyWindow(window);
     SDL_Quit();
-    return 0;
+    return workloadLog.failed() || frameCapture.failed() ? 1 : 0;
 }
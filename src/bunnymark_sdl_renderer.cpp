@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <ctime>
+#include <iomanip>
 #include <iostream>
 #include <ostream>
 #include <random>
+#include <string>
 
 #include "SDL3/SDL_init.h"
 #include <vector>
@@ -10,184 +14,687 @@
 #include "SDL3/SDL_log.h"
 #include "SDL3/SDL_render.h"
 
+#include "ablation.h"
+#include "args.h"
+#include "bunnies.h"
+#include "churn.h"
+#include "collision.h"
+#include "energy_meter.h"
+#include "fixed_timestep.h"
+#include "frame_arena.h"
+#include "frame_capture.h"
+#include "morton_order.h"
+#include "occlusion_cull.h"
+#include "perf_counters.h"
+#include "spatial_grid.h"
+#include "sprite_sort.h"
+#include "static_layer.h"
+#include "texture_pack.h"
+#include "tracking_new.h"
+#include "workload_log.h"
+#include "world.h"
+
 using namespace std::chrono;
 
 constexpr int WINDOW_WIDTH = 800;
 constexpr int WINDOW_HEIGHT = 600;
 constexpr int NUM_BUNNIES = 50000;
 
+// SDL_RenderGeometryRaw takes an int vertex count, and smaller batches keep the expanded
+// vertices in cache, so large populations are drawn in chunks of this many bunnies
+constexpr uint32_t MAX_BUNNIES_PER_DRAW = 1 << 16;
+
 void logError(const char* errorText) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s: %s", errorText, SDL_GetError());
 }
 
+// Lists what --renderer accepts besides `all`
+void logRenderDrivers() {
+    std::cout << "Available renderers:";
+    for (int i = 0; i < SDL_GetNumRenderDrivers(); i++) {
+        std::cout << " " << SDL_GetRenderDriver(i);
+    }
+    std::cout << " surface" << std::endl;
+}
+
+// Frames one renderer drew in a timed run, not counting its first second
+struct RendererResult {
+    std::string name;
+    uint64_t frames = 0;
+    double millis = 0;
+};
+
 constexpr float NANOS_IN_MILLIS = 1000000.0;
 float getMillisElapsed(const time_point<steady_clock>& a, const time_point<steady_clock>& b) {
     return static_cast<float>(duration_cast<nanoseconds>(a - b).count()) / NANOS_IN_MILLIS;
 }
 
-int main() {
-    // Initial SDL setup
-    if (!SDL_Init(SDL_INIT_VIDEO)) {
-        logError("Failed to initialize SDL");
-        SDL_Quit();
-        return 1;
-    }
-
-    // Create the window
-    SDL_Window* window = SDL_CreateWindow(
-        "SDL3 Renderer Bunnymark",
-        WINDOW_WIDTH,
-        WINDOW_HEIGHT,
-        0
+int main(int argc, char* argv[]) {
+    // Heap allocations counted per frame phase, SDL's included from its very first one
+    // (--track-allocs), optionally aborting on any allocation after N warmup frames (--no-alloc-after N)
+    SDL_SetMemoryFunctions(
+        trackedMalloc<AllocSource::SDL>,
+        trackedCalloc<AllocSource::SDL>,
+        trackedRealloc<AllocSource::SDL>,
+        trackedFree
     );
-    if (!window) {
-        logError("Failed to initialize window");
-        SDL_Quit();
+    const bool trackAllocations = hasArg(argc, argv, "--track-allocs") || hasArg(argc, argv, "--no-alloc-after");
+    allocationTracker.failAfterFrame(getIntArg(argc, argv, "--no-alloc-after", -1));
+
+    // Population (--bunnies N), defaulting to NUM_BUNNIES
+    const uint32_t population = getBunnyCount(argc, argv, NUM_BUNNIES);
+
+    // Large-world mode (--world-scale N), optionally culled on the CPU through a uniform grid (--cpu-cull)
+    const World world = getWorld(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool largeWorld = world.isLarge(WINDOW_WIDTH, WINDOW_HEIGHT);
+    const bool cpuCull = hasArg(argc, argv, "--cpu-cull");
+
+    // Cached static layer (--static P, --static-edits N): the frozen share of the population is drawn
+    // into a target texture once, only the rest of the bunnies are simulated and drawn every frame
+    StaticLayer staticLayer(argc, argv, population, world, WINDOW_WIDTH, WINDOW_HEIGHT);
+    const uint32_t bunnyCount = population - staticLayer.size();
+
+    // Bunny–bunny collisions (--collide), spread over --threads N worker threads
+    const bool collide = hasArg(argc, argv, "--collide");
+    ThreadPool threadPool(static_cast<unsigned>(std::max(getIntArg(argc, argv, "--threads", std::thread::hardware_concurrency()), 1L)));
+    CollisionSystem collisions(threadPool);
+
+    // Churn mode (--churn P, --spawn P), spawning and despawning bunnies every frame
+    BunnyChurn churn(argc, argv);
+
+    // Depth sort of the drawn bunnies between simulation and fill (--sort), timed per frame
+    const bool sortSprites = hasArg(argc, argv, "--sort");
+    SpriteSorter sorter(threadPool);
+    // Z-order reordering of the bunny store every N simulation steps, for locality in the fill (--morton N)
+    MortonOrder mortonOrder(argc, argv, sorter);
+
+    // Fixed-timestep simulation, drawn interpolated between the last two steps (--tick-rate HZ)
+    FixedTimestep fixedTimestep(argc, argv);
+    // Recording of the frame times and state hashes, or a replay checking them (--record FILE, --replay FILE)
+    WorkloadLog workloadLog(argc, argv);
+    // Offscreen render of frame N, compared against a golden image (--capture-frame N, --golden FILE)
+    FrameCapture frameCapture(argc, argv);
+
+    // Culling of the sprites hidden under the opaque cores of later ones, before the fill (--occlusion-cull)
+    OcclusionCuller occlusionCuller(argc, argv, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Hardware counters of the main thread around simulation, fill and submit (--perf-counters, Linux only)
+    PerfCounters perfCounters(hasArg(argc, argv, "--perf-counters"));
+
+    // Package and DRAM energy over each report window (--energy, Linux powercap)
+    EnergyMeter energyMeter(hasArg(argc, argv, "--energy"));
+
+    // Bottleneck attribution (--ablate), replaying the scenario for --ablate-frames N frames per ablation
+    AblationRunner ablation(
+        hasArg(argc, argv, "--ablate"),
+        static_cast<uint32_t>(getIntArg(argc, argv, "--ablate-frames", 300)),
+        mortonOrder.enabled()
+    );
+
+    // Renderer (--renderer NAME), any driver SDL_GetRenderDriver reports or `surface`, defaulting to
+    // vulkan. `--renderer all` runs each in turn for --run-seconds N (default 10) and compares them,
+    // a single renderer runs until closed unless --run-seconds is given.
+    const char* rendererName = getArg(argc, argv, "--renderer", "vulkan");
+    const bool allRenderers = SDL_strcmp(rendererName, "all") == 0;
+    const float runSeconds = getFloatArg(argc, argv, "--run-seconds", allRenderers ? 10.0f : 0.0f);
+    if (allRenderers && ablation.enabled()) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "--ablate runs a single renderer");
         return 1;
     }
-
-    // Create the renderer
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, "vulkan");
-    if (!renderer) {
-        logError("Failed to initialize renderer");
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+    if (allRenderers && workloadLog.recording()) {
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "--record records a single renderer, replay the file with --renderer all");
         return 1;
     }
 
-    // Load the bunny image as an SDL_Surface
-    SDL_Surface* bunnySurface = SDL_LoadPNG("../bunny.png");
-    if (!bunnySurface) {
-        logError("Failed to load image bunny.png");
-        SDL_DestroyWindow(window);
+    // Initial SDL setup
+    if (!SDL_Init(SDL_INIT_VIDEO)) {
+        logError("Failed to initialize SDL");
         SDL_Quit();
         return 1;
     }
 
-    // Convert the bunny surface to a texture
-    SDL_Texture* bunnyTexture = SDL_CreateTextureFromSurface(renderer, bunnySurface);
-    SDL_DestroySurface(bunnySurface);
-    if (!bunnyTexture) {
-        logError("Failed to create texture from surface");
-        SDL_DestroyWindow(window);
+    // Look up the pre-cooked bunny in the memory-mapped texture pack made by the cook_textures target
+    TexturePack texturePack;
+    const PackTexture* bunnyImage = texturePack.open("sprites.pack") ? texturePack.find("bunny") : nullptr;
+    if (!bunnyImage) {
+        SDL_SetError("No bunny in sprites.pack, build the cook_textures target");
+        logError("Failed to load texture");
         SDL_Quit();
         return 1;
     }
 
-    // Get the dimensions of the bunny for later
-    const int w = bunnyTexture->w;
-    const int h = bunnyTexture->h;
-    const int hw = w / 2;
-    const int hh = h / 2;
-
-    //
-    // Set up the bunnies
-    //
-
-    struct Bunny {
-        float x, y;
-        float vx, vy;
-    };
-
-    std::vector<Bunny> bunnies;
-    std::mt19937 rng; // NOLINT deterministic but that's fine here
-    std::uniform_real_distribution dis{-1.0f, 1.0f};
-
-    for (int i = 0; i < NUM_BUNNIES; i++) {
-        bunnies.push_back({
-            .x = static_cast<float>(WINDOW_WIDTH) / 2,
-            .y = static_cast<float>(WINDOW_HEIGHT) / 2,
-            .vx = dis(rng),
-            .vy = dis(rng)
-        });
+    // Sprites are drawn centered on the bunny's position, offset by half their size in whole pixels
+    occlusionCuller.setSprite(
+        texturePack.data(*bunnyImage),
+        bunnyImage->width,
+        bunnyImage->height,
+        static_cast<float>(bunnyImage->width / 2),
+        static_cast<float>(bunnyImage->height / 2)
+    );
+
+    // The renderers to run, with the window surface one after SDL's own drivers
+    std::vector<std::string> rendererNames;
+    if (allRenderers) {
+        for (int i = 0; i < SDL_GetNumRenderDrivers(); i++) {
+            rendererNames.emplace_back(SDL_GetRenderDriver(i));
+        }
+        rendererNames.emplace_back("surface");
+    } else {
+        rendererNames.emplace_back(rendererName);
     }
+    std::vector<RendererResult> results;
+    bool quit = false;
+    SDL_Event event;
 
-    struct Vertex {
-        float x, y;
-        float u, v;
-    };
+    for (const std::string& name : rendererNames) {
+        if (quit) {
+            break;
+        }
+        std::cout << "Renderer: " << name << std::endl;
+        RendererResult& result = results.emplace_back(RendererResult{.name = name});
+
+        // Create the window
+        SDL_Window* window = SDL_CreateWindow(
+            "SDL3 Renderer Bunnymark",
+            WINDOW_WIDTH,
+            WINDOW_HEIGHT,
+            0
+        );
+        if (!window) {
+            logError("Failed to initialize window");
+            SDL_Quit();
+            return 1;
+        }
 
-    Vertex vertices[NUM_BUNNIES * 6];
-    constexpr SDL_FColor vertexColor{1, 1, 1, 1};
+        // Create the renderer. The surface renderer is SDL's software renderer drawing straight
+        // into the window surface, which needs no GPU at all.
+        const bool surfaceRenderer = name == "surface";
+        SDL_Renderer* renderer = nullptr;
+        if (surfaceRenderer) {
+            if (SDL_Surface* windowSurface = SDL_GetWindowSurface(window)) {
+                renderer = SDL_CreateSoftwareRenderer(windowSurface);
+            }
+        } else {
+            renderer = SDL_CreateRenderer(window, name.c_str());
+        }
+        if (!renderer) {
+            logError("Failed to initialize renderer");
+            SDL_DestroyWindow(window);
+            if (allRenderers) {
+                continue;
+            }
+            logRenderDrivers();
+            SDL_Quit();
+            return 1;
+        }
 
-    //
-    // Start the game loop
-    //
+        // The software renderers draw every bunny as an unscaled blit, which SDL's surface blitters
+        // do far faster than rasterizing two triangles. Their fast alpha blit wants ARGB8888 sources.
+        const bool blitSprites = surfaceRenderer || name == "software";
+        const SDL_PixelFormat textureFormat = blitSprites ? SDL_PIXELFORMAT_ARGB8888 : SDL_PIXELFORMAT_RGBA32;
+        const int pitch = static_cast<int>(bunnyImage->width) * 4;
+        std::vector<std::byte> convertedPixels;
+        const void* pixels = texturePack.data(*bunnyImage);
+        if (blitSprites) {
+            convertedPixels.resize(static_cast<size_t>(pitch) * bunnyImage->height);
+            SDL_ConvertPixels(
+                static_cast<int>(bunnyImage->width),
+                static_cast<int>(bunnyImage->height),
+                SDL_PIXELFORMAT_RGBA32,
+                pixels,
+                pitch,
+                textureFormat,
+                convertedPixels.data(),
+                pitch
+            );
+            pixels = convertedPixels.data();
+        }
 
-    auto lastTick = steady_clock::now();
-    auto lastFpsMeasurement = steady_clock::now();
-    float dt = 0;
-    uint32_t framesInLastSecond = 0;
+        // Create the bunny texture and upload its top mip level straight from the mapping
+        SDL_Texture* bunnyTexture = SDL_CreateTexture(
+            renderer,
+            textureFormat,
+            SDL_TEXTUREACCESS_STATIC,
+            static_cast<int>(bunnyImage->width),
+            static_cast<int>(bunnyImage->height)
+        );
+        if (!bunnyTexture || !SDL_UpdateTexture(bunnyTexture, nullptr, pixels, pitch)) {
+            logError("Failed to create texture");
+            SDL_DestroyRenderer(renderer);
+            SDL_DestroyWindow(window);
+            if (allRenderers) {
+                continue;
+            }
+            SDL_Quit();
+            return 1;
+        }
+        SDL_SetTextureBlendMode(bunnyTexture, SDL_BLENDMODE_BLEND);
+
+        // The static layer, only rendered into when it changes and copied over the clear every frame
+        SDL_Texture* staticLayerTexture = nullptr;
+        if (staticLayer.enabled()) {
+            staticLayerTexture = SDL_CreateTexture(
+                renderer,
+                textureFormat,
+                SDL_TEXTUREACCESS_TARGET,
+                static_cast<int>(staticLayer.width()),
+                static_cast<int>(staticLayer.height())
+            );
+            if (!staticLayerTexture) {
+                logError("Failed to create static layer");
+                SDL_DestroyTexture(bunnyTexture);
+                SDL_DestroyRenderer(renderer);
+                SDL_DestroyWindow(window);
+                if (allRenderers) {
+                    continue;
+                }
+                SDL_Quit();
+                return 1;
+            }
+            SDL_SetTextureBlendMode(staticLayerTexture, SDL_BLENDMODE_NONE);
+            staticLayer.invalidate();
+        }
 
-    bool running = true;
-    SDL_Event event;
+        // The captured frame is drawn into this target texture instead of the window and read back
+        // from it, once per renderer so every driver of a --renderer all run is checked
+        SDL_Texture* captureTexture = nullptr;
+        if (frameCapture.enabled()) {
+            frameCapture.restart();
+            captureTexture = SDL_CreateTexture(renderer, textureFormat, SDL_TEXTUREACCESS_TARGET, WINDOW_WIDTH, WINDOW_HEIGHT);
+            if (!captureTexture) {
+                logError("Failed to create capture target, the frame will not be captured");
+            }
+        }
 
-    SDL_SetRenderDrawColor(renderer, 0, 128, 255, 255);
+        // Get the dimensions of the bunny for later
+        const int w = bunnyTexture->w;
+        const int h = bunnyTexture->h;
+        const int hw = w / 2;
+        const int hh = h / 2;
+
+        //
+        // Set up the bunnies
+        //
+
+        Bunnies bunnies;
+        bunnies.reserve(bunnyCount);
+        std::mt19937 rng; // NOLINT deterministic but that's fine here
+        std::uniform_real_distribution dis{-1.0f, 1.0f};
+
+        // In large-world and collision mode the bunnies start spread over the whole world instead of
+        // stacked at the center, where every bunny would overlap every other one. --uniform-spawn
+        // spreads them in any mode.
+        const bool spreadSpawn = largeWorld || collide || hasArg(argc, argv, "--uniform-spawn");
+        std::uniform_real_distribution spawnX{0.0f, world.width - 32};
+        std::uniform_real_distribution spawnY{0.0f, world.height - 32};
+
+        auto spawnBunny = [&] {
+            return Bunny{
+                .x = spreadSpawn ? spawnX(rng) : static_cast<float>(WINDOW_WIDTH) / 2,
+                .y = spreadSpawn ? spawnY(rng) : static_cast<float>(WINDOW_HEIGHT) / 2,
+                .vx = dis(rng),
+                .vy = dis(rng)
+            };
+        };
+        for (uint32_t i = 0; i < bunnyCount; i++) {
+            bunnies.push_back(spawnBunny());
+        }
+        fixedTimestep.reset(bunnies);
+        workloadLog.start(bunnies, world, fixedTimestep.tickMillis());
+
+        Camera camera{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+        SpatialGrid grid(world.width, world.height, getFloatArg(argc, argv, "--grid-cell", 128.0f));
+
+        // Per-frame CPU staging (culled index lists, sort keys, ...), --frame-arena N MiB to start with
+        FrameArena frameArena(static_cast<size_t>(std::max(getIntArg(argc, argv, "--frame-arena", DEFAULT_FRAME_ARENA_MIB), 1L)) << 20);
+
+        uint32_t drawCount = bunnyCount;
+
+        struct Vertex {
+            float x, y;
+            float u, v;
+        };
+
+        constexpr SDL_FColor vertexColor{1, 1, 1, 1};
+
+        // The viewport ablation draws into a single pixel, the upload one keeps drawing the same vertices
+        constexpr SDL_Rect tinyViewport{0, 0, 1, 1};
+        std::vector<Vertex> reusedVertices;
+
+        //
+        // Start the game loop
+        //
+
+        const auto startTime = steady_clock::now();
+        auto lastTick = steady_clock::now();
+        energyMeter.restart();
+        auto lastFpsMeasurement = steady_clock::now();
+        float dt = 0;
+        float sortMillis = 0;
+        uint32_t framesInLastSecond = 0;
+
+        bool running = true;
+
+        SDL_SetRenderDrawColor(renderer, 0, 128, 255, 255);
+
+        while (running) {
+            allocationTracker.beginFrame();
+            frameArena.beginFrame();
 
-    while (running) {
-        // Listen for quit event
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_EVENT_QUIT) {
+            // Listen for quit event
+            while (SDL_PollEvent(&event)) {
+                if (event.type == SDL_EVENT_QUIT) {
+                    running = false;
+                    quit = true;
+                }
+            }
+
+            // Get delta time
+            auto now = steady_clock::now();
+            dt = getMillisElapsed(now, lastTick);
+            lastTick = now;
+
+            // Stop a timed run after --run-seconds, timing every frame after the first second
+            if (runSeconds > 0) {
+                const float runMillis = getMillisElapsed(now, startTime);
+                if (runMillis > 1000) {
+                    result.frames++;
+                    result.millis += dt;
+                }
+                if (runMillis > runSeconds * 1000) {
+                    running = false;
+                }
+            }
+
+            // The simulation and the camera run on the frame's times, or on the recorded ones in a replay,
+            // which stops once they run out
+            float simulationMillis = dt;
+            float sceneMillis = getMillisElapsed(now, startTime);
+            if (!workloadLog.beginFrame(simulationMillis, sceneMillis)) {
                 running = false;
             }
-        }
 
-        // Get delta time
-        auto now = steady_clock::now();
-        dt = getMillisElapsed(now, lastTick);
-        lastTick = now;
-
-        // Measure FPS and report every second
-        framesInLastSecond++;
-        if (getMillisElapsed(now, lastFpsMeasurement) > 1000) {
-            std::cout << "FPS: " << framesInLastSecond << std::endl;
-            framesInLastSecond = 0;
-            lastFpsMeasurement = now;
-        }
+            // Move on to the next ablation run once this one has its frames, and stop after the last
+            if (ablation.beginFrame(dt, bunnies, rng)) {
+                if (ablation.done()) {
+                    ablation.report(std::cout);
+                    running = false;
+                }
+                drawCount = static_cast<uint32_t>(bunnies.size());
+                SDL_SetRenderViewport(renderer, ablation.active(Ablation::Viewport) ? &tinyViewport : nullptr);
+                reusedVertices.clear();
+                staticLayer.invalidate();
+                fixedTimestep.reset(bunnies);
+            }
 
-        SDL_RenderClear(renderer);
+            // Measure FPS and report every second
+            allocationTracker.setPhase(AllocPhase::Report);
+            framesInLastSecond++;
+            if (getMillisElapsed(now, lastFpsMeasurement) > 1000) {
+                std::cout << "FPS: " << framesInLastSecond;
+                if (churn.enabled()) {
+                    std::cout << ", bunnies: " << bunnies.size() << " (+" << churn.takeSpawned()
+                        << "/-" << churn.takeDespawned() << ")";
+                }
+                if (cpuCull) {
+                    std::cout << ", drawn: " << drawCount << ", culled: " << bunnies.size() - drawCount;
+                }
+                staticLayer.report(std::cout);
+                if (collide) {
+                    std::cout << ", colliding: " << collisions.lastCollidingCount();
+                }
+                if (sortSprites) {
+                    std::cout << ", sort: " << sortMillis / framesInLastSecond << " ms/frame";
+                    sortMillis = 0;
+                }
+                fixedTimestep.report(std::cout);
+                workloadLog.report(std::cout);
+                mortonOrder.report(std::cout);
+                occlusionCuller.report(std::cout);
+                if (const size_t arenaPeak = frameArena.takePeakBytes(); arenaPeak > 0) {
+                    std::cout << ", frame arena: " << arenaPeak / 1024 << " of " << frameArena.capacity() / 1024 << " KiB";
+                }
+                energyMeter.report(std::cout, framesInLastSecond, bunnies.size(), getMillisElapsed(now, lastFpsMeasurement));
+                std::cout << std::endl;
+                if (trackAllocations) {
+                    allocationTracker.report(std::cout);
+                }
+                perfCounters.report(std::cout);
+                framesInLastSecond = 0;
+                lastFpsMeasurement = now;
+            }
 
-        int vIdx = -1;
+            allocationTracker.setPhase(AllocPhase::Render);
+            SDL_Texture* frameTarget = captureTexture && frameCapture.beginFrame() ? captureTexture : nullptr;
+            if (frameTarget) {
+                SDL_SetRenderTarget(renderer, frameTarget);
+            }
+            SDL_RenderClear(renderer);
+
+            // Spawn and despawn bunnies, then update them, optionally colliding them with each other. With
+            // --tick-rate this runs in fixed steps, as many as are due, instead of once by the frame time
+            allocationTracker.setPhase(AllocPhase::Simulate);
+            perfCounters.begin(PerfPhase::Simulate);
+            if (!ablation.active(Ablation::Simulation)) {
+                const uint32_t ticks = fixedTimestep.enabled() ? fixedTimestep.advance(simulationMillis) : 1;
+                const float stepMillis = fixedTimestep.enabled() ? fixedTimestep.tickMillis() : simulationMillis;
+                for (uint32_t tick = 0; tick < ticks; tick++) {
+                    if (churn.enabled()) {
+                        churn.update(bunnies, rng, spawnBunny);
+                        drawCount = static_cast<uint32_t>(bunnies.size());
+                    }
+                    if (!ablation.active(Ablation::Unordered)) {
+                        mortonOrder.update(bunnies, frameArena);
+                    }
+                    fixedTimestep.snapshot(bunnies);
+                    bunnies.update(stepMillis, world);
+                    if (collide) {
+                        collisions.resolve(bunnies);
+                    }
+                }
+            }
 
-        // Update the bunnies
-        for (auto&[x, y, vx, vy] : bunnies) {
-            x += vx * dt;
-            y += vy * dt;
+            perfCounters.end(PerfPhase::Simulate, bunnies.size());
+            workloadLog.endSimulation(bunnies);
 
-            if (x < 0 || x > WINDOW_WIDTH - 32) vx *= -1;
-            if (y < 0 || y > WINDOW_HEIGHT - 32) vy *= -1;
+            // Pan the camera across the world
+            if (largeWorld) {
+                camera.update(world, sceneMillis);
+            }
 
-            // Uncomment to use SDL's built-in RenderTexture function (slower)
-            // SDL_FRect rect{x - hw, y - hh, static_cast<float>(w), static_cast<float>(h)};
-            // SDL_RenderTexture(renderer, bunnyTexture, nullptr, &rect);
+            // Redraw the static layer if it changed, then copy the view's part of it over the clear. It
+            // is only redrawn now and then, so every frozen bunny is simply drawn as a texture copy.
+            allocationTracker.setPhase(AllocPhase::Render);
+            const bool zeroArea = ablation.active(Ablation::Fill);
+            const float halfW = zeroArea ? 0.0f : static_cast<float>(hw);
+            const float halfH = zeroArea ? 0.0f : static_cast<float>(hh);
+            if (staticLayer.beginFrame(camera)) {
+                SDL_SetRenderTarget(renderer, staticLayerTexture);
+                SDL_RenderClear(renderer);
+                const Bunnies& frozen = staticLayer.bunnies();
+                for (uint32_t i = 0; i < staticLayer.size(); i++) {
+                    const SDL_FRect rect{
+                        frozen.x[i] - staticLayer.originX() - halfW,
+                        frozen.y[i] - staticLayer.originY() - halfH,
+                        zeroArea ? 0.0f : static_cast<float>(w),
+                        zeroArea ? 0.0f : static_cast<float>(h)
+                    };
+                    SDL_RenderTexture(renderer, bunnyTexture, nullptr, &rect);
+                }
+                SDL_SetRenderTarget(renderer, frameTarget);
+            }
+            if (staticLayer.enabled()) {
+                const SDL_FRect source{
+                    static_cast<float>(staticLayer.sourceX(camera)),
+                    static_cast<float>(staticLayer.sourceY(camera)),
+                    camera.width,
+                    camera.height
+                };
+                SDL_RenderTexture(renderer, staticLayerTexture, &source, nullptr);
+            }
+
+            // Only bunnies in grid cells touching the camera get expanded and drawn
+            allocationTracker.setPhase(AllocPhase::Cull);
+            uint32_t* visibleBunnies = nullptr;
+            if (cpuCull) {
+                grid.build(bunnies.x.data(), bunnies.y.data(), bunnies.size());
+                visibleBunnies = frameArena.allocate<uint32_t>(bunnies.size());
+                drawCount = grid.query(
+                    camera.x - 32,
+                    camera.y - 32,
+                    camera.x + camera.width + 32,
+                    camera.y + camera.height + 32,
+                    visibleBunnies
+                );
+            }
+
+            // Sort the drawn bunnies back to front by y, which the fill then follows. They all
+            // share one texture, so the texture half of the key is constant and costs no passes.
+            const uint32_t* drawOrder = visibleBunnies;
+            if (sortSprites) {
+                const auto sortStart = steady_clock::now();
+                drawOrder = sorter.sort(frameArena, drawOrder, drawCount, [&](const uint32_t index) {
+                    return spriteSortKey(bunnies.y[index], 0);
+                });
+                sortMillis += getMillisElapsed(steady_clock::now(), sortStart);
+            }
+
+            // Drop the bunnies completely hidden under the ones drawn after them, for this frame only
+            uint32_t fillCount = drawCount;
+            if (occlusionCuller.enabled() && !fixedTimestep.enabled()) {
+                drawOrder = occlusionCuller.cull(frameArena, bunnies, camera, drawOrder, fillCount);
+            }
+            allocationTracker.setPhase(AllocPhase::Render);
+
+            // The software renderers blit every bunny relative to the camera and expand nothing. SDL's
+            // renderer takes no custom shaders, so with --tick-rate both paths interpolate on the CPU.
+            perfCounters.begin(PerfPhase::Fill);
+            if (blitSprites) {
+                for (uint32_t i = 0; i < fillCount; i++) {
+                    const uint32_t index = drawOrder ? drawOrder[i] : i;
+                    const SDL_FRect rect{
+                        fixedTimestep.x(bunnies, index) - camera.x - halfW,
+                        fixedTimestep.y(bunnies, index) - camera.y - halfH,
+                        zeroArea ? 0.0f : static_cast<float>(w),
+                        zeroArea ? 0.0f : static_cast<float>(h)
+                    };
+                    SDL_RenderTexture(renderer, bunnyTexture, nullptr, &rect);
+                }
+            }
+
+            // Otherwise expand the bunnies into vertices, relative to the camera, one chunk at a time.
+            // The vertices come from the frame arena and are reused by every chunk, SDL copies them into
+            // its own command queue. The fill ablation collapses every sprite to zero area, and the upload
+            // one skips the expansion, drawing the vertices of the run's first frame instead.
+            const uint32_t expandCount = blitSprites ? 0 : fillCount;
+            const bool reuseVertices = ablation.active(Ablation::Upload) && !reusedVertices.empty();
+            Vertex* vertices = reuseVertices
+                ? reusedVertices.data()
+                : frameArena.allocate<Vertex>(static_cast<size_t>(std::min(expandCount, MAX_BUNNIES_PER_DRAW)) * 6);
+            for (uint32_t first = 0; first < expandCount; first += MAX_BUNNIES_PER_DRAW) {
+                uint32_t chunkCount = std::min(expandCount - first, MAX_BUNNIES_PER_DRAW);
+                if (reuseVertices) {
+                    chunkCount = std::min(chunkCount, static_cast<uint32_t>(reusedVertices.size() / 6));
+                } else {
+                    int vIdx = -1;
+                    for (uint32_t i = first; i < first + chunkCount; i++) {
+                        const uint32_t index = drawOrder ? drawOrder[i] : i;
+                        const float x = fixedTimestep.x(bunnies, index) - camera.x;
+                        const float y = fixedTimestep.y(bunnies, index) - camera.y;
+
+                        vertices[++vIdx] = {x - halfW, y - halfH, 0, 0};
+                        vertices[++vIdx] = {x - halfW, y + halfH, 0, 1};
+                        vertices[++vIdx] = {x + halfW, y - halfH, 1, 0};
+                        vertices[++vIdx] = {x + halfW, y - halfH, 1, 0};
+                        vertices[++vIdx] = {x - halfW, y + halfH, 0, 1};
+                        vertices[++vIdx] = {x + halfW, y + halfH, 1, 1};
+                    }
+                    if (ablation.active(Ablation::Upload) && reusedVertices.empty()) {
+                        reusedVertices.assign(vertices, vertices + static_cast<size_t>(chunkCount) * 6);
+                    }
+                }
+
+                SDL_RenderGeometryRaw(
+                    renderer,
+                    bunnyTexture,
+                    &vertices[0].x,
+                    sizeof(float) * 4,
+                    &vertexColor,
+                    0,
+                    &vertices[0].u,
+                    sizeof(float) * 4,
+                    static_cast<int>(chunkCount * 6),
+                    nullptr,
+                    0,
+                    4
+                );
+            }
 
-            vertices[++vIdx] = {x - hw, y - hh, 0, 0};
-            vertices[++vIdx] = {x - hw, y + hh, 0, 1};
-            vertices[++vIdx] = {x + hw, y - hh, 1, 0};
-            vertices[++vIdx] = {x + hw, y - hh, 1, 0};
-            vertices[++vIdx] = {x - hw, y + hh, 0, 1};
-            vertices[++vIdx] = {x + hw, y + hh, 1, 1};
+            perfCounters.end(PerfPhase::Fill, fillCount);
+
+            // Read the captured frame back in RGBA, whatever the renderer's format, check it and stop
+            if (frameTarget) {
+                SDL_Surface* readBack = SDL_RenderReadPixels(renderer, nullptr);
+                SDL_Surface* captured = readBack ? SDL_ConvertSurface(readBack, SDL_PIXELFORMAT_RGBA32) : nullptr;
+                if (captured) {
+                    frameCapture.check(
+                        static_cast<const uint8_t*>(captured->pixels),
+                        static_cast<uint32_t>(captured->w),
+                        static_cast<uint32_t>(captured->h),
+                        static_cast<size_t>(captured->pitch),
+                        PixelOrder::RGBA,
+                        false
+                    );
+                } else {
+                    logError("Failed to read back the captured frame");
+                }
+                SDL_DestroySurface(captured);
+                SDL_DestroySurface(readBack);
+                SDL_SetRenderTarget(renderer, nullptr);
+                running = false;
+            }
+
+            // The present ablation only flushes the queued commands to the GPU. The surface renderer
+            // has no window of its own, so its surface is copied to the window after the flush.
+            perfCounters.begin(PerfPhase::Submit);
+            if (ablation.active(Ablation::Present)) {
+                SDL_FlushRenderer(renderer);
+            } else if (surfaceRenderer) {
+                SDL_FlushRenderer(renderer);
+                SDL_UpdateWindowSurface(window);
+            } else {
+                SDL_RenderPresent(renderer);
+            }
+            perfCounters.end(PerfPhase::Submit, fillCount);
         }
 
-        SDL_RenderGeometryRaw(
-            renderer,
-            bunnyTexture,
-            &vertices[0].x,
-            sizeof(float) * 4,
-            &vertexColor,
-            0,
-            &vertices[0].u,
-            sizeof(float) * 4,
-            NUM_BUNNIES * 6,
-            nullptr,
-            0,
-            4
-        );
+        // Tearing this renderer down and setting up the next one allocates, which restarts the
+        // --no-alloc-after warmup
+        allocationTracker.restartWarmup();
 
-        SDL_RenderPresent(renderer);
+        SDL_DestroyTexture(captureTexture);
+        SDL_DestroyTexture(staticLayerTexture);
+        SDL_DestroyTexture(bunnyTexture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+    }
+
+    // Compare the renderers of a --renderer all run
+    if (results.size() > 1) {
+        std::cout << "Renderer      frames  ms/frame       FPS" << std::endl;
+        for (const RendererResult& result : results) {
+            std::cout << std::left << std::setw(12) << result.name << std::right;
+            if (result.frames == 0) {
+                std::cout << "    failed" << std::endl;
+                continue;
+            }
+            std::cout << std::fixed << std::setw(8) << result.frames
+                << std::setprecision(3) << std::setw(10) << result.millis / static_cast<double>(result.frames)
+                << std::setprecision(1) << std::setw(10) << 1000.0 * static_cast<double>(result.frames) / result.millis
+                << std::endl;
+        }
     }
 
-    SDL_DestroyTexture(bunnyTexture);
     SDL_Quit();
-    return 0;
+    return workloadLog.failed() || frameCapture.failed() ? 1 : 0;
 }
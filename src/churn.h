@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+
+#include "args.h"
+#include "bunnies.h"
+
+// Churn mode: every frame a percentage of the bunnies dies and a percentage of new ones spawns,
+// like the particles of an effect-heavy scene. `--churn P` sets both percentages, `--spawn P`
+// overrides the spawn one, so a spawn rate above the churn rate grows the population over time.
+// Fractional counts carry over to the next frame, so small rates still churn at the right pace.
+class BunnyChurn {
+public:
+    BunnyChurn(const int argc, char* argv[])
+        : despawnPercent(std::max(getFloatArg(argc, argv, "--churn", 0.0f), 0.0f)),
+          spawnPercent(std::max(getFloatArg(argc, argv, "--spawn", despawnPercent), 0.0f)) {}
+
+    bool enabled() const { return despawnPercent > 0 || spawnPercent > 0; }
+
+    // Despawns random bunnies by swap-removal, then appends the new ones made by `spawn()`
+    template<typename SpawnFn>
+    void update(Bunnies& bunnies, std::mt19937& rng, SpawnFn spawn) {
+        const size_t count = bunnies.size();
+        despawnCarry += static_cast<double>(count) * despawnPercent / 100.0;
+        spawnCarry += static_cast<double>(count) * spawnPercent / 100.0;
+        const auto despawns = std::min(static_cast<size_t>(despawnCarry), count);
+        const auto spawns = std::min(static_cast<size_t>(spawnCarry), MAX_BUNNIES - (count - despawns));
+        despawnCarry -= static_cast<double>(static_cast<size_t>(despawnCarry));
+        spawnCarry -= static_cast<double>(static_cast<size_t>(spawnCarry));
+
+        for (size_t i = 0; i < despawns; i++) {
+            bunnies.swapRemove(std::uniform_int_distribution<size_t>{0, bunnies.size() - 1}(rng));
+        }
+        for (size_t i = 0; i < spawns; i++) {
+            bunnies.push_back(spawn());
+        }
+        spawned += spawns;
+        despawned += despawns;
+    }
+
+    // Totals since the last call, for the once-per-second report
+    size_t takeSpawned() { return std::exchange(spawned, 0); }
+    size_t takeDespawned() { return std::exchange(despawned, 0); }
+
+private:
+    float despawnPercent, spawnPercent;
+    double despawnCarry = 0, spawnCarry = 0;
+    size_t spawned = 0, despawned = 0;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bunnies.h"
+#include "thread_pool.h"
+
+// Bunny–bunny collisions on 32x32 AABBs. The broadphase is a spatial hash with one cell per
+// bunny size, built in parallel as a counting sort into SoA arrays; the narrowphase scans the
+// 3x3 neighbouring cells of every bunny in parallel. Each bunny only ever writes its own
+// velocity and responses are combined with bitwise ORs, so the result does not depend on
+// thread count or on the order bunnies land in a bucket.
+class CollisionSystem {
+public:
+    explicit CollisionSystem(ThreadPool& pool) : pool(pool), threadCollisions(pool.size()) {}
+
+    // Reflects the velocity of every overlapping bunny away from the bunnies it overlaps,
+    // along the axis of least penetration
+    void resolve(Bunnies& bunnies) {
+        const size_t count = bunnies.size();
+        prepare(count);
+
+        // Hash every bunny into its cell and count the bucket sizes
+        const float* __restrict x = bunnies.x.data();
+        const float* __restrict y = bunnies.y.data();
+        pool.parallelFor(count, [&](const size_t begin, const size_t end, unsigned) {
+            for (size_t i = begin; i < end; i++) {
+                const uint32_t bucket = hashCell(cellOf(x[i]), cellOf(y[i]));
+                bucketOf[i] = bucket;
+                std::atomic_ref(bucketStart[bucket + 1]).fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+        for (size_t bucket = 1; bucket <= bucketMask + 1; bucket++) {
+            bucketStart[bucket] += bucketStart[bucket - 1];
+        }
+        std::copy(bucketStart.begin(), bucketStart.end() - 1, bucketCursor.begin());
+
+        // Scatter positions into bucket order, so each bucket is a contiguous SoA range
+        pool.parallelFor(count, [&](const size_t begin, const size_t end, unsigned) {
+            for (size_t i = begin; i < end; i++) {
+                const uint32_t slot = std::atomic_ref(bucketCursor[bucketOf[i]]).fetch_add(1, std::memory_order_relaxed);
+                sortedX[slot] = x[i];
+                sortedY[slot] = y[i];
+                sortedIndex[slot] = static_cast<uint32_t>(i);
+            }
+        });
+
+        // Narrowphase against the 3x3 neighbouring cells
+        float* __restrict vx = bunnies.vx.data();
+        float* __restrict vy = bunnies.vy.data();
+        pool.parallelFor(count, [&](const size_t begin, const size_t end, const unsigned threadIndex) {
+            uint32_t collisions = 0;
+            for (size_t i = begin; i < end; i++) {
+                const float xi = x[i];
+                const float yi = y[i];
+                const int32_t cellX = cellOf(xi);
+                const int32_t cellY = cellOf(yi);
+
+                uint32_t pushLeft = 0, pushRight = 0, pushUp = 0, pushDown = 0;
+                for (int32_t dy = -1; dy <= 1; dy++) {
+                    for (int32_t dx = -1; dx <= 1; dx++) {
+                        const uint32_t bucket = hashCell(cellX + dx, cellY + dy);
+                        const uint32_t bucketEnd = bucketStart[bucket + 1];
+                        for (uint32_t k = bucketStart[bucket]; k < bucketEnd; k++) {
+                            const float offsetX = sortedX[k] - xi;
+                            const float offsetY = sortedY[k] - yi;
+                            const float distanceX = std::fabs(offsetX);
+                            const float distanceY = std::fabs(offsetY);
+                            const uint32_t overlap = (distanceX < BUNNY_SIZE) & (distanceY < BUNNY_SIZE) & (sortedIndex[k] != i);
+                            const uint32_t horizontal = distanceX > distanceY;
+                            pushLeft |= overlap & horizontal & (offsetX > 0);
+                            pushRight |= overlap & horizontal & (offsetX <= 0);
+                            pushUp |= overlap & (horizontal ^ 1) & (offsetY > 0);
+                            pushDown |= overlap & (horizontal ^ 1) & (offsetY <= 0);
+                        }
+                    }
+                }
+
+                if (pushLeft != pushRight) vx[i] = pushLeft ? -std::fabs(vx[i]) : std::fabs(vx[i]);
+                if (pushUp != pushDown) vy[i] = pushUp ? -std::fabs(vy[i]) : std::fabs(vy[i]);
+                collisions += pushLeft | pushRight | pushUp | pushDown;
+            }
+            threadCollisions[threadIndex] = collisions;
+        });
+
+        collidingBunnies = 0;
+        for (uint32_t& collisions : threadCollisions) {
+            collidingBunnies += collisions;
+            collisions = 0;
+        }
+    }
+
+    // Number of bunnies that touched another bunny in the last resolve()
+    uint32_t lastCollidingCount() const { return collidingBunnies; }
+
+private:
+    static int32_t cellOf(const float position) {
+        return static_cast<int32_t>(std::floor(position / BUNNY_SIZE));
+    }
+
+    uint32_t hashCell(const int32_t cellX, const int32_t cellY) const {
+        return (static_cast<uint32_t>(cellX) * 73856093u ^ static_cast<uint32_t>(cellY) * 19349663u) & bucketMask;
+    }
+
+    void prepare(const size_t count) {
+        // About two buckets per bunny keeps unrelated cells from sharing buckets
+        const uint32_t bucketCount = std::bit_ceil(std::max<uint32_t>(1024, static_cast<uint32_t>(count * 2)));
+        bucketMask = bucketCount - 1;
+        bucketStart.assign(bucketCount + 1, 0);
+        bucketCursor.resize(bucketCount);
+        bucketOf.resize(count);
+        sortedX.resize(count);
+        sortedY.resize(count);
+        sortedIndex.resize(count);
+    }
+
+    ThreadPool& pool;
+    uint32_t bucketMask = 0;
+    std::vector<uint32_t> bucketStart; // prefix sums, bucket b is [bucketStart[b], bucketStart[b + 1])
+    std::vector<uint32_t> bucketCursor;
+    std::vector<uint32_t> bucketOf;
+    BunnyArray sortedX, sortedY;
+    std::vector<uint32_t> sortedIndex;
+    std::vector<uint32_t> threadCollisions;
+    uint32_t collidingBunnies = 0;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Package and DRAM energy from the Linux powercap interface (RAPL), sampled once per report
+// window. Intel and recent AMD CPUs both show up as intel-rapl zones: every package-N zone is
+// summed into the package energy and their dram subzones into the DRAM energy, core/uncore
+// subzones are already part of their package. Since Linux 5.10 energy_uj is only readable by
+// root by default, so without access, or off Linux, the meter stays unavailable and is a no-op.
+class EnergyMeter {
+public:
+    explicit EnergyMeter(const bool enabled) {
+        if (enabled) open();
+    }
+
+    ~EnergyMeter() {
+#if defined(__linux__)
+        for (const Zone& zone : zones) {
+            close(zone.fd);
+        }
+#endif
+    }
+
+    EnergyMeter(const EnergyMeter&) = delete;
+    EnergyMeter& operator=(const EnergyMeter&) = delete;
+
+    bool available() const { return !zones.empty(); }
+
+    // Starts the first window at the frame loop, leaving out the energy spent loading
+    void restart() {
+        for (Zone& zone : zones) {
+            zone.last = readMicrojoules(zone.fd);
+        }
+    }
+
+    // Appends the energy since the last call to the FPS line: per frame, split by domain, per
+    // frame and 1k bunnies, and the average power
+    void report(std::ostream& out, const uint32_t frames, const size_t bunnyCount, const float millis) {
+        if (!available() || frames == 0) return;
+        double joules[2] = {0, 0};
+        for (Zone& zone : zones) {
+            const uint64_t energy = readMicrojoules(zone.fd);
+            // The counter wraps at max_energy_range_uj
+            const uint64_t delta = energy >= zone.last ? energy - zone.last : zone.range - zone.last + energy;
+            joules[zone.dram] += static_cast<double>(delta) / 1e6;
+            zone.last = energy;
+        }
+
+        const double perFrame = (joules[0] + joules[1]) * 1000 / frames;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(3) << ", energy: " << perFrame << " mJ/frame (package "
+            << joules[0] * 1000 / frames << ", DRAM " << (hasDram ? joules[1] * 1000 / frames : 0) << "), "
+            << perFrame * 1000 / static_cast<double>(bunnyCount > 0 ? bunnyCount : 1) << " mJ/frame per 1k bunnies, "
+            << std::setprecision(1) << (joules[0] + joules[1]) * 1000 / millis << " W";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    struct Zone {
+        int fd;
+        bool dram;
+        uint64_t range;
+        uint64_t last;
+    };
+
+    void open() {
+#if defined(__linux__)
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/class/powercap", error)) {
+            const std::string zoneName = entry.path().filename().string();
+            if (zoneName.rfind("intel-rapl:", 0) != 0) continue;
+
+            std::string name;
+            std::ifstream(entry.path() / "name") >> name;
+            const bool dram = name == "dram";
+            if (!dram && name.rfind("package", 0) != 0) continue;
+
+            const int fd = ::open((entry.path() / "energy_uj").c_str(), O_RDONLY);
+            if (fd < 0) continue;
+            uint64_t range = 0;
+            std::ifstream(entry.path() / "max_energy_range_uj") >> range;
+            zones.push_back({fd, dram, range, readMicrojoules(fd)});
+            hasDram = hasDram || dram;
+        }
+        if (zones.empty()) {
+            std::cerr << "Energy counters unavailable, /sys/class/powercap/intel-rapl:*/energy_uj is missing or "
+                "not readable (root only since Linux 5.10)" << std::endl;
+        }
+#else
+        std::cerr << "Energy counters are only supported on Linux" << std::endl;
+#endif
+    }
+
+    // Re-reads the whole sysfs file, without allocating
+    static uint64_t readMicrojoules(const int fd) {
+#if defined(__linux__)
+        char text[32];
+        const ssize_t size = pread(fd, text, sizeof(text) - 1, 0);
+        if (size <= 0) return 0;
+        text[size] = '\0';
+        return std::strtoull(text, nullptr, 10);
+#else
+        (void)fd;
+        return 0;
+#endif
+    }
+
+    std::vector<Zone> zones;
+    bool hasDram = false;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+
+#include "args.h"
+#include "bunnies.h"
+
+// Fixed-timestep simulation (--tick-rate HZ): the bunnies move in steps of exactly 1000 / HZ ms,
+// as many as the elapsed time calls for, so every binary goes through the same sequence of states
+// whatever its frame rate, and frames in between cost no simulation. Before each step the positions
+// are kept as the previous snapshot, and frames draw the bunnies interpolated between it and the
+// current one by alpha(), the share of a step that has elapsed since the last one. At most
+// MAX_TICKS_PER_FRAME steps run per frame, a longer hitch is dropped instead of caught up on.
+class FixedTimestep {
+public:
+    static constexpr uint32_t MAX_TICKS_PER_FRAME = 8;
+
+    FixedTimestep(const int argc, char* argv[])
+        : rate(static_cast<float>(std::max(getFloatArg(argc, argv, "--tick-rate", 0.0f), 0.0f))),
+          stepMillis(rate > 0 ? 1000.0f / rate : 0.0f),
+          accumulator(stepMillis) {}
+
+    bool enabled() const { return rate > 0; }
+    float tickMillis() const { return stepMillis; }
+
+    // Adds a frame's elapsed time and returns how many steps are due. The first frame after
+    // construction or reset() always gets one.
+    uint32_t advance(const float frameMillis) {
+        accumulator += frameMillis;
+        auto ticks = static_cast<uint32_t>(accumulator / stepMillis);
+        if (ticks > MAX_TICKS_PER_FRAME) {
+            droppedMillis += static_cast<float>(ticks - MAX_TICKS_PER_FRAME) * stepMillis;
+            ticks = MAX_TICKS_PER_FRAME;
+        }
+        accumulator = std::min(accumulator - static_cast<float>(ticks) * stepMillis, stepMillis);
+        frameAlpha = std::min(accumulator / stepMillis, 1.0f);
+        changed = changed || ticks > 0;
+        tickCount += ticks;
+        return ticks;
+    }
+
+    // True if the bunnies moved or were replaced since markUploaded(), and always without fixed
+    // steps. Until they do, frames only have to draw the uploaded sprites again with a new alpha().
+    bool snapshotChanged() const { return changed; }
+    void markUploaded() { changed = !enabled(); }
+
+    // Share of a step elapsed since the last one, from 0 (the previous snapshot) to 1 (the current one)
+    float alpha() const { return frameAlpha; }
+
+    // Starts over from `bunnies`, e.g. after they were replaced, drawing them as they are until the
+    // next frame steps right away
+    void reset(const Bunnies& bunnies) {
+        if (!enabled()) return;
+        accumulator = stepMillis;
+        frameAlpha = 1.0f;
+        changed = true;
+        snapshot(bunnies);
+    }
+
+    // Keeps the current positions as the previous snapshot. Call right before moving the bunnies,
+    // after anything that adds, removes or reorders them, so both snapshots index the same bunnies.
+    void snapshot(const Bunnies& bunnies) {
+        if (!enabled()) return;
+        previousX.assign(bunnies.x.begin(), bunnies.x.end());
+        previousY.assign(bunnies.y.begin(), bunnies.y.end());
+    }
+
+    // The previous snapshot's positions, or the current ones without fixed steps so interpolating
+    // between them is a no-op
+    const float* previousXs(const Bunnies& bunnies) const { return enabled() ? previousX.data() : bunnies.x.data(); }
+    const float* previousYs(const Bunnies& bunnies) const { return enabled() ? previousY.data() : bunnies.y.data(); }
+
+    // Interpolated position of a bunny, for the binaries that draw from the CPU
+    float x(const Bunnies& bunnies, const size_t index) const {
+        return enabled() ? previousX[index] + (bunnies.x[index] - previousX[index]) * frameAlpha : bunnies.x[index];
+    }
+    float y(const Bunnies& bunnies, const size_t index) const {
+        return enabled() ? previousY[index] + (bunnies.y[index] - previousY[index]) * frameAlpha : bunnies.y[index];
+    }
+
+    // Appends the steps since the last call to the FPS line
+    void report(std::ostream& out) {
+        if (!enabled()) return;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << ", ticks: " << tickCount << " at " << rate << " Hz";
+        if (droppedMillis > 0) {
+            out << std::fixed << std::setprecision(1) << ", " << droppedMillis << " ms dropped";
+        }
+        out.flags(flags);
+        out.precision(precision);
+        tickCount = 0;
+        droppedMillis = 0;
+    }
+
+private:
+    float rate;
+    float stepMillis;
+    float accumulator;
+    float frameAlpha = 1.0f;
+    bool changed = true;
+    BunnyArray previousX, previousY;
+    uint32_t tickCount = 0;
+    float droppedMillis = 0;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "large_page_allocator.h"
+
+// Default bytes per frame of the arena (--frame-arena N, in MiB)
+constexpr long DEFAULT_FRAME_ARENA_MIB = 16;
+
+// Bump-pointer arena for the CPU staging of one frame: culled index lists, sort keys, expanded
+// vertices and packed instances. Two buffers alternate, so memory handed out in one frame stays
+// valid through the next, long enough for APIs that read it a frame late like bgfx::makeRef.
+// A frame that outgrows its buffer chains another block, and the buffer is merged into one
+// bigger block the next time it comes around, so a steady workload stops allocating after a
+// couple of frames. The per-frame high-water mark tells how big to make it up front.
+class FrameArena {
+public:
+    explicit FrameArena(const size_t bytesPerFrame) {
+        for (Buffer& buffer : buffers) {
+            buffer.blocks.reserve(8);
+            addBlock(buffer, std::max<size_t>(bytesPerFrame, 1));
+        }
+    }
+
+    ~FrameArena() {
+        for (Buffer& buffer : buffers) {
+            for (const Block& block : buffer.blocks) {
+                freeLargePages(block.data, block.size);
+            }
+        }
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Switches to the other buffer and empties it, the previous frame's memory stays valid
+    void beginFrame() {
+        current ^= 1;
+        Buffer& buffer = buffers[current];
+        if (buffer.blocks.size() > 1) {
+            size_t total = 0;
+            for (const Block& block : buffer.blocks) {
+                total += block.size;
+                freeLargePages(block.data, block.size);
+            }
+            buffer.blocks.clear();
+            addBlock(buffer, total);
+        }
+        buffer.used = 0;
+        buffer.frameBytes = 0;
+    }
+
+    // Uninitialized room for `count` Ts, valid until the frame after next begins
+    template<typename T>
+    T* allocate(const size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena memory is released without destroying it");
+        return static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T)));
+    }
+
+    void* allocateBytes(const size_t bytes, const size_t alignment) {
+        Buffer& buffer = buffers[current];
+        const Block* block = &buffer.blocks.back();
+        const auto start = reinterpret_cast<uintptr_t>(block->data);
+        size_t offset = ((start + buffer.used + alignment - 1) & ~(uintptr_t{alignment} - 1)) - start;
+        if (offset + bytes > block->size) {
+            buffer.frameBytes += block->size - buffer.used;
+            addBlock(buffer, std::max(bytes + alignment, block->size));
+            block = &buffer.blocks.back();
+            const auto blockStart = reinterpret_cast<uintptr_t>(block->data);
+            offset = ((blockStart + alignment - 1) & ~(uintptr_t{alignment} - 1)) - blockStart;
+            buffer.used = 0;
+        }
+        buffer.frameBytes += offset + bytes - buffer.used;
+        buffer.used = offset + bytes;
+        peakBytes = std::max(peakBytes, buffer.frameBytes);
+        return block->data + offset;
+    }
+
+    // Highest bytes used by a single frame since the last call
+    size_t takePeakBytes() { return std::exchange(peakBytes, 0); }
+
+    // Bytes the current frame can use before chaining another block
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Block& block : buffers[current].blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        std::byte* data;
+        size_t size;
+    };
+
+    struct Buffer {
+        std::vector<Block> blocks; // more than one only in a frame that outgrew the buffer
+        size_t used = 0;           // in the last block
+        size_t frameBytes = 0;     // over all blocks, including alignment padding
+    };
+
+    static void addBlock(Buffer& buffer, const size_t size) {
+        allocationTracker.record(AllocSource::LargePages, size);
+        auto* data = static_cast<std::byte*>(allocateLargePages(size));
+        if (!data) throw std::bad_alloc();
+        buffer.blocks.push_back({data, size});
+    }
+
+    Buffer buffers[2];
+    unsigned current = 0;
+    size_t peakBytes = 0;
+};
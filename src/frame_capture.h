@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "args.h"
+
+// Byte order of the pixels a binary reads back
+enum class PixelOrder : uint8_t { RGBA, BGRA };
+
+// 8-bit RGB image, rows top to bottom, as stored in a binary PPM (P6) file
+struct RgbImage {
+    uint32_t width = 0, height = 0;
+    std::vector<uint8_t> pixels;
+
+    bool read(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        std::string magic;
+        uint32_t maxValue = 0;
+        if (!(input >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255) return false;
+        input.get(); // the single whitespace ending the header
+        pixels.resize(static_cast<size_t>(width) * height * 3);
+        return static_cast<bool>(input.read(reinterpret_cast<char*>(pixels.data()), static_cast<std::streamsize>(pixels.size())));
+    }
+
+    bool write(const std::string& path) const {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        output << "P6\n" << width << " " << height << "\n255\n";
+        return static_cast<bool>(output.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size())));
+    }
+};
+
+// Pixel check of an optimized path (--capture-frame N): frame N is rendered into an offscreen
+// target instead of the window, read back, and compared against a golden image (--golden FILE,
+// written from the capture if it does not exist yet), after which the binary exits. GPUs and
+// drivers may filter and rasterize sprite edges slightly differently, so the comparison is
+// tolerant: a pixel differs when a channel is off by more than --golden-tolerance T (default 8),
+// and the frame matches while at most --golden-pixels P percent of them do (default 1). An exact
+// checksum is printed as well, to tell identical images apart at a glance. --capture FILE also
+// saves the frame, e.g. to look at a mismatch. Only deterministic frames are worth comparing, so
+// pair it with --replay.
+class FrameCapture {
+public:
+    FrameCapture(const int argc, char* argv[])
+        : captureFrame(static_cast<uint64_t>(std::max(getIntArg(argc, argv, "--capture-frame", 0), 0L))),
+          goldenPath(getArg(argc, argv, "--golden", "")),
+          capturePath(getArg(argc, argv, "--capture", "")),
+          tolerance(static_cast<int>(std::clamp(getIntArg(argc, argv, "--golden-tolerance", 8), 0L, 255L))),
+          maxDifferingPercent(std::max(getFloatArg(argc, argv, "--golden-pixels", 1.0f), 0.0f)) {}
+
+    bool enabled() const { return captureFrame > 0; }
+    bool captured() const { return isCaptured; }
+    // True if the frame was never captured, e.g. the run ended first, or did not match the golden image
+    bool failed() const { return enabled() && (!isCaptured || mismatch); }
+
+    // Counts the frames from scratch, for binaries that run several times over. A mismatch in an
+    // earlier run still fails.
+    void restart() {
+        frame = 0;
+        isCaptured = false;
+    }
+
+    // Call once per rendered frame. Returns true for the frame to capture, which the binary then
+    // renders offscreen and hands to check() once its pixels are read back.
+    bool beginFrame() { return enabled() && ++frame == captureFrame; }
+
+    // Compares the captured frame, `height` rows of `pitch` bytes starting at the top or, for
+    // render targets read back with a bottom-left origin, at the bottom
+    void check(const uint8_t* pixels, const uint32_t width, const uint32_t height, const size_t pitch, const PixelOrder order, const bool bottomUp) {
+        isCaptured = true;
+        RgbImage image{width, height, std::vector<uint8_t>(static_cast<size_t>(width) * height * 3)};
+        const int red = order == PixelOrder::RGBA ? 0 : 2;
+        const int blue = 2 - red;
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t* row = pixels + (bottomUp ? height - 1 - y : y) * pitch;
+            uint8_t* out = image.pixels.data() + static_cast<size_t>(y) * width * 3;
+            for (uint32_t x = 0; x < width; x++) {
+                out[x * 3 + 0] = row[x * 4 + red];
+                out[x * 3 + 1] = row[x * 4 + 1];
+                out[x * 3 + 2] = row[x * 4 + blue];
+            }
+        }
+
+        uint64_t checksum = 0xcbf29ce484222325ull;
+        for (const uint8_t value : image.pixels) {
+            checksum = (checksum ^ value) * 0x100000001b3ull;
+        }
+        const auto flags = std::cout.flags();
+        const auto precision = std::cout.precision();
+        std::cout << "Frame " << captureFrame << " (" << width << "x" << height << "), checksum "
+            << std::hex << std::setfill('0') << std::setw(16) << checksum << std::setfill(' ');
+        std::cout.flags(flags);
+
+        if (!capturePath.empty() && !image.write(capturePath)) {
+            std::cerr << "Failed to write " << capturePath << std::endl;
+        }
+        if (goldenPath.empty()) {
+            std::cout << std::endl;
+            return;
+        }
+
+        RgbImage golden;
+        if (!golden.read(goldenPath)) {
+            std::cout << ", no golden image yet, " << (image.write(goldenPath) ? "wrote " : "failed to write ")
+                << goldenPath << std::endl;
+            return;
+        }
+        if (golden.width != width || golden.height != height) {
+            mismatch = true;
+            std::cout << ", MISMATCH: " << goldenPath << " is " << golden.width << "x" << golden.height << std::endl;
+            return;
+        }
+
+        size_t differing = 0;
+        int maxDifference = 0;
+        for (size_t i = 0; i < image.pixels.size(); i += 3) {
+            int difference = 0;
+            for (size_t channel = i; channel < i + 3; channel++) {
+                difference = std::max(difference, std::abs(image.pixels[channel] - golden.pixels[channel]));
+            }
+            maxDifference = std::max(maxDifference, difference);
+            differing += difference > tolerance;
+        }
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        mismatch = static_cast<double>(differing) * 100 > maxDifferingPercent * static_cast<double>(pixelCount);
+        std::cout << std::fixed << std::setprecision(3) << ", " << differing << " pixels ("
+            << 100.0 * static_cast<double>(differing) / static_cast<double>(pixelCount) << "%) off by more than "
+            << tolerance << " from " << goldenPath << ", at most " << maxDifference << ": "
+            << (mismatch ? "MISMATCH" : "match") << std::endl;
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+private:
+    uint64_t captureFrame;
+    std::string goldenPath, capturePath;
+    int tolerance;
+    double maxDifferingPercent;
+    uint64_t frame = 0;
+    bool isCaptured = false;
+    bool mismatch = false;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+#include <thread>
+
+// Mean, maximum and standard deviation of a per-frame time over a report window, without
+// keeping the samples
+class TimingStat {
+public:
+    void add(const float millis) {
+        count++;
+        sum += millis;
+        sumSquares += static_cast<double>(millis) * millis;
+        maximum = std::max(maximum, millis);
+    }
+
+    uint32_t samples() const { return count; }
+    double mean() const { return count > 0 ? sum / count : 0; }
+    float max() const { return maximum; }
+
+    double deviation() const {
+        if (count < 2) return 0;
+        const double m = mean();
+        return std::sqrt(std::max(sumSquares / count - m * m, 0.0));
+    }
+
+    // Appends "mean X ms, max Y ms" plus the deviation as jitter if asked for, then starts over
+    void report(std::ostream& out, const bool jitter = false) {
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(2) << "mean " << mean() << " ms, max " << maximum << " ms";
+        if (jitter) {
+            out << ", jitter " << deviation() << " ms";
+        }
+        out.flags(flags);
+        out.precision(precision);
+        *this = {};
+    }
+
+private:
+    uint32_t count = 0;
+    double sum = 0, sumSquares = 0;
+    float maximum = 0;
+};
+
+// Paces frames to a fixed interval (--frame-interval MS) by sleeping before the frame samples its
+// input, so the wait lands before the simulation instead of between it and the present. The OS
+// sleep wakes up late by up to a scheduler tick, so it stops short and spins the rest. A frame that
+// overran starts the schedule over rather than rushing the next ones to catch up.
+class FramePacer {
+public:
+    explicit FramePacer(const float intervalMillis)
+        : interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<float, std::milli>(std::max(intervalMillis, 0.0f)))) {}
+
+    bool enabled() const { return interval.count() > 0; }
+
+    void wait() {
+        if (!enabled()) return;
+        using namespace std::chrono;
+        constexpr auto spinMargin = milliseconds(1);
+        const auto now = steady_clock::now();
+        if (next <= now) {
+            next = now + interval;
+            return;
+        }
+        if (next - now > spinMargin) {
+            std::this_thread::sleep_until(next - spinMargin);
+        }
+        while (steady_clock::now() < next) {
+            std::this_thread::yield();
+        }
+        next += interval;
+    }
+
+private:
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point next{};
+};
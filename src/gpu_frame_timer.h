@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+
+#include "SDL3/SDL_gpu.h"
+
+#include "frame_pacing.h"
+
+// GPU side of the SDL3 GPU frames, which SDL_gpu has no timer queries for. Every frame is
+// submitted with a fence, and the fences are queried without blocking between the phases of
+// the frame, so a completion is seen at the first query after it happened. The GPU is assumed
+// to start on a frame once it is submitted and the previous frame is done, which gives its busy
+// time, the idle gap before it (the CPU did not keep the GPU fed), the time from submit to
+// completion and the number of frames queued ahead of it. The times are upper bounds, as exact
+// as the queries are frequent.
+class GpuFrameTimer {
+public:
+    // More than SDL keeps in flight, so the ring only fills if frames never complete
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 8;
+
+    explicit GpuFrameTimer(SDL_GPUDevice* device) : device(device) {}
+
+    GpuFrameTimer(const GpuFrameTimer&) = delete;
+    GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+    // Submits the command buffer, keeping its fence to time it
+    bool submit(SDL_GPUCommandBuffer* commandBuffer) {
+        poll();
+        if (inFlight == MAX_FRAMES_IN_FLIGHT) {
+            waitForFrames(MAX_FRAMES_IN_FLIGHT - 1);
+        }
+        queueDepthSum += inFlight;
+        queueDepthMax = std::max(queueDepthMax, inFlight);
+        queueDepthSamples++;
+
+        SDL_GPUFence* fence = SDL_SubmitGPUCommandBufferAndAcquireFence(commandBuffer);
+        if (!fence) return false;
+        frames[(first + inFlight) % MAX_FRAMES_IN_FLIGHT] = {fence, std::chrono::steady_clock::now()};
+        inFlight++;
+        return true;
+    }
+
+    // Retires the frames the GPU has finished, oldest first, without blocking
+    void poll() {
+        while (inFlight > 0 && SDL_QueryGPUFence(device, frames[first].fence)) {
+            complete(std::chrono::steady_clock::now());
+        }
+    }
+
+    // Blocks until at most `count` frames are in flight, counting the time as fence wait. Call
+    // with 0 before releasing anything the frames use, and before destroying the device.
+    void waitForFrames(const uint32_t count) {
+        const auto start = std::chrono::steady_clock::now();
+        while (inFlight > count) {
+            SDL_WaitForGPUFences(device, true, &frames[first].fence, 1);
+            complete(std::chrono::steady_clock::now());
+        }
+        waitMillis += millisBetween(start, std::chrono::steady_clock::now());
+    }
+
+    // Appends the GPU estimates since the last call to the FPS line
+    void report(std::ostream& out) {
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << ", GPU busy: ";
+        busy.report(out);
+        out << ", GPU idle: ";
+        idle.report(out);
+        out << ", submit to done: ";
+        submitToDone.report(out);
+        out << std::fixed << std::setprecision(2) << ", queue depth: mean "
+            << (queueDepthSamples > 0 ? static_cast<double>(queueDepthSum) / queueDepthSamples : 0.0)
+            << ", max " << queueDepthMax << ", fence wait: " << waitMillis << " ms";
+        out.flags(flags);
+        out.precision(precision);
+        queueDepthSum = 0;
+        queueDepthSamples = 0;
+        queueDepthMax = 0;
+        waitMillis = 0;
+    }
+
+private:
+    struct Frame {
+        SDL_GPUFence* fence;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    static float millisBetween(const std::chrono::steady_clock::time_point a, const std::chrono::steady_clock::time_point b) {
+        return std::chrono::duration<float, std::milli>(b - a).count();
+    }
+
+    void complete(const std::chrono::steady_clock::time_point done) {
+        const Frame& frame = frames[first];
+        SDL_ReleaseGPUFence(device, frame.fence);
+        const bool hadPrevious = lastDone.time_since_epoch().count() > 0;
+        const auto started = hadPrevious ? std::max(frame.submitted, lastDone) : frame.submitted;
+        busy.add(millisBetween(started, done));
+        if (hadPrevious) {
+            idle.add(millisBetween(lastDone, started));
+        }
+        submitToDone.add(millisBetween(frame.submitted, done));
+        lastDone = done;
+        first = (first + 1) % MAX_FRAMES_IN_FLIGHT;
+        inFlight--;
+    }
+
+    SDL_GPUDevice* device;
+    Frame frames[MAX_FRAMES_IN_FLIGHT]{};
+    uint32_t first = 0, inFlight = 0;
+    std::chrono::steady_clock::time_point lastDone{};
+    TimingStat busy, idle, submitToDone;
+    uint64_t queueDepthSum = 0;
+    uint32_t queueDepthSamples = 0, queueDepthMax = 0;
+    float waitMillis = 0;
+};
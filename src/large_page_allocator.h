@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "alloc_tracker.h"
+
+// Bytes from which an allocation is worth backing with large pages
+constexpr size_t LARGE_PAGE_THRESHOLD = 2 * 1024 * 1024;
+
+// Allocates blocks of at least LARGE_PAGE_THRESHOLD bytes straight from the OS, asking for large
+// pages so that streaming over millions of bunnies does not thrash the TLB. On Linux the mapping
+// is 2 MiB aligned and marked for transparent huge pages. On Windows, large pages need the
+// "Lock pages in memory" privilege, so without it the allocation falls back to regular pages.
+// Smaller blocks go through the regular heap.
+inline void* allocateLargePages(const size_t bytes) {
+    if (bytes < LARGE_PAGE_THRESHOLD) return std::malloc(bytes);
+#if defined(_WIN32)
+    const size_t largePage = GetLargePageMinimum();
+    if (largePage > 0) {
+        const size_t rounded = (bytes + largePage - 1) / largePage * largePage;
+        void* memory = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (memory) return memory;
+    }
+    return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    // Over-allocate by one large page and trim both ends, so the block starts on a huge page boundary
+    const size_t mapped = bytes + LARGE_PAGE_THRESHOLD;
+    void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    const auto start = reinterpret_cast<uintptr_t>(memory);
+    const uintptr_t aligned = (start + LARGE_PAGE_THRESHOLD - 1) & ~(uintptr_t{LARGE_PAGE_THRESHOLD} - 1);
+    if (aligned > start) munmap(memory, aligned - start);
+    const uintptr_t end = start + mapped;
+    const uintptr_t alignedEnd = aligned + bytes;
+    const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t pageEnd = (alignedEnd + pageSize - 1) & ~(pageSize - 1);
+    if (end > pageEnd) munmap(reinterpret_cast<void*>(pageEnd), end - pageEnd);
+#if defined(MADV_HUGEPAGE)
+    madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void*>(aligned);
+#endif
+}
+
+inline void freeLargePages(void* memory, const size_t bytes) {
+    if (!memory) return;
+    if (bytes < LARGE_PAGE_THRESHOLD) {
+        std::free(memory);
+        return;
+    }
+#if defined(_WIN32)
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, bytes);
+#endif
+}
+
+// Standard allocator on top of allocateLargePages, for the containers holding per-bunny state
+template<typename T>
+struct LargePageAllocator {
+    using value_type = T;
+
+    LargePageAllocator() = default;
+    template<typename U>
+    LargePageAllocator(const LargePageAllocator<U>&) noexcept {}
+
+    T* allocate(const size_t count) {
+        allocationTracker.record(AllocSource::LargePages, count * sizeof(T));
+        void* memory = allocateLargePages(count * sizeof(T));
+        if (!memory) throw std::bad_alloc();
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* memory, const size_t count) noexcept {
+        freeLargePages(memory, count * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const LargePageAllocator<U>&) const noexcept { return true; }
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file, so blobs can be handed to the graphics API
+// without being read into an intermediate buffer first. Pages are only faulted in when
+// the API actually touches them.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const char* path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* path) {
+        close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) return false;
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view) return false;
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+        const int file = ::open(path, O_RDONLY);
+        if (file < 0) return false;
+        struct stat fileStat {};
+        if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+            ::close(file);
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (view == MAP_FAILED) return false;
+        mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+        mappedData = static_cast<const uint8_t*>(view);
+        return true;
+    }
+
+    void close() {
+        if (!mappedData) return;
+#if defined(_WIN32)
+        UnmapViewOfFile(mappedData);
+#else
+        munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+
+    bool isOpen() const { return mappedData != nullptr; }
+    const uint8_t* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+
+private:
+    const uint8_t* mappedData = nullptr;
+    size_t mappedSize = 0;
+};
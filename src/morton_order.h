@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+
+#include "args.h"
+#include "bunnies.h"
+#include "frame_arena.h"
+#include "sprite_sort.h"
+
+// Side of the square cells positions are quantized to before their bits are interleaved, four
+// bunnies wide. A cell of the framebuffer is 64 KiB at 4 bytes per pixel, which stays in cache
+// while its bunnies are filled in any order, and coarse cells are crossed rarely enough that
+// the store stays nearly sorted between reorders at the default speeds.
+constexpr float MORTON_CELL_SIZE = 4 * BUNNY_SIZE;
+
+// Spreads the low 16 bits of `v` over its even bits
+inline uint32_t mortonSpread(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Z-order (Morton) code of a position: the bits of its cell's column and row interleaved, so cells
+// that are close together mostly get codes that are close together
+inline uint32_t mortonCode(const float x, const float y) {
+    const auto column = static_cast<uint32_t>(std::clamp(x / MORTON_CELL_SIZE, 0.0f, 65535.0f));
+    const auto row = static_cast<uint32_t>(std::clamp(y / MORTON_CELL_SIZE, 0.0f, 65535.0f));
+    return mortonSpread(column) | mortonSpread(row) << 1;
+}
+
+// Spatial reordering (--morton N): every N simulation steps the bunny store is put into Z-order of
+// the bunnies' positions, so sprites filled in store order are drawn close to each other and hit the
+// same framebuffer cache lines. Between reorders the bunnies only move a little, so the store stays
+// nearly sorted. A single pass keeps a sorted run, setting aside every bunny that breaks it along
+// with the one it broke, and only those few are sorted and merged back in. When more than one in
+// MAX_DISPLACED_SHARE is out of place, like on the first reorder or after churn appended new
+// bunnies, the whole store is radix sorted instead. --ablate measures what the order gains.
+class MortonOrder {
+public:
+    static constexpr size_t MAX_DISPLACED_SHARE = 4;
+
+    MortonOrder(const int argc, char* argv[], SpriteSorter& sorter)
+        : interval(static_cast<uint32_t>(std::max(getIntArg(argc, argv, "--morton", 0), 0L))), sorter(sorter) {}
+
+    bool enabled() const { return interval > 0; }
+
+    // Call once per simulation step, before the snapshot and update. Reorders every `interval` steps,
+    // with the keys and the new order in `arena`.
+    void update(Bunnies& bunnies, FrameArena& arena) {
+        if (!enabled() || ++step % interval != 0) return;
+        const auto start = std::chrono::steady_clock::now();
+        const size_t count = bunnies.size();
+
+        uint32_t* keys = arena.allocate<uint32_t>(count);
+        for (size_t i = 0; i < count; i++) {
+            keys[i] = mortonCode(bunnies.x[i], bunnies.y[i]);
+        }
+
+        // Split into a sorted run and the bunnies set aside, giving up once too many are
+        const size_t maxDisplaced = count / MAX_DISPLACED_SHARE;
+        uint32_t* kept = arena.allocate<uint32_t>(count);
+        uint32_t* displaced = arena.allocate<uint32_t>(count);
+        size_t keptCount = 0, displacedCount = 0;
+        for (uint32_t i = 0; i < count && displacedCount <= maxDisplaced; i++) {
+            if (keptCount > 0 && keys[i] < keys[kept[keptCount - 1]]) {
+                displaced[displacedCount++] = kept[--keptCount];
+                displaced[displacedCount++] = i;
+            } else {
+                kept[keptCount++] = i;
+            }
+        }
+
+        const uint32_t* order = nullptr;
+        if (displacedCount > maxDisplaced) {
+            order = sorter.sort(arena, nullptr, count, [&](const uint32_t index) {
+                return uint64_t{keys[index]};
+            });
+            displacedTotal += count;
+            fullSorts++;
+        } else if (displacedCount > 0) {
+            const auto byKey = [&](const uint32_t a, const uint32_t b) { return keys[a] < keys[b]; };
+            std::sort(displaced, displaced + displacedCount, byKey);
+            uint32_t* merged = arena.allocate<uint32_t>(count);
+            std::merge(kept, kept + keptCount, displaced, displaced + displacedCount, merged, byKey);
+            order = merged;
+            displacedTotal += displacedCount;
+        }
+
+        if (order) {
+            gather(bunnies.x, order, count);
+            gather(bunnies.y, order, count);
+            gather(bunnies.vx, order, count);
+            gather(bunnies.vy, order, count);
+        }
+        reorders++;
+        millis += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Appends the reorders since the last call to the FPS line
+    void report(std::ostream& out) {
+        if (!enabled()) return;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(3) << ", morton: " << reorders << " reorders, "
+            << (reorders > 0 ? millis / reorders : 0.0) << " ms each, "
+            << (reorders > 0 ? displacedTotal / reorders : 0) << " bunnies moved each, " << fullSorts << " full sorts";
+        out.flags(flags);
+        out.precision(precision);
+        reorders = 0;
+        fullSorts = 0;
+        displacedTotal = 0;
+        millis = 0;
+    }
+
+private:
+    // Puts `values` into `order`, swapping the result in so the scratch array is reused by the next one
+    void gather(BunnyArray& values, const uint32_t* order, const size_t count) {
+        scratch.resize(count);
+        const float* __restrict in = values.data();
+        float* __restrict out = scratch.data();
+        for (size_t i = 0; i < count; i++) {
+            out[i] = in[order[i]];
+        }
+        values.swap(scratch);
+    }
+
+    uint32_t interval;
+    SpriteSorter& sorter;
+    BunnyArray scratch;
+    uint32_t step = 0;
+    uint32_t reorders = 0, fullSorts = 0;
+    size_t displacedTotal = 0;
+    double millis = 0;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+#include <vector>
+
+#include "args.h"
+#include "bunnies.h"
+#include "frame_arena.h"
+#include "world.h"
+
+// Largest rectangle of fully opaque texels of an RGBA8 image, as [left, right) x [top, bottom)
+struct OpaqueRect {
+    int left = 0, top = 0, right = 0, bottom = 0;
+};
+
+inline OpaqueRect findOpaqueRect(const uint8_t* rgba, const int width, const int height) {
+    // Per row, the run of opaque texels ending there in every column, then the widest span of
+    // columns at least as tall as each of them
+    OpaqueRect best;
+    std::vector<int> runs(width, 0);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            runs[x] = rgba[(static_cast<size_t>(y) * width + x) * 4 + 3] == 255 ? runs[x] + 1 : 0;
+        }
+        for (int x = 0; x < width; x++) {
+            int left = x, right = x + 1;
+            while (left > 0 && runs[left - 1] >= runs[x]) left--;
+            while (right < width && runs[right] >= runs[x]) right++;
+            if ((right - left) * runs[x] > (best.right - best.left) * (best.bottom - best.top)) {
+                best = {left, y + 1 - runs[x], right, y + 1};
+            }
+        }
+    }
+    return best;
+}
+
+// Occlusion culling on the CPU (--occlusion-cull): the view is split into square tiles
+// (--occlusion-tile N pixels, default 8), and the sprites are walked from the last drawn to the
+// first. A sprite whose footprint only touches tiles already covered by the opaque core of later
+// sprites is dropped, otherwise it marks the tiles lying completely within its own core as
+// covered. Cores shrink by a texel on every side so filtering at their edges cannot let anything
+// shine through, which keeps the test conservative for opaque and alpha-tested sprites.
+class OcclusionCuller {
+public:
+    OcclusionCuller(const int argc, char* argv[], const float viewWidth, const float viewHeight)
+        : active(hasArg(argc, argv, "--occlusion-cull")),
+          tileSize(static_cast<float>(std::max(getIntArg(argc, argv, "--occlusion-tile", 8), 1L))),
+          tilesPerPixel(1.0f / tileSize),
+          viewWidth(viewWidth),
+          viewHeight(viewHeight),
+          columns(std::max(1, static_cast<int>(std::ceil(viewWidth * tilesPerPixel)))),
+          rows(std::max(1, static_cast<int>(std::ceil(viewHeight * tilesPerPixel)))),
+          wordsPerRow((columns + 63) / 64),
+          covered(static_cast<size_t>(wordsPerRow) * rows) {}
+
+    bool enabled() const { return active; }
+
+    // The sprite every bunny is drawn with: `width` x `height` pixels of `rgba` at 1:1, with its
+    // top-left corner `anchorX`, `anchorY` pixels up and left of the bunny's position
+    void setSprite(const uint8_t* rgba, const uint32_t width, const uint32_t height, const float anchorX, const float anchorY) {
+        spriteWidth = static_cast<float>(width);
+        spriteHeight = static_cast<float>(height);
+        offsetX = anchorX;
+        offsetY = anchorY;
+        const OpaqueRect opaque = findOpaqueRect(rgba, static_cast<int>(width), static_cast<int>(height));
+        hasCore = opaque.right - opaque.left > 2 && opaque.bottom - opaque.top > 2;
+        coreLeft = static_cast<float>(opaque.left + 1);
+        coreTop = static_cast<float>(opaque.top + 1);
+        coreRight = static_cast<float>(opaque.right - 1);
+        coreBottom = static_cast<float>(opaque.bottom - 1);
+    }
+
+    // Drops the hidden ones of the `count` sprites drawn in `order` (or 0..count-1 when null)
+    // and returns the rest, still in draw order, setting `count` to how many there are. The
+    // result lives in `arena`, so it is valid as long as its frame is.
+    const uint32_t* cull(FrameArena& arena, const Bunnies& bunnies, const Camera& camera, const uint32_t* order, uint32_t& count) {
+        const auto start = std::chrono::steady_clock::now();
+        std::fill(covered.begin(), covered.end(), 0);
+        size_t uncoveredTiles = static_cast<size_t>(columns) * rows;
+
+        // Kept sprites are written from the back, as they are found front to back
+        uint32_t* kept = arena.allocate<uint32_t>(count);
+        uint32_t first = count;
+        for (uint32_t i = count; i-- > 0 && uncoveredTiles > 0;) {
+            const uint32_t index = order ? order[i] : i;
+            const float left = bunnies.x[index] - camera.x - offsetX;
+            const float top = bunnies.y[index] - camera.y - offsetY;
+            if (left >= viewWidth || top >= viewHeight || left + spriteWidth <= 0 || top + spriteHeight <= 0) {
+                continue;
+            }
+            if (isCovered(left, top, left + spriteWidth, top + spriteHeight)) {
+                continue;
+            }
+            kept[--first] = index;
+            if (hasCore) {
+                uncoveredTiles -= cover(left + coreLeft, top + coreTop, left + coreRight, top + coreBottom);
+            }
+        }
+
+        hiddenTotal += first;
+        drawnTotal += count;
+        frames++;
+        millis += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        count -= first;
+        return kept + first;
+    }
+
+    // Appends the share of sprites culled since the last call to the FPS line
+    void report(std::ostream& out) {
+        if (!active) return;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(1) << ", occluded: "
+            << (drawnTotal > 0 ? 100.0 * static_cast<double>(hiddenTotal) / static_cast<double>(drawnTotal) : 0.0) << "%"
+            << std::setprecision(3) << " in " << (frames > 0 ? millis / frames : 0.0) << " ms/frame";
+        out.flags(flags);
+        out.precision(precision);
+        hiddenTotal = 0;
+        drawnTotal = 0;
+        frames = 0;
+        millis = 0;
+    }
+
+private:
+    int clampColumn(const int column) const { return std::clamp(column, 0, columns - 1); }
+    int clampRow(const int row) const { return std::clamp(row, 0, rows - 1); }
+
+    // Bits `first` to `last` of a row's word `word`, both inclusive and clipped to the word
+    static uint64_t wordMask(const int word, const int first, const int last) {
+        const int low = std::max(first - word * 64, 0);
+        const int high = std::min(last - word * 64, 63);
+        return (~0ull >> (63 - high)) & (~0ull << low);
+    }
+
+    // True if every tile the rectangle touches is covered
+    bool isCovered(const float left, const float top, const float right, const float bottom) const {
+        const int firstColumn = clampColumn(static_cast<int>(std::floor(left * tilesPerPixel)));
+        const int lastColumn = clampColumn(static_cast<int>(std::ceil(right * tilesPerPixel)) - 1);
+        const int firstRow = clampRow(static_cast<int>(std::floor(top * tilesPerPixel)));
+        const int lastRow = clampRow(static_cast<int>(std::ceil(bottom * tilesPerPixel)) - 1);
+        for (int row = firstRow; row <= lastRow; row++) {
+            const uint64_t* tiles = covered.data() + static_cast<size_t>(row) * wordsPerRow;
+            for (int word = firstColumn / 64; word <= lastColumn / 64; word++) {
+                const uint64_t mask = wordMask(word, firstColumn, lastColumn);
+                if ((tiles[word] & mask) != mask) return false;
+            }
+        }
+        return true;
+    }
+
+    // Marks the tiles lying completely within the rectangle as covered, where the last column and
+    // row end at the view's edge. Returns how many were not covered before.
+    size_t cover(const float left, const float top, const float right, const float bottom) {
+        const int firstColumn = std::max(static_cast<int>(std::ceil(left * tilesPerPixel)), 0);
+        const int lastColumn = right >= viewWidth ? columns - 1 : static_cast<int>(std::floor(right * tilesPerPixel)) - 1;
+        const int firstRow = std::max(static_cast<int>(std::ceil(top * tilesPerPixel)), 0);
+        const int lastRow = bottom >= viewHeight ? rows - 1 : static_cast<int>(std::floor(bottom * tilesPerPixel)) - 1;
+        size_t newlyCovered = 0;
+        if (firstColumn > lastColumn) return 0;
+        for (int row = firstRow; row <= lastRow; row++) {
+            uint64_t* tiles = covered.data() + static_cast<size_t>(row) * wordsPerRow;
+            for (int word = firstColumn / 64; word <= lastColumn / 64; word++) {
+                const uint64_t mask = wordMask(word, firstColumn, lastColumn);
+                newlyCovered += std::popcount(mask & ~tiles[word]);
+                tiles[word] |= mask;
+            }
+        }
+        return newlyCovered;
+    }
+
+    bool active;
+    float tileSize, tilesPerPixel;
+    float viewWidth, viewHeight;
+    int columns, rows;
+    int wordsPerRow;
+    std::vector<uint64_t> covered; // a bit per tile, rows padded to whole words
+    float spriteWidth = 0, spriteHeight = 0;
+    float offsetX = 0, offsetY = 0;
+    bool hasCore = false;
+    float coreLeft = 0, coreTop = 0, coreRight = 0, coreBottom = 0;
+    uint64_t hiddenTotal = 0, drawnTotal = 0;
+    uint32_t frames = 0;
+    double millis = 0;
+};
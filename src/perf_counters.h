@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <iterator>
+#include <ostream>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Parts of the frame the hardware counters are read around
+enum class PerfPhase : uint8_t { Simulate, Fill, Submit, Count };
+constexpr const char* PERF_PHASE_NAMES[] = {"simulate", "fill", "submit"};
+
+enum class PerfEvent : uint8_t { Cycles, Instructions, L1Misses, LlcMisses, BranchMisses, DtlbMisses, Count };
+constexpr const char* PERF_EVENT_NAMES[] = {"cycles", "instructions", "L1 misses", "LLC misses", "branch misses", "dTLB misses"};
+
+// Hardware performance counters of the calling thread, opened as one perf_event_open group so
+// they are scheduled together, and read around each phase of the frame. Worker threads of the
+// pool are not counted. Events the CPU or VM lacks are left out, and if the group cannot be
+// opened at all, e.g. in a container or with a strict kernel.perf_event_paranoid, the counters
+// stay unavailable and every call is a no-op. Counts are scaled up if the kernel had to
+// multiplex the group.
+class PerfCounters {
+public:
+    explicit PerfCounters(const bool enabled) {
+        if (enabled) open();
+    }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (const int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return fds[0] >= 0; }
+
+    void begin(const PerfPhase phase) {
+        if (available()) read(phaseStart[static_cast<size_t>(phase)]);
+    }
+
+    // Adds the counts since begin(phase), over `items` bunnies processed in it
+    void end(const PerfPhase phase, const uint64_t items) {
+        if (!available()) return;
+        uint64_t now[static_cast<size_t>(PerfEvent::Count)]{};
+        if (!read(now)) return;
+        const auto p = static_cast<size_t>(phase);
+        for (size_t e = 0; e < std::size(now); e++) {
+            totals[p][e] += now[e] - phaseStart[p][e];
+        }
+        itemCounts[p] += items;
+    }
+
+    // Prints IPC and per-bunny counts of every phase since the last report, then resets them
+    void report(std::ostream& out) {
+        if (!available()) return;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed;
+        for (size_t p = 0; p < std::size(totals); p++) {
+            const uint64_t* counts = totals[p];
+            if (counts[0] == 0 && itemCounts[p] == 0) continue;
+            const double items = static_cast<double>(itemCounts[p] > 0 ? itemCounts[p] : 1);
+            out << "Perf " << PERF_PHASE_NAMES[p] << ": IPC " << std::setprecision(2);
+            if (counts[0] > 0 && fds[1] >= 0) {
+                out << static_cast<double>(counts[1]) / static_cast<double>(counts[0]);
+            } else {
+                out << "n/a";
+            }
+            out << ", per bunny:";
+            for (size_t e = 0; e < std::size(totals[p]); e++) {
+                if (e == static_cast<size_t>(PerfEvent::Instructions) || fds[e] < 0) continue;
+                out << (e == 0 ? " " : ", ") << std::setprecision(e == 0 ? 1 : 4)
+                    << static_cast<double>(counts[e]) / items << " " << PERF_EVENT_NAMES[e];
+            }
+            out << std::endl;
+            std::fill(std::begin(totals[p]), std::end(totals[p]), 0);
+            itemCounts[p] = 0;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    void open() {
+#if defined(__linux__)
+        constexpr auto cacheMiss = [](const uint64_t cache) {
+            return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        };
+        const struct { uint32_t type; uint64_t config; } events[] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB)},
+        };
+        for (size_t e = 0; e < std::size(events); e++) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = events[e].type;
+            attr.config = events[e].config;
+            attr.disabled = e == 0;
+            attr.exclude_kernel = 1; // allowed up to perf_event_paranoid 2
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, e == 0 ? -1 : fds[0], 0));
+            if (fds[0] < 0) {
+                std::cerr << "Performance counters unavailable (" << std::strerror(errno)
+                    << "), check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+                return;
+            }
+            if (fds[e] >= 0) slots[e] = openCount++;
+        }
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+        std::cerr << "Performance counters are only supported on Linux" << std::endl;
+#endif
+    }
+
+    bool read(uint64_t (&counts)[static_cast<size_t>(PerfEvent::Count)]) const {
+#if defined(__linux__)
+        // nr, time enabled, time running, then one value per opened event in group order
+        uint64_t buffer[3 + static_cast<size_t>(PerfEvent::Count)];
+        if (::read(fds[0], buffer, sizeof(buffer)) < static_cast<ssize_t>((3 + openCount) * sizeof(uint64_t))) return false;
+        const uint64_t enabled = buffer[1], running = buffer[2];
+        for (size_t e = 0; e < std::size(counts); e++) {
+            if (slots[e] < 0) continue;
+            const uint64_t value = buffer[3 + slots[e]];
+            counts[e] = running > 0 && running < enabled
+                ? static_cast<uint64_t>(static_cast<double>(value) * enabled / running)
+                : value;
+        }
+        return true;
+#else
+        (void)counts;
+        return false;
+#endif
+    }
+
+    int fds[static_cast<size_t>(PerfEvent::Count)] = {-1, -1, -1, -1, -1, -1};
+    int slots[static_cast<size_t>(PerfEvent::Count)] = {-1, -1, -1, -1, -1, -1}; // index in a group read
+    int openCount = 0;
+    uint64_t phaseStart[static_cast<size_t>(PerfPhase::Count)][static_cast<size_t>(PerfEvent::Count)]{};
+    uint64_t totals[static_cast<size_t>(PerfPhase::Count)][static_cast<size_t>(PerfEvent::Count)]{};
+    uint64_t itemCounts[static_cast<size_t>(PerfPhase::Count)]{};
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// On-disk cache of compiled pipeline/shader blobs, one file per 64-bit id under a
+// directory per device, so switching GPUs or drivers never feeds back incompatible
+// blobs. Reads and writes may come from the renderer's own thread.
+class PipelineCache {
+public:
+    explicit PipelineCache(std::filesystem::path root) : root(std::move(root)) {}
+
+    // Selects the device subdirectory, called once the device is known. Until then the
+    // cache misses and drops writes.
+    void setDevice(const std::string_view deviceKey) {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash(deviceKey)));
+        deviceDirectory = root / name;
+        std::error_code error;
+        std::filesystem::create_directories(deviceDirectory, error);
+    }
+
+    // Removes every cached blob of every device, for measuring a cold start
+    void clear() const {
+        std::error_code error;
+        std::filesystem::remove_all(root, error);
+    }
+
+    uint32_t readSize(const uint64_t id) {
+        std::error_code error;
+        const auto size = deviceDirectory.empty() ? 0 : std::filesystem::file_size(pathOf(id), error);
+        if (deviceDirectory.empty() || error) {
+            misses++;
+            return 0;
+        }
+        return static_cast<uint32_t>(size);
+    }
+
+    bool read(const uint64_t id, void* data, const uint32_t size) {
+        std::ifstream stream(pathOf(id), std::ios::binary);
+        const bool ok = !deviceDirectory.empty() && stream.read(static_cast<char*>(data), size).gcount() == size;
+        ok ? hits++ : misses++;
+        return ok;
+    }
+
+    void write(const uint64_t id, const void* data, const uint32_t size) {
+        if (deviceDirectory.empty()) return;
+
+        // Write to a temporary file first, so a crash never leaves a truncated blob behind
+        const std::filesystem::path path = pathOf(id);
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+            if (!stream.write(static_cast<const char*>(data), size)) return;
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        writes++;
+    }
+
+    // Whether any blob is cached for the current device
+    bool hasEntries() const {
+        std::error_code error;
+        if (deviceDirectory.empty()) return false;
+        for (const auto& entry : std::filesystem::directory_iterator(deviceDirectory, error)) {
+            if (entry.path().extension() == ".bin") return true;
+        }
+        return false;
+    }
+
+    // Remembers the startup time of the last cold and the last warm run on this device,
+    // so either kind of run can show both
+    void recordStartup(const bool warm, const float millis) const {
+        if (deviceDirectory.empty()) return;
+        std::ofstream(startupPathOf(warm), std::ios::binary | std::ios::trunc)
+            .write(reinterpret_cast<const char*>(&millis), sizeof(millis));
+    }
+
+    // Negative if there was no such run yet
+    float previousStartup(const bool warm) const {
+        float millis = -1;
+        if (!deviceDirectory.empty()) {
+            std::ifstream(startupPathOf(warm), std::ios::binary).read(reinterpret_cast<char*>(&millis), sizeof(millis));
+        }
+        return millis;
+    }
+
+    // Prints the cache activity of this run next to the last cold and warm startup times,
+    // then records this run's startup time. Binaries that cannot tell the cache state name the
+    // two kinds of run differently.
+    void reportStartup(const bool warm, const float millis, const char* coldName = "cold start", const char* warmName = "warm start") const {
+        const float lastCold = warm ? previousStartup(false) : millis;
+        const float lastWarm = warm ? millis : previousStartup(true);
+        auto formatMillis = [](const float value) {
+            return value < 0 ? std::string("n/a") : std::to_string(value) + " ms";
+        };
+        std::cout << "Pipeline cache: " << hits << " hits, " << misses << " misses, " << writes << " writes"
+            << ", " << coldName << ": " << formatMillis(lastCold) << ", " << warmName << ": " << formatMillis(lastWarm) << std::endl;
+        recordStartup(warm, millis);
+    }
+
+    bool contains(const uint64_t id) const {
+        std::error_code error;
+        return !deviceDirectory.empty() && std::filesystem::exists(pathOf(id), error);
+    }
+
+    uint32_t hitCount() const { return hits; }
+    uint32_t missCount() const { return misses; }
+    uint32_t writeCount() const { return writes; }
+
+    // FNV-1a, for keying blobs and devices
+    static uint64_t hash(const std::string_view bytes, uint64_t seed = 0xcbf29ce484222325ull) {
+        for (const char c : bytes) {
+            seed = (seed ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+        }
+        return seed;
+    }
+
+private:
+    std::filesystem::path pathOf(const uint64_t id) const {
+        char name[21];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(id));
+        return deviceDirectory / name;
+    }
+
+    std::filesystem::path startupPathOf(const bool warm) const {
+        return deviceDirectory / (warm ? "startup_warm" : "startup_cold");
+    }
+
+    std::filesystem::path root;
+    std::filesystem::path deviceDirectory;
+    std::atomic<uint32_t> hits = 0, misses = 0, writes = 0;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Uniform grid over the world, rebuilt from scratch every frame with a counting sort.
+// Bunnies are binned by their anchor position only, so queries should be padded by the
+// sprite size to also catch sprites that overlap into the queried area.
+class SpatialGrid {
+public:
+    SpatialGrid(const float worldWidth, const float worldHeight, const float cellSize)
+        : cellSize(cellSize),
+          columns(std::max(1, static_cast<int>(std::ceil(worldWidth / cellSize)))),
+          rows(std::max(1, static_cast<int>(std::ceil(worldHeight / cellSize)))),
+          cellStart(static_cast<size_t>(columns) * rows + 1),
+          cellCursor(static_cast<size_t>(columns) * rows) {}
+
+    void build(const float* xs, const float* ys, const size_t count) {
+        cellOf.resize(count);
+        items.resize(count);
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t cell = cellIndex(xs[i], ys[i]);
+            cellOf[i] = cell;
+            cellStart[cell + 1]++;
+        }
+        for (size_t cell = 1; cell < cellStart.size(); cell++) {
+            cellStart[cell] += cellStart[cell - 1];
+        }
+
+        std::copy(cellStart.begin(), cellStart.end() - 1, cellCursor.begin());
+        for (size_t i = 0; i < count; i++) {
+            items[cellCursor[cellOf[i]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Writes the indices of all bunnies in cells intersecting the rectangle to `out`,
+    // which must have room for every bunny. Returns the number of indices written.
+    size_t query(const float minX, const float minY, const float maxX, const float maxY, uint32_t* out) const {
+        const int firstColumn = clampColumn(minX);
+        const int lastColumn = clampColumn(maxX);
+        const int firstRow = clampRow(minY);
+        const int lastRow = clampRow(maxY);
+
+        // Cells of a row are contiguous, so each row is a single copy
+        size_t count = 0;
+        for (int row = firstRow; row <= lastRow; row++) {
+            const uint32_t begin = cellStart[row * columns + firstColumn];
+            const uint32_t end = cellStart[row * columns + lastColumn + 1];
+            std::memcpy(out + count, items.data() + begin, (end - begin) * sizeof(uint32_t));
+            count += end - begin;
+        }
+        return count;
+    }
+
+private:
+    int clampColumn(const float x) const {
+        return std::clamp(static_cast<int>(std::floor(x / cellSize)), 0, columns - 1);
+    }
+
+    int clampRow(const float y) const {
+        return std::clamp(static_cast<int>(std::floor(y / cellSize)), 0, rows - 1);
+    }
+
+    uint32_t cellIndex(const float x, const float y) const {
+        return clampRow(y) * columns + clampColumn(x);
+    }
+
+    float cellSize;
+    int columns, rows;
+    std::vector<uint32_t> cellStart;  // prefix sums, items of cell c are [cellStart[c], cellStart[c + 1])
+    std::vector<uint32_t> cellCursor;
+    std::vector<uint32_t> cellOf;
+    std::vector<uint32_t> items;
+};
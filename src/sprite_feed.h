@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ios>
+#include <iostream>
+#include <ostream>
+#include <string>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "args.h"
+#include "bunnies.h"
+
+// Ring of sprite position frames in POSIX shared memory, written by a bunnymark_feeder process
+// and read by a renderer (--feed NAME). The ring starts with a SpriteFeedHeader, padded to 64
+// bytes, followed by SLOT_COUNT slots, each a SpriteFeedSlot followed by the x and then the y
+// positions of up to `capacity` sprites. There are no locks: every slot is a seqlock whose
+// sequence is odd while the feeder writes it and 2 * N once frame N is complete, and the header
+// holds the number of the latest complete frame. A reader takes that frame's slot, reads the
+// positions straight out of it and checks the sequence again afterwards. The feeder only comes
+// back to the slot SLOT_COUNT - 1 frames later, so a reader that falls this far behind gets a
+// torn frame, which is counted rather than retried. Publish times are steady_clock nanoseconds,
+// a system-wide monotonic clock on Linux and macOS, so they can be compared across processes.
+struct SpriteFeedHeader {
+    static constexpr uint32_t MAGIC = 0x44464e42; // "BNFD"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t SLOT_COUNT = 4;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t capacity;
+    std::atomic<uint64_t> latest; // 0 until the first frame is published
+};
+
+struct alignas(64) SpriteFeedSlot {
+    std::atomic<uint64_t> sequence;
+    uint64_t publishNanos;
+    uint32_t count;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sprite feed needs lock-free 64-bit atomics");
+
+constexpr size_t SPRITE_FEED_HEADER_BYTES = 64;
+
+inline size_t spriteFeedSlotBytes(const uint32_t capacity) {
+    return (sizeof(SpriteFeedSlot) + size_t{capacity} * 2 * sizeof(float) + 63) & ~size_t{63};
+}
+
+inline size_t spriteFeedBytes(const uint32_t capacity) {
+    return SPRITE_FEED_HEADER_BYTES + SpriteFeedHeader::SLOT_COUNT * spriteFeedSlotBytes(capacity);
+}
+
+inline uint64_t spriteFeedNanos() {
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+// A mapping of the ring, from either side
+class SpriteFeedRing {
+public:
+    SpriteFeedRing() = default;
+    ~SpriteFeedRing() { close(); }
+
+    SpriteFeedRing(const SpriteFeedRing&) = delete;
+    SpriteFeedRing& operator=(const SpriteFeedRing&) = delete;
+
+    // Creates the ring for `capacity` sprites per frame, replacing any left behind by a feeder that was killed
+    bool create(const char* name, const uint32_t capacity) {
+        close();
+#if defined(_WIN32)
+        (void)name;
+        (void)capacity;
+        return false;
+#else
+        shm_unlink(name);
+        const int file = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (file < 0) return false;
+        const size_t bytes = spriteFeedBytes(capacity);
+        if (ftruncate(file, static_cast<off_t>(bytes)) != 0 || !map(file, bytes, true)) {
+            ::close(file);
+            shm_unlink(name);
+            return false;
+        }
+        ::close(file);
+        SpriteFeedHeader& ringHeader = header();
+        ringHeader.version = SpriteFeedHeader::VERSION;
+        ringHeader.slotCount = SpriteFeedHeader::SLOT_COUNT;
+        ringHeader.capacity = capacity;
+        ringHeader.latest.store(0, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < SpriteFeedHeader::SLOT_COUNT; i++) {
+            slot(i).sequence.store(0, std::memory_order_relaxed);
+        }
+        // The magic goes last, a reader that opens the ring any earlier turns it down and tries again
+        std::atomic_thread_fence(std::memory_order_release);
+        ringHeader.magic = SpriteFeedHeader::MAGIC;
+        unlinkName = name;
+        return true;
+#endif
+    }
+
+    // Maps an existing ring read-only. Fails until its feeder has finished setting it up.
+    bool open(const char* name) {
+        close();
+#if defined(_WIN32)
+        (void)name;
+        return false;
+#else
+        const int file = shm_open(name, O_RDONLY, 0);
+        if (file < 0) return false;
+        struct stat fileStat {};
+        const bool mapped = fstat(file, &fileStat) == 0
+            && static_cast<size_t>(fileStat.st_size) >= SPRITE_FEED_HEADER_BYTES
+            && map(file, static_cast<size_t>(fileStat.st_size), false);
+        ::close(file);
+        if (!mapped) return false;
+        const SpriteFeedHeader& ringHeader = header();
+        const bool valid = ringHeader.magic == SpriteFeedHeader::MAGIC && ringHeader.version == SpriteFeedHeader::VERSION
+            && ringHeader.slotCount == SpriteFeedHeader::SLOT_COUNT && mappedSize >= spriteFeedBytes(ringHeader.capacity);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!valid) close();
+        return valid;
+#endif
+    }
+
+    // Unmaps the ring, and removes its name if this side created it
+    void close() {
+        if (!base) return;
+#if !defined(_WIN32)
+        munmap(base, mappedSize);
+        if (!unlinkName.empty()) {
+            shm_unlink(unlinkName.c_str());
+            unlinkName.clear();
+        }
+#endif
+        base = nullptr;
+        mappedSize = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    SpriteFeedHeader& header() const { return *reinterpret_cast<SpriteFeedHeader*>(base); }
+    SpriteFeedSlot& slot(const uint64_t index) const {
+        return *reinterpret_cast<SpriteFeedSlot*>(
+            base + SPRITE_FEED_HEADER_BYTES + index % SpriteFeedHeader::SLOT_COUNT * spriteFeedSlotBytes(header().capacity));
+    }
+    float* xs(const uint64_t index) const { return reinterpret_cast<float*>(&slot(index) + 1); }
+    float* ys(const uint64_t index) const { return xs(index) + header().capacity; }
+
+    // Writes the positions of `count` sprites (at most the capacity) as the next frame, and returns its number
+    uint64_t publish(const float* x, const float* y, const uint32_t count) {
+        SpriteFeedHeader& ringHeader = header();
+        const uint64_t number = ringHeader.latest.load(std::memory_order_relaxed) + 1;
+        SpriteFeedSlot& target = slot(number);
+        target.sequence.store(number * 2 - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        target.count = std::min(count, ringHeader.capacity);
+        std::memcpy(xs(number), x, target.count * sizeof(float));
+        std::memcpy(ys(number), y, target.count * sizeof(float));
+        target.publishNanos = spriteFeedNanos();
+        target.sequence.store(number * 2, std::memory_order_release);
+        ringHeader.latest.store(number, std::memory_order_release);
+        return number;
+    }
+
+private:
+#if !defined(_WIN32)
+    bool map(const int file, const size_t bytes, const bool writable) {
+        void* view = mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+        if (view == MAP_FAILED) return false;
+        base = static_cast<uint8_t*>(view);
+        mappedSize = bytes;
+        return true;
+    }
+#endif
+
+    uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+    std::string unlinkName;
+};
+
+// A frame of the feed, pointing straight into shared memory
+struct FeedFrame {
+    const float* x = nullptr;
+    const float* y = nullptr;
+    uint32_t count = 0;
+    uint64_t number = 0;
+    uint64_t publishNanos = 0;
+};
+
+// Renderer side of the feed (--feed NAME): the sprites drawn are the positions a bunnymark_feeder
+// process publishes, filled from the ring right into the mapped upload buffers, and the local
+// bunnies are neither simulated nor culled or sorted. The ring is opened once the feeder has
+// created it, until then nothing is drawn. The FPS line gets the frames received from the feeder,
+// the ones it published in between that were never drawn, the frames that drew a feed frame
+// again, torn reads, the handoff latency from publish to the end of the fill, and the throughput.
+class SpriteFeed {
+public:
+    SpriteFeed(const int argc, char* argv[])
+        : name(getArg(argc, argv, "--feed", "")) {
+        if (!enabled()) return;
+#if defined(_WIN32)
+        std::cerr << "--feed needs POSIX shared memory, ignored" << std::endl;
+        name.clear();
+#else
+        std::cout << "Sprites from bunnymark_feeder on " << name
+            << ", without local simulation, culling, sorting and --tick-rate" << std::endl;
+#endif
+    }
+
+    bool enabled() const { return !name.empty(); }
+
+    // Call once per frame right before the fill. Points `frame` at the feeder's latest frame and
+    // returns true if it is a new one, to be filled and then handed to release(). Otherwise `frame`
+    // is the last one again, which the upload buffers still hold. Its slot is not read again, the
+    // feeder may be rewriting it by then, so the buffers have to persist across frames.
+    bool acquire(FeedFrame& frame) {
+        frame = last;
+        if (!ring.isOpen() && !ring.open(name.c_str())) {
+            if (!waiting) {
+                std::cout << "Waiting for bunnymark_feeder on " << name << std::endl;
+                waiting = true;
+            }
+            return false;
+        }
+        const uint64_t number = ring.header().latest.load(std::memory_order_acquire);
+        if (number == 0) return false;
+        if (number == last.number) {
+            repeated++;
+            return false;
+        }
+        const SpriteFeedSlot& slot = ring.slot(number);
+        if (slot.sequence.load(std::memory_order_acquire) != number * 2) {
+            // Already overwritten, drop it and pick up the next one
+            torn++;
+            return false;
+        }
+        if (last.number > 0 && number > last.number + 1) {
+            missed += number - last.number - 1;
+        }
+        last = {
+            .x = ring.xs(number),
+            .y = ring.ys(number),
+            .count = std::min({slot.count, ring.header().capacity, MAX_BUNNIES}),
+            .number = number,
+            .publishNanos = slot.publishNanos
+        };
+        frame = last;
+        return true;
+    }
+
+    // Call once the sprites of an acquired frame are filled. Returns false if the feeder reused the
+    // slot meanwhile, so some of the sprites may come from a later frame.
+    bool release(const FeedFrame& frame) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (ring.slot(frame.number).sequence.load(std::memory_order_relaxed) != frame.number * 2) {
+            torn++;
+            return false;
+        }
+        const double latencyMillis = static_cast<double>(spriteFeedNanos() - frame.publishNanos) / 1e6;
+        received++;
+        sprites += frame.count;
+        latencySum += latencyMillis;
+        maxLatency = std::max(maxLatency, latencyMillis);
+        return true;
+    }
+
+    // Appends the feed statistics since the last call to the FPS line
+    void report(std::ostream& out, const double elapsedMillis) {
+        if (!enabled()) return;
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        out << ", feed: " << received << " frames, " << missed << " missed, " << repeated << " repeated, "
+            << torn << " torn";
+        if (received > 0) {
+            const double seconds = elapsedMillis / 1000;
+            out << std::fixed << std::setprecision(3) << ", handoff: " << latencySum / static_cast<double>(received)
+                << " ms avg, " << maxLatency << " ms max, " << std::setprecision(1)
+                << static_cast<double>(sprites) / seconds / 1e6 << " M sprites/s ("
+                << static_cast<double>(sprites * 2 * sizeof(float)) / seconds / (1 << 20) << " MiB/s)";
+        }
+        out.flags(flags);
+        out.precision(precision);
+        received = 0;
+        missed = 0;
+        repeated = 0;
+        torn = 0;
+        sprites = 0;
+        latencySum = 0;
+        maxLatency = 0;
+    }
+
+private:
+    std::string name;
+    SpriteFeedRing ring;
+    bool waiting = false;
+    FeedFrame last;
+    uint64_t received = 0;
+    uint64_t missed = 0;
+    uint64_t repeated = 0;
+    uint64_t torn = 0;
+    uint64_t sprites = 0;
+    double latencySum = 0;
+    double maxLatency = 0;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "frame_arena.h"
+#include "thread_pool.h"
+
+// Packs a sprite's draw order into a radix-sortable key: depth in the high half so sprites
+// draw back to front, texture in the low half so equal-depth sprites batch by texture
+inline uint64_t spriteSortKey(const float depth, const uint32_t texture) {
+    // Flip the sign bit of positive floats and all bits of negative ones, so the unsigned
+    // bit patterns order the same as the floats
+    const uint32_t bits = std::bit_cast<uint32_t>(depth);
+    const uint32_t sortable = bits ^ (bits & 0x80000000u ? 0xffffffffu : 0x80000000u);
+    return static_cast<uint64_t>(sortable) << 32 | texture;
+}
+
+// Multi-threaded LSD radix sort of sprite indices by a 64-bit key, 8 bits per pass. Every
+// thread histograms and scatters its own contiguous range, so the sort is stable. Bytes that
+// are the same in every key are skipped, so a key that only uses 32 bits costs 4 passes.
+class SpriteSorter {
+public:
+    explicit SpriteSorter(ThreadPool& pool) : pool(pool), histograms(pool.size()), keyBits(pool.size(), {0, ~0ull}) {}
+
+    // Sorts `indices` (or 0..count-1 when null) by keyOf(index) and returns the sorted indices.
+    // The keys and indices live in `arena`, so the result is valid as long as its frame is.
+    template<typename KeyFn>
+    const uint32_t* sort(FrameArena& arena, const uint32_t* indices, const size_t count, KeyFn&& keyOf) {
+        uint64_t* keys[2] = {arena.allocate<uint64_t>(count), arena.allocate<uint64_t>(count)};
+        uint32_t* values[2] = {arena.allocate<uint32_t>(count), arena.allocate<uint32_t>(count)};
+
+        // Build the keys, tracking which bits differ between them
+        pool.parallelFor(count, [&](const size_t begin, const size_t end, const unsigned threadIndex) {
+            uint64_t* __restrict outKeys = keys[0];
+            uint32_t* __restrict outValues = values[0];
+            uint64_t anySet = 0, allSet = ~0ull;
+            for (size_t i = begin; i < end; i++) {
+                const uint32_t index = indices ? indices[i] : static_cast<uint32_t>(i);
+                const uint64_t key = keyOf(index);
+                outKeys[i] = key;
+                outValues[i] = index;
+                anySet |= key;
+                allSet &= key;
+            }
+            keyBits[threadIndex] = {anySet, allSet};
+        });
+
+        uint64_t anySet = 0, allSet = ~0ull;
+        for (auto& [threadAny, threadAll] : keyBits) {
+            anySet |= threadAny;
+            allSet &= threadAll;
+            threadAny = 0;
+            threadAll = ~0ull;
+        }
+        const uint64_t varyingBits = anySet ^ allSet;
+
+        int current = 0;
+        for (int shift = 0; shift < 64; shift += 8) {
+            if (((varyingBits >> shift) & 0xff) == 0) continue;
+
+            // Threads with an empty range never run, so their histograms are cleared up front
+            for (Histogram& histogram : histograms) {
+                std::fill(std::begin(histogram.count), std::end(histogram.count), 0);
+            }
+            pool.parallelFor(count, [&](const size_t begin, const size_t end, const unsigned threadIndex) {
+                uint32_t* __restrict histogram = histograms[threadIndex].count;
+                const uint64_t* __restrict inKeys = keys[current];
+                for (size_t i = begin; i < end; i++) {
+                    histogram[(inKeys[i] >> shift) & 0xff]++;
+                }
+            });
+
+            // Turn the counts into scatter offsets, digit-major then thread-major
+            uint32_t offset = 0;
+            for (int digit = 0; digit < 256; digit++) {
+                for (Histogram& histogram : histograms) {
+                    const uint32_t digitCount = histogram.count[digit];
+                    histogram.count[digit] = offset;
+                    offset += digitCount;
+                }
+            }
+
+            pool.parallelFor(count, [&](const size_t begin, const size_t end, const unsigned threadIndex) {
+                uint32_t* __restrict cursor = histograms[threadIndex].count;
+                const uint64_t* __restrict inKeys = keys[current];
+                const uint32_t* __restrict inValues = values[current];
+                uint64_t* __restrict outKeys = keys[current ^ 1];
+                uint32_t* __restrict outValues = values[current ^ 1];
+                for (size_t i = begin; i < end; i++) {
+                    const uint32_t slot = cursor[(inKeys[i] >> shift) & 0xff]++;
+                    outKeys[slot] = inKeys[i];
+                    outValues[slot] = inValues[i];
+                }
+            });
+            current ^= 1;
+        }
+
+        return values[current];
+    }
+
+private:
+    struct alignas(64) Histogram {
+        uint32_t count[256];
+    };
+
+    ThreadPool& pool;
+    std::vector<Histogram> histograms; // one per thread, cache-line aligned against false sharing
+    std::vector<std::pair<uint64_t, uint64_t>> keyBits; // per-thread OR and AND of all keys
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Captured during static initialization, i.e. before main() runs, as the closest portable
+// stand-in for process start
+inline const std::chrono::steady_clock::time_point processStartTime = std::chrono::steady_clock::now();
+
+// Splits the time from process start to the first presented frame into named phases.
+// Each mark() closes the phase that started at the previous mark.
+class StartupProfiler {
+public:
+    void mark(const char* phase) {
+        const auto now = std::chrono::steady_clock::now();
+        phases.push_back({phase, millisBetween(lastMark, now)});
+        lastMark = now;
+    }
+
+    // Shown next to the total, e.g. whether the pipeline cache was cold or warm
+    void setVariant(const char* name) {
+        variant = name;
+    }
+
+    // Closes the last phase and prints the breakdown. Returns true only on the call that reported.
+    bool reportFirstFrame() {
+        if (isReported) return false;
+        mark("first frame");
+        isReported = true;
+
+        std::cout << "Startup";
+        if (variant) std::cout << " (" << variant << ")";
+        std::cout << ": " << std::fixed << std::setprecision(2)
+            << millisBetween(processStartTime, lastMark) << " ms to first frame" << std::endl;
+        for (const auto& [name, millis] : phases) {
+            std::cout << "  " << std::left << std::setw(24) << name << std::right << std::setw(9) << millis << " ms" << std::endl;
+        }
+        std::cout.unsetf(std::ios::floatfield | std::ios::adjustfield);
+        std::cout << std::setprecision(6);
+        return true;
+    }
+
+    bool reported() const { return isReported; }
+
+    float totalMillis() const {
+        return millisBetween(processStartTime, lastMark);
+    }
+
+private:
+    struct Phase {
+        const char* name;
+        float millis;
+    };
+
+    static float millisBetween(const std::chrono::steady_clock::time_point a, const std::chrono::steady_clock::time_point b) {
+        return std::chrono::duration<float, std::milli>(b - a).count();
+    }
+
+    std::chrono::steady_clock::time_point lastMark = processStartTime;
+    std::vector<Phase> phases;
+    const char* variant = nullptr;
+    bool isReported = false;
+};
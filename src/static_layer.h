@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <utility>
+
+#include "args.h"
+#include "bunnies.h"
+#include "world.h"
+
+// Largest side of a layer that covers the whole world, 64 MiB of RGBA8. The layer of a larger
+// world only covers the view, so it is redrawn whenever the camera moves.
+constexpr uint32_t MAX_STATIC_LAYER_SIZE = 4096;
+
+// Cached static layer (--static P): P percent of the bunnies are frozen in place, scattered over
+// the world, and drawn once into an offscreen target that every frame composites under the moving
+// ones. Only the moving bunnies are simulated, uploaded and drawn per frame. The layer is redrawn
+// when a frozen bunny changes, which --static-edits N forces by moving one every N frames, or when
+// the caller invalidates it.
+class StaticLayer {
+public:
+    StaticLayer(const int argc, char* argv[], const uint32_t bunnyCount, const World& world, const float windowWidth, const float windowHeight)
+        : editInterval(static_cast<uint32_t>(std::max(getIntArg(argc, argv, "--static-edits", 0), 0L))),
+          viewWidth(static_cast<uint32_t>(windowWidth)),
+          viewHeight(static_cast<uint32_t>(windowHeight)),
+          spawnX(0.0f, world.width - BUNNY_SIZE),
+          spawnY(0.0f, world.height - BUNNY_SIZE) {
+        // At least one bunny keeps moving, so there is always something to draw on top
+        const float percent = std::clamp(getFloatArg(argc, argv, "--static", 0.0f), 0.0f, 100.0f);
+        const auto frozen = std::min(static_cast<uint32_t>(static_cast<double>(bunnyCount) * percent / 100.0), bunnyCount - 1);
+        frozenBunnies.reserve(frozen);
+        for (uint32_t i = 0; i < frozen; i++) {
+            frozenBunnies.push_back({spawnX(rng), spawnY(rng), 0, 0});
+        }
+
+        coversWorld = world.width <= MAX_STATIC_LAYER_SIZE && world.height <= MAX_STATIC_LAYER_SIZE;
+        layerWidth = coversWorld ? std::max(static_cast<uint32_t>(std::ceil(world.width)), viewWidth) : viewWidth;
+        layerHeight = coversWorld ? std::max(static_cast<uint32_t>(std::ceil(world.height)), viewHeight) : viewHeight;
+    }
+
+    bool enabled() const { return frozenBunnies.size() > 0; }
+    uint32_t size() const { return static_cast<uint32_t>(frozenBunnies.size()); }
+    const Bunnies& bunnies() const { return frozenBunnies; }
+
+    // Size of the offscreen target in pixels, and the world position of its top-left corner
+    uint32_t width() const { return layerWidth; }
+    uint32_t height() const { return layerHeight; }
+    float originX() const { return layerX; }
+    float originY() const { return layerY; }
+
+    // Top-left corner of the view within the layer, in whole pixels so it can be copied as-is
+    uint32_t sourceX(const Camera& camera) const { return source(camera.x - layerX, layerWidth - viewWidth); }
+    uint32_t sourceY(const Camera& camera) const { return source(camera.y - layerY, layerHeight - viewHeight); }
+
+    void invalidate() { dirty = true; }
+
+    // Call once per frame after the camera has moved. Applies the --static-edits change, then
+    // returns true if the layer has to be redrawn before compositing it this frame.
+    bool beginFrame(const Camera& camera) {
+        if (!enabled()) return false;
+        if (editInterval > 0 && ++frame % editInterval == 0) {
+            const size_t index = std::uniform_int_distribution<size_t>{0, frozenBunnies.size() - 1}(rng);
+            frozenBunnies.x[index] = spawnX(rng);
+            frozenBunnies.y[index] = spawnY(rng);
+            dirty = true;
+        }
+        if (!coversWorld && (camera.x != layerX || camera.y != layerY)) {
+            layerX = camera.x;
+            layerY = camera.y;
+            dirty = true;
+        }
+        if (!dirty) return false;
+        dirty = false;
+        redraws++;
+        return true;
+    }
+
+    // Appends the frozen count and the redraws since the last call to the FPS line
+    void report(std::ostream& out) {
+        if (!enabled()) return;
+        out << ", static: " << frozenBunnies.size() << " frozen, " << std::exchange(redraws, 0) << " layer redraws";
+    }
+
+private:
+    static uint32_t source(const float offset, const uint32_t maximum) {
+        return std::min(static_cast<uint32_t>(std::max(std::lround(offset), 0L)), maximum);
+    }
+
+    uint32_t editInterval;
+    uint32_t viewWidth, viewHeight;
+    std::mt19937 rng; // NOLINT deterministic, and apart from the moving bunnies' so replays match
+    std::uniform_real_distribution<float> spawnX, spawnY;
+    Bunnies frozenBunnies;
+    bool coversWorld = true;
+    uint32_t layerWidth = 0, layerHeight = 0;
+    float layerX = 0, layerY = 0;
+    bool dirty = true;
+    uint32_t frame = 0;
+    uint32_t redraws = 0;
+};
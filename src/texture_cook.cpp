@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "SDL3/SDL_init.h"
+#include "SDL3/SDL_log.h"
+#include "SDL3/SDL_surface.h"
+
+#include "texture_pack.h"
+
+// Offline cook step: decodes sprite PNGs once and writes them into a single texture pack
+// with RGBA8 mip chains, ready to be uploaded straight from a memory mapping at runtime.
+//
+// Usage: texture_cook <output.pack> <input.png>...
+
+void logError(const char* errorText) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "%s: %s", errorText, SDL_GetError());
+}
+
+struct CookedTexture {
+    PackTexture entry;
+    std::vector<uint8_t> pixels;
+};
+
+// Appends every further mip level to the level 0 pixels, each a 2x2 box filter of the
+// previous one (clamped at the edges of odd-sized levels)
+void appendMips(CookedTexture& texture) {
+    uint32_t level = 0;
+    while (packMipDimension(texture.entry.width, level) > 1 || packMipDimension(texture.entry.height, level) > 1) {
+        const uint32_t srcWidth = packMipDimension(texture.entry.width, level);
+        const uint32_t srcHeight = packMipDimension(texture.entry.height, level);
+        const uint32_t dstWidth = packMipDimension(texture.entry.width, level + 1);
+        const uint32_t dstHeight = packMipDimension(texture.entry.height, level + 1);
+
+        const size_t srcOffset = packMipOffset(texture.entry, level);
+        texture.pixels.resize(texture.pixels.size() + static_cast<size_t>(dstWidth) * dstHeight * 4);
+        const uint8_t* src = texture.pixels.data() + srcOffset;
+        uint8_t* dst = texture.pixels.data() + packMipOffset(texture.entry, level + 1);
+
+        for (uint32_t y = 0; y < dstHeight; y++) {
+            for (uint32_t x = 0; x < dstWidth; x++) {
+                const uint32_t x0 = std::min(x * 2, srcWidth - 1), x1 = std::min(x * 2 + 1, srcWidth - 1);
+                const uint32_t y0 = std::min(y * 2, srcHeight - 1), y1 = std::min(y * 2 + 1, srcHeight - 1);
+                for (uint32_t channel = 0; channel < 4; channel++) {
+                    const uint32_t sum = src[(y0 * srcWidth + x0) * 4 + channel]
+                        + src[(y0 * srcWidth + x1) * 4 + channel]
+                        + src[(y1 * srcWidth + x0) * 4 + channel]
+                        + src[(y1 * srcWidth + x1) * 4 + channel];
+                    dst[(y * dstWidth + x) * 4 + channel] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        level++;
+    }
+    texture.entry.mipCount = level + 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <output.pack> <input.png>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<CookedTexture> textures;
+    for (int i = 2; i < argc; i++) {
+        const std::string name = std::filesystem::path(argv[i]).stem().string();
+        if (name.size() >= sizeof(PackTexture::name)) {
+            std::cerr << "Texture name too long: " << name << std::endl;
+            return 1;
+        }
+
+        // Decode and swizzle into RGBA8 byte order
+        SDL_Surface* loaded = SDL_LoadPNG(argv[i]);
+        if (!loaded) {
+            logError("Failed to load image");
+            return 1;
+        }
+        SDL_Surface* surface = SDL_ConvertSurface(loaded, SDL_PIXELFORMAT_RGBA32);
+        SDL_DestroySurface(loaded);
+        if (!surface) {
+            logError("Failed to convert image to RGBA8");
+            return 1;
+        }
+
+        CookedTexture texture{};
+        texture.entry.nameHash = packNameHash(name);
+        std::memcpy(texture.entry.name, name.c_str(), name.size());
+        texture.entry.width = static_cast<uint32_t>(surface->w);
+        texture.entry.height = static_cast<uint32_t>(surface->h);
+        texture.entry.format = PackFormat::RGBA8;
+
+        const size_t rowSize = static_cast<size_t>(surface->w) * 4;
+        texture.pixels.resize(rowSize * surface->h);
+        for (int y = 0; y < surface->h; y++) {
+            std::memcpy(
+                texture.pixels.data() + y * rowSize,
+                static_cast<const uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch,
+                rowSize
+            );
+        }
+        SDL_DestroySurface(surface);
+
+        appendMips(texture);
+        texture.entry.dataSize = texture.pixels.size();
+        textures.push_back(std::move(texture));
+    }
+
+    // The runtime binary searches the table by name hash
+    std::sort(textures.begin(), textures.end(), [](const CookedTexture& a, const CookedTexture& b) {
+        return a.entry.nameHash < b.entry.nameHash;
+    });
+
+    auto alignUp = [](const uint64_t offset) {
+        return (offset + PACK_DATA_ALIGNMENT - 1) / PACK_DATA_ALIGNMENT * PACK_DATA_ALIGNMENT;
+    };
+    uint64_t offset = alignUp(sizeof(PackHeader) + textures.size() * sizeof(PackTexture));
+    for (CookedTexture& texture : textures) {
+        texture.entry.dataOffset = offset;
+        offset = alignUp(offset + texture.entry.dataSize);
+    }
+
+    std::ofstream stream(argv[1], std::ios::binary | std::ios::trunc);
+    if (!stream) {
+        std::cerr << "Failed to open " << argv[1] << " for writing" << std::endl;
+        return 1;
+    }
+
+    PackHeader header{};
+    std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = PACK_VERSION;
+    header.textureCount = static_cast<uint32_t>(textures.size());
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const CookedTexture& texture : textures) {
+        stream.write(reinterpret_cast<const char*>(&texture.entry), sizeof(texture.entry));
+    }
+    for (const CookedTexture& texture : textures) {
+        // Pad up to the page-aligned start of this texture
+        const std::vector<char> padding(texture.entry.dataOffset - static_cast<uint64_t>(stream.tellp()), 0);
+        stream.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        stream.write(reinterpret_cast<const char*>(texture.pixels.data()), static_cast<std::streamsize>(texture.pixels.size()));
+    }
+    if (!stream) {
+        std::cerr << "Failed to write " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::cout << "Cooked " << textures.size() << " textures into " << argv[1] << " (" << offset << " bytes)" << std::endl;
+    return 0;
+}
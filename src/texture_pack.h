@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "mapped_file.h"
+
+// Texture pack written by the offline cook step (texture_cook) and memory-mapped at runtime.
+// Layout: PackHeader, then PackTexture entries sorted by name hash, then the pixel data of
+// every texture at a page-aligned offset. Pixel data is RGBA8 in byte order, with the full
+// mip chain stored largest level first and each level tightly packed, so it can be handed to
+// the graphics API straight from the mapping. Opening a pack only validates the header and
+// the table, so it costs the same no matter how many textures or bytes the pack holds.
+
+constexpr char PACK_MAGIC[4] = {'B', 'N', 'Y', 'P'};
+constexpr uint32_t PACK_VERSION = 1;
+constexpr uint64_t PACK_DATA_ALIGNMENT = 4096;
+
+enum class PackFormat : uint32_t {
+    RGBA8 = 0
+};
+
+struct PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t textureCount;
+    uint32_t reserved;
+};
+
+struct PackTexture {
+    uint64_t nameHash;
+    char name[32];
+    uint32_t width, height;
+    uint32_t mipCount;
+    PackFormat format;
+    uint64_t dataOffset; // from the start of the pack
+    uint64_t dataSize;   // all mip levels
+};
+
+// FNV-1a, also used by the cook step to sort the table
+constexpr uint64_t packNameHash(const std::string_view name) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+constexpr uint32_t packMipDimension(const uint32_t size, const uint32_t level) {
+    return std::max(1u, size >> level);
+}
+
+constexpr uint64_t packMipSize(const PackTexture& texture, const uint32_t level) {
+    return static_cast<uint64_t>(packMipDimension(texture.width, level)) * packMipDimension(texture.height, level) * 4;
+}
+
+// Offset of a mip level from the start of the texture's data
+constexpr uint64_t packMipOffset(const PackTexture& texture, const uint32_t level) {
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < level; i++) {
+        offset += packMipSize(texture, i);
+    }
+    return offset;
+}
+
+class TexturePack {
+public:
+    bool open(const char* path) {
+        if (!file.open(path)) return false;
+
+        if (file.size() < sizeof(PackHeader)) return fail();
+        std::memcpy(&header, file.data(), sizeof(PackHeader));
+        if (std::memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header.version != PACK_VERSION) {
+            return fail();
+        }
+        if (file.size() < sizeof(PackHeader) + static_cast<uint64_t>(header.textureCount) * sizeof(PackTexture)) {
+            return fail();
+        }
+
+        textures = reinterpret_cast<const PackTexture*>(file.data() + sizeof(PackHeader));
+        return true;
+    }
+
+    // Binary search over the hash-sorted table, nullptr if the pack has no such texture or
+    // its entry points outside the pack. Entries are only validated when looked up.
+    const PackTexture* find(const std::string_view name) const {
+        const uint64_t hash = packNameHash(name);
+        const PackTexture* end = textures + header.textureCount;
+        const PackTexture* it = std::lower_bound(textures, end, hash, [](const PackTexture& texture, const uint64_t value) {
+            return texture.nameHash < value;
+        });
+        for (; it != end && it->nameHash == hash; ++it) {
+            if (name == std::string_view(it->name, strnlen(it->name, sizeof(it->name)))) {
+                return isValid(*it) ? it : nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    const uint8_t* data(const PackTexture& texture, const uint32_t level = 0) const {
+        return file.data() + texture.dataOffset + packMipOffset(texture, level);
+    }
+
+private:
+    bool isValid(const PackTexture& texture) const {
+        return texture.format == PackFormat::RGBA8
+            && texture.mipCount > 0 && texture.mipCount <= 32
+            && texture.dataSize >= packMipOffset(texture, texture.mipCount)
+            && texture.dataOffset <= file.size()
+            && texture.dataSize <= file.size() - texture.dataOffset;
+    }
+
+    bool fail() {
+        file.close();
+        textures = nullptr;
+        header = {};
+        return false;
+    }
+
+    MappedFile file;
+    PackHeader header {};
+    const PackTexture* textures = nullptr;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel frame work. The calling thread takes part
+// as thread 0, so a pool of size 1 runs everything inline.
+class ThreadPool {
+public:
+    explicit ThreadPool(const unsigned threadCount = std::max(1u, std::thread::hardware_concurrency()))
+        : threadCount(std::max(1u, threadCount)) {
+        for (unsigned i = 1; i < this->threadCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return threadCount; }
+
+    // Splits [0, count) into one contiguous range per thread and calls fn(begin, end, threadIndex)
+    // for each non-empty range. Blocks until every range is done.
+    template<typename Fn>
+    void parallelFor(const size_t count, Fn&& fn) {
+        const size_t chunk = (count + threadCount - 1) / threadCount;
+        auto task = [&](const unsigned threadIndex) {
+            const size_t begin = std::min(count, threadIndex * chunk);
+            const size_t end = std::min(count, begin + chunk);
+            if (begin < end) fn(begin, end, threadIndex);
+        };
+        run([](void* context, const unsigned threadIndex) {
+            (*static_cast<decltype(task)*>(context))(threadIndex);
+        }, &task);
+    }
+
+private:
+    using Invoke = void (*)(void* context, unsigned threadIndex);
+
+    void run(const Invoke invoke, void* context) {
+        if (threadCount == 1) {
+            invoke(context, 0);
+            return;
+        }
+        {
+            std::lock_guard lock(mutex);
+            job = invoke;
+            jobContext = context;
+            pending = threadCount - 1;
+            generation++;
+        }
+        wake.notify_all();
+        invoke(context, 0);
+
+        std::unique_lock lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+
+    void workerLoop(const unsigned threadIndex) {
+        uint64_t seenGeneration = 0;
+        while (true) {
+            Invoke invoke;
+            void* context;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] { return generation != seenGeneration; });
+                seenGeneration = generation;
+                if (stopping) return;
+                invoke = job;
+                context = jobContext;
+            }
+
+            invoke(context, threadIndex);
+
+            std::lock_guard lock(mutex);
+            if (--pending == 0) done.notify_one();
+        }
+    }
+
+    unsigned threadCount;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    unsigned pending = 0;
+    bool stopping = false;
+    Invoke job = nullptr;
+    void* jobContext = nullptr;
+};
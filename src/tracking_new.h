@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+#include "alloc_tracker.h"
+
+// Replaces the global operator new/delete with malloc-based versions that count into
+// allocationTracker. Include from the one translation unit of a binary. The nothrow forms
+// default to these, every other form is replaced so no runtime or sanitizer mixes in its own.
+
+inline void* trackedNew(const std::size_t size) {
+    allocationTracker.record(AllocSource::New, size);
+    if (void* memory = std::malloc(size > 0 ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+inline void* trackedAlignedNew(const std::size_t size, const std::align_val_t alignment) {
+    allocationTracker.record(AllocSource::New, size);
+    const auto align = static_cast<std::size_t>(alignment);
+#if defined(_WIN32)
+    void* memory = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+    // aligned_alloc wants a non-zero multiple of the alignment
+    void* memory = std::aligned_alloc(align, ((size > 0 ? size : 1) + align - 1) / align * align);
+#endif
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+inline void trackedAlignedDelete(void* memory) noexcept {
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void* operator new(const std::size_t size) { return trackedNew(size); }
+void* operator new[](const std::size_t size) { return trackedNew(size); }
+void* operator new(const std::size_t size, const std::align_val_t alignment) { return trackedAlignedNew(size, alignment); }
+void* operator new[](const std::size_t size, const std::align_val_t alignment) { return trackedAlignedNew(size, alignment); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { trackedAlignedDelete(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { trackedAlignedDelete(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { trackedAlignedDelete(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { trackedAlignedDelete(memory); }
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "bunnies.h"
+#include "world.h"
+
+// Hash of the bunnies' exact state: FNV-1a over the count and the bits of every component, so
+// any kernel that rounds differently from the one that recorded it shows up
+inline uint64_t bunnyStateHash(const Bunnies& bunnies) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const auto mix = [&hash](const uint64_t word) { hash = (hash ^ word) * 0x100000001b3ull; };
+    mix(bunnies.size());
+    for (const BunnyArray* values : {&bunnies.x, &bunnies.y, &bunnies.vx, &bunnies.vy}) {
+        for (const float value : *values) {
+            mix(std::bit_cast<uint32_t>(value));
+        }
+    }
+    return hash;
+}
+
+// Deterministic workload recording (--record FILE) and replay (--replay FILE). The bunnies are
+// spawned from a fixed seed, so what a run simulates only depends on its options and on the time
+// of every frame. A recording stores the latter, the frame time and the time since the start that
+// pans the camera, along with a hash of the bunnies every --hash-interval N frames (default 60).
+// A replay drives the simulation with the recorded times instead of the clock, so any binary goes
+// through exactly the same states as the recording did, and checks every hash on the way. It ends
+// once all recorded frames are played. The file is read up front, so replay does no I/O per frame.
+//
+// File layout, in native byte order: a FileHeader, then per frame a FrameRecord, followed by the
+// state hash on every hashInterval-th frame.
+class WorkloadLog {
+public:
+    static constexpr uint32_t MAGIC = 0x52594e42; // "BNYR"
+    static constexpr uint32_t VERSION = 1;
+
+    struct FileHeader {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t bunnyCount;
+        uint32_t hashInterval;
+        float worldWidth, worldHeight;
+        float tickMillis; // 0 without --tick-rate
+        uint32_t reserved = 0;
+        uint64_t initialHash;
+    };
+
+    struct FrameRecord {
+        float frameMillis;
+        float sceneMillis;
+    };
+
+    WorkloadLog(const int argc, char* argv[])
+        : recordPath(getArg(argc, argv, "--record", "")),
+          replayPath(getArg(argc, argv, "--replay", "")),
+          hashInterval(static_cast<uint32_t>(std::max(getIntArg(argc, argv, "--hash-interval", 60), 1L))) {
+        if ((recording() || replaying()) && hasArg(argc, argv, "--ablate")) {
+            std::cerr << "--record and --replay are ignored with --ablate, which rewinds the bunnies" << std::endl;
+            recordPath.clear();
+            replayPath.clear();
+        }
+        if (recording() && replaying()) {
+            std::cerr << "--record is ignored with --replay" << std::endl;
+            recordPath.clear();
+        }
+    }
+
+    bool recording() const { return !recordPath.empty(); }
+    bool replaying() const { return !replayPath.empty(); }
+    // True if the replay could not start or a state hash did not match in any run
+    bool failed() const { return broken || mismatched; }
+
+    // Call once the bunnies are spawned, and again whenever a run starts over from fresh ones.
+    // Writes the header of a recording, or loads a replay and checks it was recorded with the
+    // same population, world and tick.
+    void start(const Bunnies& bunnies, const World& world, const float tickMillis) {
+        frame = 0;
+        hashIndex = 0;
+        mismatches = 0;
+        const FileHeader expected{
+            .bunnyCount = static_cast<uint32_t>(bunnies.size()),
+            .hashInterval = hashInterval,
+            .worldWidth = world.width,
+            .worldHeight = world.height,
+            .tickMillis = tickMillis,
+            .initialHash = bunnyStateHash(bunnies)
+        };
+
+        if (recording()) {
+            output.open(recordPath, std::ios::binary | std::ios::trunc);
+            if (!output.write(reinterpret_cast<const char*>(&expected), sizeof(expected))) {
+                std::cerr << "Failed to create " << recordPath << ", not recording" << std::endl;
+                recordPath.clear();
+            }
+        }
+        if (replaying() && frames.empty() && !broken) {
+            load();
+        }
+        if (replaying() && !broken) {
+            const char* mismatch = header.bunnyCount != expected.bunnyCount ? "--bunnies"
+                : header.worldWidth != expected.worldWidth || header.worldHeight != expected.worldHeight ? "--world-scale"
+                : header.tickMillis != expected.tickMillis ? "--tick-rate"
+                : header.initialHash != expected.initialHash ? "spawn options"
+                : nullptr;
+            if (mismatch) {
+                std::cerr << replayPath << " was recorded with different " << mismatch
+                    << ", replay with the options it was recorded with" << std::endl;
+                broken = true;
+            }
+        }
+    }
+
+    // Call at the top of every frame with its measured time and the time since the start. A
+    // recording stores them, a replay replaces them with the recorded ones. Returns false once a
+    // replay has played every frame, or could not start, after printing its result.
+    bool beginFrame(float& frameMillis, float& sceneMillis) {
+        if (recording()) {
+            const FrameRecord record{frameMillis, sceneMillis};
+            output.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+        if (!replaying()) return true;
+        if (broken) return false;
+        if (frame == frames.size()) {
+            std::cout << "Replayed " << frames.size() << " frames of " << replayPath << ", "
+                << hashIndex - mismatches << " of " << hashIndex << " state hashes matched";
+            if (mismatches > 0) {
+                std::cout << ", first mismatch at frame " << firstMismatchFrame;
+            }
+            std::cout << std::endl;
+            return false;
+        }
+        frameMillis = frames[frame].frameMillis;
+        sceneMillis = frames[frame].sceneMillis;
+        return true;
+    }
+
+    // Call once per frame after the simulation. Every hashInterval frames, writes the hash of the
+    // bunnies to a recording, or checks it against a replay's.
+    void endSimulation(const Bunnies& bunnies) {
+        if (!recording() && !replaying()) return;
+        if (++frame % hashInterval != 0) return;
+        const uint64_t hash = bunnyStateHash(bunnies);
+        if (recording()) {
+            output.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+            return;
+        }
+        if (hashIndex >= hashes.size()) return;
+        if (hashes[hashIndex] != hash && mismatches++ == 0) {
+            mismatched = true;
+            firstMismatchFrame = frame;
+            std::cerr << "State hash mismatch at frame " << frame << " of " << replayPath << std::hex
+                << ": recorded " << hashes[hashIndex] << ", got " << hash << std::dec << std::endl;
+        }
+        hashIndex++;
+    }
+
+    // Appends the progress of the recording or replay to the FPS line
+    void report(std::ostream& out) const {
+        if (recording()) {
+            out << ", recording: " << frame << " frames";
+        } else if (replaying()) {
+            out << ", replay: " << frame << "/" << frames.size() << " frames, " << mismatches << " mismatches";
+        }
+    }
+
+private:
+    // Reads the whole replay, dropping a frame cut short by a recording that was killed
+    void load() {
+        std::ifstream input(replayPath, std::ios::binary);
+        if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MAGIC
+            || header.version != VERSION || header.hashInterval == 0) {
+            std::cerr << "Failed to read " << replayPath << ", not a bunnymark recording" << std::endl;
+            broken = true;
+            return;
+        }
+        hashInterval = header.hashInterval;
+        FrameRecord record;
+        while (input.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+            if ((frames.size() + 1) % hashInterval == 0) {
+                uint64_t hash;
+                if (!input.read(reinterpret_cast<char*>(&hash), sizeof(hash))) break;
+                hashes.push_back(hash);
+            }
+            frames.push_back(record);
+        }
+    }
+
+    std::string recordPath, replayPath;
+    uint32_t hashInterval;
+    std::ofstream output;
+    FileHeader header{};
+    std::vector<FrameRecord> frames;
+    std::vector<uint64_t> hashes;
+    bool broken = false;
+    bool mismatched = false;
+    size_t frame = 0;
+    size_t hashIndex = 0;
+    size_t mismatches = 0;
+    size_t firstMismatchFrame = 0;
+};
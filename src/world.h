@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "args.h"
+
+// Large-world mode: bunnies roam a world that can be much bigger than the window,
+// while a camera pans across it so only part of the population is ever on screen.
+
+struct World {
+    float width, height;
+
+    bool isLarge(const float viewWidth, const float viewHeight) const {
+        return width > viewWidth || height > viewHeight;
+    }
+};
+
+// `--world-scale N` makes the world N times the window size in each dimension
+inline World getWorld(const int argc, char* argv[], const float windowWidth, const float windowHeight) {
+    const float scale = std::max(getFloatArg(argc, argv, "--world-scale", 1.0f), 1.0f);
+    return {windowWidth * scale, windowHeight * scale};
+}
+
+struct Camera {
+    float x, y;          // top-left corner in world space
+    float width, height; // size of the view, i.e. the window
+
+    // Sweeps the view over the whole world on a slow Lissajous path
+    void update(const World& world, const float timeMillis) {
+        x = (world.width - width) * 0.5f * (1.0f + std::sin(timeMillis * 0.00021f));
+        y = (world.height - height) * 0.5f * (1.0f + std::sin(timeMillis * 0.00034f));
+    }
+};